@@ -30,6 +30,8 @@
 #endif
 
 #define ENABLE_NULLSPACE 1
+// record begin/end events for --trace (see trace.h)
+#define ENABLE_TRACE 1
 #define APP_NAME "OpenGL-Template [BUILT: " __TIME__ "]"
 
 #define glchk_ assert(glGetError() == GL_NO_ERROR);
@@ -0,0 +1,11 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+// Micro-benchmarks of the engine's CPU-side subsystems. These run in place
+// of the demo (see --bench) and need no window or GL context.
+
+// run the benchmark called "name", setting "*passed" to false if one of
+// its results failed a check. Returns false if there is no such benchmark.
+extern bool bench_run(const char *name, bool *passed);
+
+#endif
@@ -38,6 +38,12 @@ public:
 
   void apply(float dt);
 
+  // go to where the scripted path is "t" seconds in: an orbit of about
+  // "radius" around the target, moving in and out and up and down so
+  // that what is seen, and from how far, keeps changing. A function of
+  // "t" alone, unlike the showreel, for repeatable benchmarks.
+  void follow_path(float t, float radius);
+
   // return projection matrix
   inline const glm::mat4 &get_proj(void) const { return proj; }
 
@@ -0,0 +1,92 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "base.h"
+#include "readback.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+enum capture_format_t {
+  CAPTURE_PPM = 0, // concatenated binary (P6) images
+  CAPTURE_Y4M,     // YUV4MPEG2, 4:2:0 full range; ffmpeg & co. read it
+};
+
+struct capture_stats_t {
+  uint64_t captured;         // frames whose readback was issued
+  uint64_t written;          // frames written out
+  uint64_t dropped_readback; // skipped: every pixel buffer still in flight
+  uint64_t dropped_writer;   // skipped: the writer had fallen behind
+  double latency_sum_ms;     // readback issued to frame written
+  double latency_max_ms;
+};
+
+// Captures frames of the bound read framebuffer to a file or a pipe.
+// grab() only issues an asynchronous readback (see readback_t); poll()
+// hands finished ones to a worker thread which converts and writes them.
+// A caller that reads every frame back anyway passes them to submit()
+// instead, and the capture then never reads back a frame of its own.
+// Unless lossless, frames are dropped rather than ever stalling the
+// render thread.
+struct capture_t {
+  capture_t(void)
+      : out(NULL), piped(false), format(CAPTURE_Y4M), width(0), height(0),
+        lossless(false), stopping(false), stats_() {}
+
+  // "path" is a file name, or "|command" to pipe into a command's stdin.
+  // Paths ending in ".ppm" get PPM frames, anything else Y4M.
+  bool init(const char *path, int width, int height, int fps, bool lossless);
+  void teardown(void);
+
+  inline bool active(void) const { return out != NULL; }
+
+  // read back the current frame; call once it is fully drawn
+  void grab(uint64_t frame);
+  // pass finished readbacks on to the writer
+  void poll(void);
+  // write a frame read back by the caller, in the layout of readback_t
+  void submit(const uint8_t *rgba, uint64_t frame,
+              tsamplr_t::storage_t issued);
+
+  capture_stats_t stats(void);
+
+private:
+  struct frame_t {
+    std::vector<uint8_t> rgba;
+    uint64_t frame;
+    tsamplr_t::storage_t issued;
+  };
+
+  readback_t readback;
+  readback_t::sink_fn_t sink;
+
+  FILE *out;
+  bool piped;
+  capture_format_t format;
+  int width, height;
+  bool lossless;
+
+  // frames owned by the writer are in "ready", the rest in "idle"
+  std::vector<frame_t> frames;
+  std::vector<uint32_t> idle;
+  std::deque<uint32_t> ready;
+
+  std::mutex lock;
+  std::condition_variable frame_ready, frame_idle;
+  bool stopping;
+  std::thread writer;
+
+  capture_stats_t stats_;
+
+  // writer-only conversion buffer
+  std::vector<uint8_t> scratch;
+
+  void enqueue(const uint8_t *rgba, uint64_t frame,
+               tsamplr_t::storage_t issued);
+  void writer_main(void);
+  void write_frame(const frame_t &f);
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef __COLLISION_H__
+#define __COLLISION_H__
+
+#include "scene.h"
+
+enum shape_t { SHAPE_SPHERE = 0, SHAPE_BOX };
+
+// collision proxies of the scene's entities (structure-of-arrays). For
+// spheres "extent" is the radius along every axis, for boxes it is the
+// half size of the axis-aligned box.
+struct collider_set_t {
+  std::vector<glm::vec3> centre;
+  std::vector<glm::vec3> extent;
+  std::vector<uint8_t> shape;
+  std::vector<entity_t> entity;
+
+  inline uint32_t size(void) const { return (uint32_t)shape.size(); }
+
+  void add(glm::vec3 c, glm::vec3 e, shape_t s, entity_t ent);
+  void clear(void);
+
+  // rebuild the set from the current entity positions
+  void gather(const scene_t &scene);
+};
+
+struct body_pair_t {
+  uint32_t a, b; // collider indices, a < b
+};
+
+enum broadphase_mode_t { BROADPHASE_GRID = 0, BROADPHASE_SAP };
+
+// finds the pairs of colliders whose bounding boxes overlap, either with a
+// spatial hash grid or by sweep-and-prune along the axis of most spread
+struct broadphase_t {
+  broadphase_mode_t mode;
+
+  broadphase_t(void) : mode(BROADPHASE_GRID), cell_size(0.0f), sap_axis(-1) {}
+
+  // (re)build the acceleration structure for "set"
+  void build(const collider_set_t &set);
+
+  // append each overlapping pair once to "out". The search is split across
+  // the job system; the output order does not depend on the thread count.
+  void find_pairs(const collider_set_t &set,
+                  std::vector<body_pair_t> *out) const;
+
+private:
+  // bounds of the colliders, as of the last build
+  std::vector<glm::vec3> aabb_min, aabb_max;
+
+  // spatial hash grid: colliders are binned by the cell of their centre,
+  // and buckets (hashed cells) are stored contiguously in "cell_bodies".
+  // The sorted_* arrays mirror cell_bodies' order.
+  float cell_size;
+  uint32_t bucket_mask;
+  std::vector<glm::ivec3> cell, sorted_cell;
+  std::vector<glm::vec3> sorted_min, sorted_max;
+  std::vector<uint32_t> bucket_start, cell_bodies;
+
+  // sweep-and-prune: colliders sorted by their lower bound on "sap_axis".
+  // The order is kept between builds, as it rarely changes much.
+  int sap_axis;
+  std::vector<uint32_t> sap_order;
+
+  void build_grid(const collider_set_t &set);
+  void build_sap(const collider_set_t &set);
+  void find_pairs_grid(uint32_t begin, uint32_t end,
+                       std::vector<body_pair_t> *out) const;
+  void find_pairs_sap(uint32_t begin, uint32_t end,
+                      std::vector<body_pair_t> *out) const;
+};
+
+struct contact_t {
+  uint32_t a, b;    // collider indices
+  glm::vec3 normal; // from a to b
+  float depth;      // penetration depth along normal
+};
+
+// sphere-sphere and sphere-box tests of the candidate pairs. Box-box pairs
+// are ignored as boxes are driven kinematically.
+extern void narrow_phase(const collider_set_t &set, const body_pair_t *pairs,
+                         size_t count, std::vector<contact_t> *out);
+
+// push spheres out of whatever they penetrate and remove the velocity
+// component carrying them further in
+extern void resolve_contacts(scene_t *scene, const collider_set_t &set,
+                             const std::vector<contact_t> &contacts);
+
+#endif
@@ -2,20 +2,30 @@
 #define __CUBE_H__
 
 #include "object.h"
-
-struct cube_t : public object_t, public gfx_obj_t<cube_t> {
-  cube_t(void) : object_t(), gfx_obj_t<cube_t>() {}
-
-  virtual ~cube_t(void) {}
-
-  virtual void setup(glm::vec3 pos) override final;
-  virtual void teardown(void) override final;
-
-  void update(float dt);
-  void render(GLuint shdr_prog);
-
-private:
+#include "scene.h"
+
+// half the edge length of the cube mesh, in world units
+static const float cube_half_size = 0.5f;
+
+// behaviour and graphics resources shared by every cube entity
+struct cube_t : public gfx_obj_t<cube_t> {
+  static void setup(void);
+  static void teardown(void);
+
+  // cubes are animated kinematically, as a function of the scene time,
+  // all bobbing in step once every 2 pi seconds. Before the scene store
+  // each cube advanced a clock shared by all of them, so n cubes bobbed n
+  // times as fast, a step apart; headless hashes from then differ.
+  static void update(entity_block_t *blk, float time);
+
+  // draw cubes grouped by level of detail, "lod_instances[l]" of level l,
+  // with one instanced draw call per level
+  static void render(const glm::mat4 *models, const uint32_t *lod_instances);
+
+  // draw the cubes a gpu_culler_t found visible, with one indirect draw
+  // per level of detail
+  static void render_indirect(GLuint instances, GLuint commands,
+                              GLintptr cmd_offset, GLsizei cmd_stride);
 };
 
 #endif
-
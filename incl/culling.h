@@ -0,0 +1,134 @@
+#ifndef __CULLING_H__
+#define __CULLING_H__
+
+#include "base.h"
+#include "scene.h"
+#include "integrator.h"
+
+// where the objects the camera cannot see are culled
+enum cull_mode_t {
+  CULL_NONE = 0, // nowhere: every object is drawn
+  CULL_CPU,      // by walking a bvh_t, drawing the rest instanced
+  CULL_GPU,      // by a compute pass writing indirect draws (gpu-cull.h)
+  CULL_MODE_COUNT
+};
+
+extern const char *cull_mode_name(cull_mode_t mode);
+
+// The six planes bounding what a camera sees, normalised and facing
+// inwards: a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for
+// every plane.
+struct frustum_t {
+  enum plane_t {
+    PLANE_LEFT = 0,
+    PLANE_RIGHT,
+    PLANE_BOTTOM,
+    PLANE_TOP,
+    PLANE_NEAR,
+    PLANE_FAR,
+    PLANE_COUNT
+  };
+  glm::vec4 planes[PLANE_COUNT];
+
+  // planes of a GL view-projection matrix, i.e. get_proj() * get_matrix()
+  void extract(const glm::mat4 &view_proj);
+
+  // false if the sphere is certainly outside
+  bool test_sphere(const glm::vec3 &centre, float radius) const;
+};
+
+// what one cull cost and found
+struct cull_stats_t {
+  uint32_t objects;      // entities in the hierarchy
+  uint32_t visible;      // entities that passed
+  uint32_t culled;       // objects - visible
+  uint32_t nodes_tested; // child boxes tested against the frustum
+  bool rebuilt;          // the hierarchy was rebuilt rather than refitted
+  double update_ms;      // time spent bounding, refitting or rebuilding
+  double cull_ms;        // time spent testing
+
+  cull_stats_t(void)
+      : objects(0), visible(0), culled(0), nodes_tested(0), rebuilt(false),
+        update_ms(0.0), cull_ms(0.0) {}
+};
+
+// Bounding-volume hierarchy over the bounding spheres of the scene's
+// entities: a tree of boxes, four children to a node, with up to
+// "leaf_size" entities to a leaf. update() refits the boxes around the
+// entities' new positions, and only rebuilds the tree when the entities
+// change or the boxes have grown too loose to cull well. cull() walks it
+// with four child boxes tested at a time, skipping every subtree that is
+// wholly outside a plane and accepting without further tests every subtree
+// wholly inside the frustum.
+struct bvh_t {
+  static const uint32_t leaf_size = 4;
+
+  // a refit that leaves the boxes' summed surface area this many times
+  // what it was after the last build triggers a rebuild
+  float rebuild_ratio;
+
+  bvh_t(void) : rebuild_ratio(2.0f), built_cost(0.0f), cost(0.0f) {
+    for (uint32_t &c : counts)
+      c = 0;
+  }
+
+  // bound entity i of type t by a sphere of "radius[t]" around "pos[t][i]"
+  void update(const std::vector<glm::vec3> pos[ENTITY_TYPE_COUNT],
+              const float radius[ENTITY_TYPE_COUNT], cull_stats_t *stats);
+
+  // the indices of the entities of each type that may be inside "f", in
+  // ascending order, into visible[type]
+  void cull(const frustum_t &f, std::vector<uint32_t> visible[ENTITY_TYPE_COUNT],
+            cull_stats_t *stats) const;
+
+  // as cull, with a given instruction set (SIMD_AVX2 runs the SSE path)
+  void cull_with(simd_level_t level, const frustum_t &f,
+                 std::vector<uint32_t> visible[ENTITY_TYPE_COUNT],
+                 cull_stats_t *stats) const;
+
+  inline uint32_t size(void) const { return (uint32_t)items.size(); }
+  void clear(void);
+
+  // The four child boxes of a node, structure-of-arrays so that one SIMD
+  // register holds the same bound of every child. An empty slot has
+  // count 0 and an inverted box; a leaf slot has the first of its "count"
+  // items in "child"; an inner slot has its node in "child" and count 0.
+  struct node_t {
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+    int32_t child[4];
+    uint32_t count[4];
+    // the node's own items are items[first, first + size), since every
+    // subtree covers a contiguous run of them
+    uint32_t first, size;
+    // where the node's box is stored, or -1 for the root
+    int32_t parent;
+    uint32_t slot;
+  };
+
+private:
+  // parents come before their children
+  std::vector<node_t> nodes;
+  std::vector<entity_t> items;
+  // bounding spheres of "items", in the same order
+  std::vector<float> sph_x, sph_y, sph_z, sph_r;
+  // the items being sorted by build, with their centres alongside so that
+  // partitioning them stays within one array
+  struct build_item_t {
+    float centre[3];
+    uint32_t item;
+  };
+  std::vector<build_item_t> order;
+
+  uint32_t counts[ENTITY_TYPE_COUNT];
+  float built_cost, cost;
+
+  void bound(const std::vector<glm::vec3> pos[ENTITY_TYPE_COUNT],
+             const float radius[ENTITY_TYPE_COUNT]);
+  void build(void);
+  int32_t build_node(uint32_t first, uint32_t size, int32_t parent,
+                     uint32_t slot);
+  float refit(void);
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "base.h"
+#include "culling.h"
+#include "lod.h"
 
 struct demo_app_t {
   bool init(int argc, char const *argv[]);
@@ -6,4 +8,12 @@ struct demo_app_t {
   void update(float);
   void input(int, int, int, int);
   void render(void);
+
+  // what culling found in the latest render
+  cull_stats_t cull_stats;
+  // and the levels of detail it drew
+  lod_stats_t lod_stats;
+
+  // half the width of the square the objects were spawned over
+  float extent;
 };
@@ -0,0 +1,53 @@
+#ifndef __FRAME_REPORT_H__
+#define __FRAME_REPORT_H__
+
+#include "base.h"
+
+// Report of a headless run along the scripted camera path (--report): the
+// distribution of frame times, split into the render thread's CPU time
+// and the GPU time of the profiled passes, and the memory the process
+// used. Written as JSON, and compared with an earlier report to fail runs
+// that got slower (--baseline).
+
+// summary of a set of samples, with nearest-rank percentiles
+struct sample_stats_t {
+  double mean, p50, p95, p99, max;
+  uint32_t count;
+};
+
+extern sample_stats_t sample_stats(std::vector<double> samples);
+
+struct frame_report_t {
+  // what was run
+  uint32_t frames, warmup, objects, sphere_segments;
+  float dt, lod_error;
+  const char *cull;
+
+  // in ms, for each frame after the warmup: all of it, the CPU time of
+  // its update and render, and the GPU time of its profiled passes
+  std::vector<double> frame_ms, cpu_ms, gpu_ms;
+  // frames after the warmup without GPU times; their absence would bias
+  // gpu_ms, so check() refuses reports that have any
+  uint32_t gpu_dropped;
+
+  // resident memory at the end and at most, in kB; 0 if unknown
+  uint64_t rss_kb, peak_rss_kb;
+  // bytes streamed to the GPU in the last frame
+  uint64_t stream_bytes;
+  uint64_t hash;
+
+  frame_report_t(void);
+
+  // read rss_kb and peak_rss_kb from the OS
+  void sample_memory(void);
+
+  bool write(const char *path) const;
+
+  // compare with the report in "path", written by write() for the same
+  // scene: false, after saying why, if the median or 95th percentile of
+  // the frame, CPU or GPU times is more than "max_regression" percent
+  // above it, or if either report is missing GPU times
+  bool check(const char *path, float max_regression) const;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __GL_EXT_H__
+#define __GL_EXT_H__
+
+#include "base.h"
+
+// Entry points newer than the core profile covered by the bundled glad
+// loader. These are resolved once, after glad, through the same loader
+// procedure e.g. glext_load((GLADloadproc)glfwGetProcAddress);
+
+// GL 4.4 / ARB_buffer_storage
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// GL 4.3: compute shaders, shader storage buffers and indirect draws
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT 0x90DF
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+
+typedef void(APIENTRYP glext_vertex_attrib_divisor_fn)(GLuint index,
+                                                       GLuint divisor);
+typedef void(APIENTRYP glext_buffer_storage_fn)(GLenum target,
+                                                GLsizeiptr size,
+                                                const void *data,
+                                                GLbitfield flags);
+typedef void(APIENTRYP glext_dispatch_compute_fn)(GLuint num_groups_x,
+                                                  GLuint num_groups_y,
+                                                  GLuint num_groups_z);
+typedef void(APIENTRYP glext_memory_barrier_fn)(GLbitfield barriers);
+typedef void(APIENTRYP glext_multi_draw_elements_indirect_fn)(
+    GLenum mode, GLenum type, const void *indirect, GLsizei drawcount,
+    GLsizei stride);
+
+struct glext_t {
+  glext_vertex_attrib_divisor_fn vertex_attrib_divisor;
+  // optional: NULL where the context has neither GL 4.4 nor the extension
+  glext_buffer_storage_fn buffer_storage;
+  // optional: all NULL unless the context is GL 4.3 or later
+  glext_dispatch_compute_fn dispatch_compute;
+  glext_memory_barrier_fn memory_barrier;
+  glext_multi_draw_elements_indirect_fn multi_draw_elements_indirect;
+};
+
+extern glext_t glext;
+
+extern void glext_load(GLADloadproc load);
+
+// whether the context advertises extension "name"
+extern bool glext_supported(const char *name);
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef __GL_STATE_H__
+#define __GL_STATE_H__
+
+#include "base.h"
+
+// Shadow copy of the GL state our render paths change. Binds and toggles
+// that would leave the state as it is are skipped, and code which wants to
+// put state back the way it found it saves and restores the shadow instead
+// of querying the driver with glGet*/glIsEnabled, which can stall the
+// pipeline.
+//
+// This only works if every change to tracked state goes through here,
+// including deleting bound objects (see the delete_* calls). Code that
+// cannot comply must call invalidate() afterwards.
+struct gl_state_t {
+  // buffer binding points that are tracked
+  enum buffer_slot_t {
+    BUF_ARRAY = 0,
+    BUF_ELEMENT_ARRAY, // part of the bound vertex array's state
+    BUF_PIXEL_PACK,
+    BUF_PIXEL_UNPACK,
+    BUF_UNIFORM,
+    BUF_SLOT_COUNT
+  };
+
+  // capabilities that are tracked
+  enum cap_slot_t { CAP_DEPTH_TEST = 0, CAP_BLEND, CAP_CULL_FACE,
+                    CAP_SCISSOR_TEST, CAP_SLOT_COUNT };
+
+  static const uint32_t max_texture_units = 8;
+
+  struct snapshot_t {
+    GLuint program;
+    GLuint vertex_array;
+    GLuint buffers[BUF_SLOT_COUNT];
+    GLuint draw_framebuffer, read_framebuffer;
+    GLenum active_texture; // unit index, not GL_TEXTUREi
+    GLuint texture_2d[max_texture_units];
+    GLuint caps[CAP_SLOT_COUNT]; // 0, 1 or unknown
+    GLenum blend_equation;
+    GLenum blend_src, blend_dst;
+    GLfloat line_width;
+  };
+
+  // GL calls made and skipped, since reset()
+  uint64_t issued, skipped;
+
+  gl_state_t(void) { invalidate(); }
+
+  // the context has just been created: every value is the GL default
+  void reset(void);
+  // forget everything, so the next change of each value is issued
+  void invalidate(void);
+
+  inline snapshot_t save(void) const { return cur; }
+  // put back every value in "s" that differs from the current one
+  void restore(const snapshot_t &s);
+
+  void use_program(GLuint program);
+  void bind_vertex_array(GLuint vao);
+  void bind_buffer(GLenum target, GLuint buffer);
+  // bind part of "buffer" to indexed binding point "index" of "target".
+  // Indexed bindings are not tracked, so this is always issued; like GL,
+  // it also binds "buffer" to the target's generic binding point.
+  void bind_buffer_range(GLenum target, GLuint index, GLuint buffer,
+                         GLintptr offset, GLsizeiptr size);
+  void bind_framebuffer(GLenum target, GLuint fbo);
+  void active_texture(GLenum unit); // GL_TEXTUREi
+  void bind_texture(GLenum target, GLuint texture);
+
+  void enable(GLenum cap);
+  void disable(GLenum cap);
+  void blend_equation(GLenum mode);
+  void blend_func(GLenum src, GLenum dst);
+  void line_width(GLfloat width);
+
+  // delete objects, unbinding them from the shadow as GL does
+  void delete_buffers(GLsizei n, const GLuint *buffers);
+  void delete_vertex_arrays(GLsizei n, const GLuint *arrays);
+  void delete_textures(GLsizei n, const GLuint *textures);
+  void delete_framebuffers(GLsizei n, const GLuint *fbos);
+  // stops using "program" first, so its name can be reused safely
+  void delete_program(GLuint program);
+
+private:
+  snapshot_t cur;
+
+  // whether "*value" must be changed to "v"; records "v" if so
+  template <typename T> inline bool update(T *value, T v) {
+    if (*value == v) {
+      ++skipped;
+      return false;
+    }
+    *value = v;
+    ++issued;
+    return true;
+  }
+
+  void set_cap(GLenum cap, bool on);
+};
+
+// initial definition in gl-state.cpp
+extern gl_state_t gl_state;
+
+#endif
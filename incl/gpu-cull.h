@@ -0,0 +1,75 @@
+#ifndef __GPU_CULL_H__
+#define __GPU_CULL_H__
+
+#include "base.h"
+#include "culling.h"
+#include "lod.h"
+#include "shader.h"
+#include "stream-buffer.h"
+
+// Frustum culling on the GPU, for contexts with GL 4.3. Each frame the
+// bounding spheres of every entity are streamed into a shader storage
+// buffer, and a compute pass tests each against the frustum and picks the
+// level of detail of those that pass, counting them in the draw command of
+// their type and level in "commands". A second pass gives each a model
+// matrix in "instances", packed by type and level, and the commands are
+// drawn with glMultiDrawElementsIndirect (see gfx_obj_t::indirect_draw_).
+// The CPU never learns what was visible, except through the stats.
+struct gpu_culler_t {
+  // the command glMultiDrawElementsIndirect reads
+  struct draw_cmd_t {
+    GLuint count, instance_count, first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+  };
+
+  GLuint commands;  // max_lods draw_cmd_t per entity type
+  GLuint instances; // model matrices of the visible entities
+
+  gpu_culler_t(void)
+      : commands(0), instances(0), lods(0), capacity(0), objects(0),
+        frame(0) {}
+
+  // false if the context lacks GL 4.3, leaving culling to the CPU
+  bool init(void);
+  void teardown(void);
+  inline bool ready(void) const { return program.handle != 0; }
+
+  // cull the entities of type t, bounded by a sphere of "radius[t]" around
+  // "pos[t][i]" and drawn with the levels "chains[t]" describes, level l
+  // having "idx_count[t][l]" indices. The counts in "stats" and
+  // "lod_stats" are those of frames_in_flight - 1 frames ago, mapped once
+  // their fence signals, which it normally has; otherwise this waits.
+  void cull(const std::vector<glm::vec3> pos[ENTITY_TYPE_COUNT],
+            const float radius[ENTITY_TYPE_COUNT],
+            const lod_chain_t chains[ENTITY_TYPE_COUNT],
+            const GLsizei idx_count[ENTITY_TYPE_COUNT][max_lods],
+            const lod_view_t &view, const frustum_t &f, cull_stats_t *stats,
+            lod_stats_t *lod_stats);
+
+  // where the command of type t's level 0 is in "commands"; the other
+  // levels follow, command_stride bytes apart
+  static inline GLintptr command_offset(entity_type_t t) {
+    return (GLintptr)(sizeof(draw_cmd_t) * max_lods * t);
+  }
+  static const GLsizei command_stride = sizeof(draw_cmd_t);
+
+private:
+  static const uint32_t frames_in_flight = stream_buffer_t::frames_in_flight;
+
+  shader_program_t program;
+  // the level each entity was drawn with, kept between frames for the
+  // hysteresis, and whether it was visible
+  GLuint lods;
+  // entities "instances" has room for
+  uint32_t capacity;
+  // entities "lods" was set up for
+  uint32_t objects;
+  // copies of "commands", one per frame in flight, for the stats, and the
+  // fences that signal when each copy is done
+  GLuint counts[frames_in_flight];
+  GLsync fences[frames_in_flight];
+  uint32_t frame;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __HEADLESS_H__
+#define __HEADLESS_H__
+
+#include "base.h"
+
+// Create a GL 3.3 core context without a visible window, make it current
+// and load the GL entry points. Built with HAVE_EGL this is a surfaceless
+// EGL context, which needs neither a display server nor a GPU (e.g. Mesa
+// llvmpipe); otherwise, or if that fails, a hidden GLFW window.
+extern bool headless_init(void);
+extern void headless_teardown(void);
+
+// framebuffer object with RGBA8 colour and 24-bit depth renderbuffers
+struct offscreen_target_t {
+  GLuint fbo;
+  GLuint colour, depth;
+  int width, height;
+
+  offscreen_target_t(void) : fbo(0), colour(0), depth(0), width(0), height(0) {}
+
+  void init(int width, int height);
+  void teardown(void);
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __INTEGRATOR_H__
+#define __INTEGRATOR_H__
+
+#include "scene.h"
+
+// instruction sets the batch integrator can run on
+enum simd_level_t { SIMD_SCALAR = 0, SIMD_SSE, SIMD_AVX2, SIMD_LEVEL_COUNT };
+
+// best level supported by the host, detected once at first use
+extern simd_level_t simd_detect(void);
+extern const char *simd_name(simd_level_t level);
+
+// level used by integrate_spheres; defaults to simd_detect(). Requests for
+// a level the host cannot run are clamped to the best supported level.
+extern void simd_set_level(simd_level_t level);
+extern simd_level_t simd_get_level(void);
+
+// advance position and velocity of the spheres [begin, end) in "blk" by
+// "dt", including the ground-plane contact test, and refresh their model
+// matrices. Every level produces the same results as the scalar path.
+extern void integrate_spheres(entity_block_t *blk, float dt, uint32_t begin,
+                              uint32_t end);
+
+extern void integrate_spheres_with(simd_level_t level, entity_block_t *blk,
+                                   float dt, uint32_t begin, uint32_t end);
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include "base.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// A work-stealing thread pool. Each worker owns a deque which it pops
+// from the back; idle threads steal from the front of the others'. Any
+// thread (worker or not) may submit work. A submitting thread helps run
+// the chunks of its own parallel_for, and only those, then sleeps until
+// the ones others took are done: the render thread never ends up running
+// a chunk of the simulation's step, or the other way round.
+//
+// parallel_for always splits [0, count) into the same chunks whatever the
+// number of threads, so work whose chunks write only to their own range
+// (or to per-chunk outputs merged in chunk order, see parallel_gather)
+// gives results independent of the thread count.
+struct job_system_t {
+  typedef std::function<void(uint32_t begin, uint32_t end)> range_fn_t;
+
+  job_system_t(void) : queued(0), stopping(false) {}
+
+  // for init(): one worker per hardware thread, less the caller's
+  static const uint32_t auto_workers = ~0U;
+
+  // start "num_workers" worker threads, or auto_workers; with 0, every
+  // parallel_for runs on its caller alone
+  void init(uint32_t num_workers);
+  void teardown(void);
+
+  // threads that take part in a parallel_for, including the caller
+  inline uint32_t num_threads(void) const {
+    return (uint32_t)workers.size() + 1;
+  }
+
+  // call fn(begin, end) over [0, count) in chunks of at most "grain"
+  // elements, returning once every chunk has run
+  void parallel_for(uint32_t count, uint32_t grain, const range_fn_t &fn);
+
+  // as parallel_for, with each chunk appending to its own output vector.
+  // The outputs are concatenated onto "out" in chunk order.
+  template <typename T, typename F>
+  void parallel_gather(uint32_t count, uint32_t grain, std::vector<T> *out,
+                       F fn) {
+    const uint32_t chunks = grain ? (count + grain - 1) / grain : 0;
+    if (chunks <= 1) {
+      fn(0U, count, out);
+      return;
+    }
+
+    std::vector<std::vector<T>> partial(chunks);
+    parallel_for(count, grain, [&](uint32_t begin, uint32_t end) {
+      fn(begin, end, &partial[begin / grain]);
+    });
+
+    size_t total = out->size();
+    for (const std::vector<T> &p : partial)
+      total += p.size();
+    out->reserve(total);
+    for (const std::vector<T> &p : partial)
+      out->insert(out->end(), p.begin(), p.end());
+  }
+
+private:
+  // the chunks of one parallel_for, and how its caller waits for them
+  struct batch_t {
+    const range_fn_t *fn;
+    std::atomic<uint32_t> remaining;
+    std::mutex lock;
+    std::condition_variable finished;
+    bool done; // set, under "lock", by whoever runs the last chunk
+  };
+
+  struct task_t {
+    batch_t *batch;
+    uint32_t begin, end;
+  };
+
+  struct queue_t {
+    std::mutex lock;
+    std::deque<task_t> tasks;
+  };
+
+  std::vector<std::thread> workers;
+
+  // one queue per worker, then one shared by all non-worker threads
+  std::vector<std::unique_ptr<queue_t>> queues;
+
+  std::atomic<uint32_t> queued; // tasks waiting in any queue
+  std::atomic<bool> stopping;
+  std::mutex sleep_lock;
+  std::condition_variable wake;
+
+  uint32_t own_queue(void) const;
+  bool pop(uint32_t q, task_t *t);
+  bool pop_batch(uint32_t q, const batch_t *batch, task_t *t);
+  bool steal(uint32_t thief, task_t *t);
+  void execute(const task_t &t);
+  void worker_main(uint32_t index);
+};
+
+// initial definition in jobs.cpp
+extern job_system_t jobs;
+
+#endif
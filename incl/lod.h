@@ -0,0 +1,56 @@
+#ifndef __LOD_H__
+#define __LOD_H__
+
+#include "base.h"
+#include "camera.h"
+#include "mesh-cache.h"
+
+// Level-of-detail selection by screen-space error. Each level of a mesh
+// carries an estimate of how far its surface strays from the exact shape,
+// and an object is drawn with the coarsest level whose error, projected at
+// the object's distance, stays within a tolerance in pixels. An object
+// only moves to a coarser level once that level's error is well inside the
+// tolerance, so objects near the threshold do not flicker between two.
+
+// levels a mesh may have, finest first
+static const uint32_t max_lods = 4;
+
+// the geometric error of each level of a mesh, in mesh units
+struct lod_chain_t {
+  uint32_t count;
+  float error[max_lods];
+};
+
+// the camera's side of the selection
+struct lod_view_t {
+  glm::vec3 eye;
+  float px_per_unit; // pixels a unit spans one unit in front of the eye
+  float tolerance;   // pixels of error allowed; 0 keeps every level 0
+  float hysteresis;  // coarsen only while under tolerance * hysteresis
+
+  // from "c", seen through a viewport "height" pixels tall
+  void setup(const camera_t &c, float height, float tolerance);
+};
+
+// objects drawn at each level, over all entity types
+struct lod_stats_t {
+  uint32_t instances[max_lods];
+  uint64_t triangles;
+
+  lod_stats_t(void) : triangles(0) {
+    for (uint32_t &n : instances)
+      n = 0;
+  }
+};
+
+// the error of a tessellated mesh: how far the middle of its mean edge
+// lies inside the sphere bounding it
+extern float tessellation_error(const mesh_view_t &view);
+
+// update "lods[idx[i]]" for the "count" objects at "pos[idx[i]]", each
+// bounded by a sphere of "radius"
+extern void select_lods(const lod_view_t &view, const lod_chain_t &chain,
+                        float radius, const glm::vec3 *pos,
+                        const uint32_t *idx, uint32_t count, uint8_t *lods);
+
+#endif
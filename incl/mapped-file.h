@@ -0,0 +1,25 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include "base.h"
+
+// A whole file mapped read-only into memory. Where the platform has no
+// mapping here (Windows), the file is read into one allocation instead.
+struct mapped_file_t {
+  const uint8_t *data;
+  size_t size;
+
+  mapped_file_t(void) : data(NULL), size(0) {}
+  ~mapped_file_t(void) { release(); }
+
+  // map "path", which is about to be read front to back. Returns false,
+  // leaving nothing mapped, if it cannot be opened or is empty.
+  bool map(const char *path);
+  void release(void);
+
+private:
+  mapped_file_t(const mapped_file_t &);
+  mapped_file_t &operator=(const mapped_file_t &);
+};
+
+#endif
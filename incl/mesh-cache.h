@@ -0,0 +1,76 @@
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include "tools.h"
+#include "mapped-file.h"
+
+// Bump whenever the generators, the optimiser or the packed vertex format
+// change what they produce, so stale cache files are regenerated.
+static const uint32_t mesh_cache_version = 2;
+
+// The GPU-ready arrays of a mesh, in the layout gfx_obj_t uploads. The
+// arrays belong to whatever made the view: a mesh_pack_t or a mapped
+// cache file.
+struct mesh_view_t {
+  vertex_layout_t layout;
+  uint32_t vtx_count, idx_count;
+  uint32_t idx_size; // bytes per index: 2 or 4
+  vtx_decode_t decode;
+
+  // packed_vtx_t or glm::vec3 positions
+  const void *vtx;
+  // VTX_LAYOUT_SEPARATE only, otherwise NULL
+  const glm::vec3 *nrm;
+  const glm::vec2 *txcrd;
+  const void *idx;
+
+  inline size_t vtx_bytes(void) const {
+    return (size_t)vtx_count * (layout == VTX_LAYOUT_PACKED
+                                    ? sizeof(packed_vtx_t)
+                                    : sizeof(glm::vec3));
+  }
+  inline size_t nrm_bytes(void) const {
+    return nrm ? (size_t)vtx_count * sizeof(glm::vec3) : 0;
+  }
+  inline size_t txcrd_bytes(void) const {
+    return txcrd ? (size_t)vtx_count * sizeof(glm::vec2) : 0;
+  }
+  inline size_t idx_bytes(void) const {
+    return (size_t)idx_count * idx_size;
+  }
+};
+
+// storage for the packed arrays of a view of a mesh_t
+struct mesh_pack_t {
+  std::vector<packed_vtx_t> vtx;
+  std::vector<uint16_t> idx16;
+};
+
+// view "m" in "layout", packing into "pack" where the layout needs it
+extern mesh_view_t view_mesh(const mesh_t *m, vertex_layout_t layout,
+                             mesh_pack_t *pack);
+
+// A mesh cache file mapped into memory. Files are named after a hash of
+// the format version, the layout and every mesh_create_info_t field, and
+// record all of them, so a file can never be mistaken for another mesh.
+// They are in the host's byte order.
+struct cached_mesh_t {
+  mesh_view_t view; // valid between a successful load() and release()
+
+
+  // map the cached mesh from directory "dir". Returns false when there is
+  // none, or it is stale or damaged.
+  bool load(const char *dir, const mesh_create_info_t &info,
+            vertex_layout_t layout);
+  inline void release(void) { file.release(); }
+
+private:
+  mapped_file_t file;
+};
+
+// write "view" to the cache in directory "dir", creating the directory if
+// needed. Returns false, having written nothing, on failure.
+extern bool store_cached_mesh(const char *dir, const mesh_create_info_t &info,
+                              const mesh_view_t &view);
+
+#endif
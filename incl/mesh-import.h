@@ -0,0 +1,28 @@
+#ifndef __MESH_IMPORT_H__
+#define __MESH_IMPORT_H__
+
+#include "tools.h"
+
+// Triangle mesh importers. The file is mapped rather than read, parsed in
+// place and written straight into the mesh_t, whose storage is reused when
+// it has the capacity. Polygons are split into fans of triangles, and
+// vertex normals are computed when the file has none. The triangles keep
+// the file's order: see mesh-opt.h to reorder them for drawing.
+//
+// Each returns false, reporting why on stderr, if the file cannot be read
+// or is malformed; "out" is then left empty.
+
+// Wavefront OBJ: "v", "vt", "vn" and "f" statements (other statements are
+// skipped). Large files are parsed in parallel chunks on the job system;
+// the result does not depend on the thread count. Face corners with the
+// same position, texture coordinate and normal share a vertex.
+extern bool import_obj(const char *path, mesh_t *out);
+
+// Binary PLY, either byte order: the x, y, z, nx, ny, nz and u, v (or s, t)
+// properties of "vertex", and the "vertex_indices" list of "face".
+extern bool import_ply(const char *path, mesh_t *out);
+
+// import_obj or import_ply, by the file's extension
+extern bool import_mesh(const char *path, mesh_t *out);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __MESH_OPT_H__
+#define __MESH_OPT_H__
+
+#include "tools.h"
+
+// Post-transform vertex cache behaviour of an index order, simulated with
+// a FIFO of "cache_size" entries
+struct vertex_cache_stats_t {
+  uint64_t transforms; // cache misses, i.e. vertex shader invocations
+  float acmr;          // transforms per triangle: 0.5 at best, 3 at worst
+  float atvr;          // transforms per vertex: 1 at best
+};
+
+// size of the FIFO the statistics and the optimiser assume, in vertices
+static const uint32_t vertex_cache_size = 32;
+
+extern vertex_cache_stats_t
+analyze_vertex_cache(const mesh_t *m, uint32_t cache_size = vertex_cache_size);
+
+// Reorder the triangles of "m" for the post-transform cache with Tipsify
+// (Sander, Nehab and Barczak, 2007), which runs in linear time. The
+// clusters it produces are then sorted so that those facing out from the
+// mesh's centre draw first, which lets early depth testing reject more
+// of what is behind them. Returns false, leaving "m" as it was, when the
+// new order would miss the cache more often than the current one.
+extern bool optimize_vertex_cache(mesh_t *m,
+                                  uint32_t cache_size = vertex_cache_size);
+
+// Renumber the vertices of "m" in the order the triangles first use them,
+// so vertex fetch walks the arrays forwards. Unused vertices move to the
+// end.
+extern void optimize_vertex_fetch(mesh_t *m);
+
+#endif
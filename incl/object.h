@@ -3,13 +3,25 @@
 
 #include "base.h"
 #include "tools.h"
+#include "mesh-cache.h"
+#include "options.h"
+#include "gl-ext.h"
+#include "lod.h"
+#include "gl-state.h"
+#include "stream-buffer.h"
+
+#include <cstddef>
 
 template <typename T> struct gfx_obj_t {
   typedef T derived_t;
+  // "model" is a mat4 and so occupies four consecutive locations, and
+  // "decode" two: the vtx_decode_t of the level drawn, set as the current
+  // value of both attributes before each draw
   static constexpr struct {
-    uint32_t pos, norm, txcrd, col;
-  } vtx_attr = {0U, 1U, 2U, 3U};
+    uint32_t pos, norm, txcrd, col, model, decode;
+  } vtx_attr = {0U, 1U, 2U, 3U, 4U, 8U};
   static uint32_t buf_usage;
+  // host copy of the finest level; empty when it came from the mesh cache
   static mesh_t mesh;
 
   struct def_t {
@@ -20,90 +32,223 @@ template <typename T> struct gfx_obj_t {
         GLuint vtx, idx, txcrd, nrm;
       };
     } bufs; // handles
+    vertex_layout_t layout;
+    GLenum idx_type; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLsizei idx_count, vtx_count;
+    vtx_decode_t decode;
+    float error; // see tessellation_error
   };
 
-  static def_t gfx_def;
+  // the levels of detail, finest first
+  static def_t gfx_lods[max_lods];
+  static uint32_t lod_count;
 
   gfx_obj_t(void) {}
   ~gfx_obj_t(void) {}
 
-  void define_(const mesh_create_info_t &mci) {
+  // one level of detail per "mcis[i]", finest first
+  static void define_(const mesh_create_info_t *mcis, uint32_t count,
+                      vertex_layout_t layout = VTX_LAYOUT_PACKED) {
+    assert(count && count <= max_lods && "Invalid level of detail count!");
+    lod_count = count;
+    for (uint32_t l = 0; l < count; ++l)
+      define_lod_(mcis[l], layout, l);
+  }
+
+  static lod_chain_t lod_chain(void) {
+    lod_chain_t chain = {lod_count, {}};
+    for (uint32_t l = 0; l < lod_count; ++l)
+      chain.error[l] = gfx_lods[l].error;
+    return chain;
+  }
+
+  static void define_lod_(const mesh_create_info_t &mci,
+                          vertex_layout_t layout, uint32_t lod) {
+    // static data: one copy straight into the new storage
     struct {
-      void operator()(GLenum target, GLsizei sz, void *host_ptr) {
-        glBufferData(target, sz, NULL, GL_STATIC_DRAW);
-        void *gpu_ptr = glMapBuffer(target, GL_WRITE_ONLY);
-        if (!gpu_ptr) {
-          fprintf(stderr, "ERROR: failed to map buffer\n");
-          exit(1);
-        }
-        memcpy(gpu_ptr, host_ptr, sz);
-        GLboolean result = glUnmapBuffer(target);
-        if (!result) {
-          fprintf(stderr, "ERROR: failed to unmap buffer\n");
-          exit(1);
-        }
-        gpu_ptr = NULL;
+      void operator()(GLenum target, GLsizeiptr sz, const void *host_ptr) {
+        glBufferData(target, sz, host_ptr, GL_STATIC_DRAW);
       }
     } fill_buf;
 
-    create_mesh_data(&mci, &mesh);
+    // map a cached copy of the GPU-ready arrays if there is one, and
+    // generate them (caching them for next time) if not
+    cached_mesh_t cached;
+    mesh_pack_t pack;
+    mesh_view_t view;
+    mesh_t coarse;
+    if (opts.mesh_cache && cached.load(opts.mesh_cache, mci, layout)) {
+      view = cached.view;
+    } else {
+      mesh_t &m = lod ? coarse : mesh;
+      create_mesh_data(&mci, &m);
+      assert(!m.vtx_data.empty() && "Invalid mesh structure!");
+      view = view_mesh(&m, layout, &pack);
+      if (opts.mesh_cache && !store_cached_mesh(opts.mesh_cache, mci, view))
+        fprintf(stderr, "WARNING: failed to write the mesh cache in %s\n",
+                opts.mesh_cache);
+    }
+
+    def_t &gfx_def = gfx_lods[lod];
+    gfx_def.layout = layout;
+    gfx_def.idx_type =
+        view.idx_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    gfx_def.idx_count = view.idx_count;
+    gfx_def.vtx_count = view.vtx_count;
+    gfx_def.decode = view.decode;
+    gfx_def.error = tessellation_error(view);
 
     glGenVertexArrays(1, &gfx_def.vao);
     glGenBuffers(4, (GLuint *)(&gfx_def.bufs));
 
-    glBindVertexArray(gfx_def.vao);
+    gl_state.bind_vertex_array(gfx_def.vao);
 
     // vertices
-    assert(!mesh.vtx_data.empty() && "Invalid mesh structure!");
-    glBindBuffer(GL_ARRAY_BUFFER, gfx_def.bufs.vtx);
-    fill_buf(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh.vtx_data.size(),
-             (GLvoid *)mesh.vtx_data.data());
-    glVertexAttribPointer(vtx_attr.pos, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    gl_state.bind_buffer(GL_ARRAY_BUFFER, gfx_def.bufs.vtx);
+    fill_buf(GL_ARRAY_BUFFER, view.vtx_bytes(), view.vtx);
+
+    if (layout == VTX_LAYOUT_PACKED) {
+      // positions stay integers, scaled by the decode attribute, which
+      // keeps them exact whichever snorm rule the GL version uses
+      const GLsizei stride = sizeof(packed_vtx_t);
+      glVertexAttribPointer(vtx_attr.pos, 3, GL_SHORT, GL_FALSE, stride,
+                            (GLvoid *)offsetof(packed_vtx_t, pos));
+      glEnableVertexAttribArray(vtx_attr.pos);
+      glVertexAttribPointer(vtx_attr.norm, 2, GL_SHORT, GL_TRUE, stride,
+                            (GLvoid *)offsetof(packed_vtx_t, nrm));
+      glEnableVertexAttribArray(vtx_attr.norm);
+      // texture coordinates too, scaled by the decode bias's w
+      glVertexAttribPointer(vtx_attr.txcrd, 2, GL_SHORT, GL_FALSE, stride,
+                            (GLvoid *)offsetof(packed_vtx_t, txcrd));
+      glEnableVertexAttribArray(vtx_attr.txcrd);
+    } else {
+      glVertexAttribPointer(vtx_attr.pos, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+      glEnableVertexAttribArray(vtx_attr.pos);
+
+      // normals
+      if (view.nrm) {
+        gl_state.bind_buffer(GL_ARRAY_BUFFER, gfx_def.bufs.nrm);
+        fill_buf(GL_ARRAY_BUFFER, view.nrm_bytes(), view.nrm);
+        glVertexAttribPointer(vtx_attr.norm, 3, GL_FLOAT, GL_TRUE, 0, NULL);
+        glEnableVertexAttribArray(vtx_attr.norm);
+      }
 
-    // indices
-    if (!mesh.idx_data.empty()) {
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gfx_def.bufs.idx);
-      fill_buf(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * mesh.idx_data.size(),
-               (GLvoid *)mesh.idx_data.data());
+      // texture coordinates
+      if (view.txcrd) {
+        gl_state.bind_buffer(GL_ARRAY_BUFFER, gfx_def.bufs.txcrd);
+        fill_buf(GL_ARRAY_BUFFER, view.txcrd_bytes(), view.txcrd);
+        glVertexAttribPointer(vtx_attr.txcrd, 2, GL_FLOAT, GL_TRUE, 0, NULL);
+        glEnableVertexAttribArray(vtx_attr.txcrd);
+      }
     }
 
-    // normals
-    if (!mesh.norm_data.empty()) {
-      glBindBuffer(GL_ARRAY_BUFFER, gfx_def.bufs.nrm);
-      fill_buf(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh.norm_data.size(),
-               (GLvoid *)mesh.norm_data.data());
-      glVertexAttribPointer(vtx_attr.norm, 3, GL_FLOAT, GL_TRUE, 0, NULL);
+    // indices
+    if (view.idx_count) {
+      gl_state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, gfx_def.bufs.idx);
+      fill_buf(GL_ELEMENT_ARRAY_BUFFER, view.idx_bytes(), view.idx);
     }
 
-    // texture coordinates
-    if (!mesh.txcrd_data.empty()) {
-      glBindBuffer(GL_ARRAY_BUFFER, gfx_def.bufs.txcrd);
-      fill_buf(GL_ARRAY_BUFFER, sizeof(glm::vec2) * mesh.txcrd_data.size(),
-               (GLvoid *)mesh.txcrd_data.data());
-      glVertexAttribPointer(vtx_attr.txcrd, 2, GL_FLOAT, GL_TRUE, 0, NULL);
+    printf("... LOD %u, error %g: %s vertices, %s indices: %lu bytes on the "
+           "GPU\n",
+           lod, gfx_def.error, layout == VTX_LAYOUT_PACKED ? "packed" : "float",
+           gfx_def.idx_type == GL_UNSIGNED_SHORT ? "16-bit" : "32-bit",
+           (unsigned long)(view.vtx_bytes() + view.nrm_bytes() +
+                           view.txcrd_bytes() + view.idx_bytes()));
+
+    // per-instance model matrices, one column per attribute location.
+    // They live in the stream buffer, and are pointed at on each draw.
+    for (uint32_t col = 0; col < 4; ++col) {
+      glEnableVertexAttribArray(vtx_attr.model + col);
+      glext.vertex_attrib_divisor(vtx_attr.model + col, 1);
     }
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    // keep later element buffer binds out of this vertex array
+    gl_state.bind_vertex_array(0);
   }
 
-  void destroy_(void) { glDeleteBuffers(4, (GLuint*)(&gfx_def.bufs)); }
-};
-
-struct object_t {
-
-  object_t(void) : mat(glm::mat4(1.0f)), pos(0.0f) {}
-  ~object_t(void) {}
+  static void destroy_(void) {
+    for (uint32_t l = 0; l < lod_count; ++l) {
+      gl_state.delete_buffers(4, (GLuint *)(&gfx_lods[l].bufs));
+      gl_state.delete_vertex_arrays(1, &gfx_lods[l].vao);
+    }
+    lod_count = 0;
+  }
 
-  virtual void setup(glm::vec3 pos) = 0;
-  virtual void teardown(void) = 0;
+  // the decode attributes are not arrays, so take their current values.
+  // Unlike an array they ignore base_instance.
+  static void set_decode_(const def_t &gfx_def) {
+    glVertexAttrib4fv(vtx_attr.decode, glm::value_ptr(gfx_def.decode.scale));
+    glVertexAttrib4fv(vtx_attr.decode + 1,
+                      glm::value_ptr(gfx_def.decode.bias));
+  }
 
-  inline const glm::mat4 &get_matrix(void) const { return mat; }
+  // draw "models", those of level 0 first, then those of level 1 and so
+  // on, "lod_instances[l]" of level l. One instanced draw call per level
+  // drawn; the caller is expected to have bound the shader program.
+  static void batch_draw_(GLenum mode, const glm::mat4 *models,
+                          const uint32_t *lod_instances) {
+    GLsizei count = 0;
+    for (uint32_t l = 0; l < lod_count; ++l)
+      count += lod_instances[l];
+    if (!count)
+      return;
+
+    GLintptr offset;
+    void *dst = stream_buf.map(sizeof(glm::mat4) * count, sizeof(glm::vec4),
+                               &offset);
+    memcpy(dst, models, sizeof(glm::mat4) * count);
+    stream_buf.unmap();
+
+    for (uint32_t l = 0; l < lod_count; ++l) {
+      const def_t &gfx_def = gfx_lods[l];
+      const GLsizei n = lod_instances[l];
+      if (n) {
+        gl_state.bind_vertex_array(gfx_def.vao);
+        gl_state.bind_buffer(GL_ARRAY_BUFFER, stream_buf.handle);
+        for (uint32_t col = 0; col < 4; ++col)
+          glVertexAttribPointer(vtx_attr.model + col, 4, GL_FLOAT, GL_FALSE,
+                                sizeof(glm::mat4),
+                                (GLvoid *)(offset + sizeof(glm::vec4) * col));
+        set_decode_(gfx_def);
+
+        if (gfx_def.idx_count)
+          glDrawElementsInstanced(mode, gfx_def.idx_count, gfx_def.idx_type,
+                                  NULL, n);
+        else
+          glDrawArraysInstanced(mode, 0, gfx_def.vtx_count, n);
+      }
+      offset += sizeof(glm::mat4) * n;
+    }
+  }
 
-protected:
-  glm::mat4 mat;
-  glm::vec3 pos;
+  // draw each level with the indirect command for it in "commands", the
+  // first at "cmd_offset" and the rest "cmd_stride" bytes apart. The
+  // commands' base_instance find their model matrices in "instances".
+  // Needs GL 4.3 and indexed meshes.
+  static void indirect_draw_(GLenum mode, GLuint instances, GLuint commands,
+                             GLintptr cmd_offset, GLsizei cmd_stride) {
+    // not tracked by gl_state: indirect draws are its only user
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands);
+
+    for (uint32_t l = 0; l < lod_count; ++l) {
+      const def_t &gfx_def = gfx_lods[l];
+      assert(gfx_def.idx_count && "Indirect draws need an indexed mesh!");
+
+      gl_state.bind_vertex_array(gfx_def.vao);
+      gl_state.bind_buffer(GL_ARRAY_BUFFER, instances);
+      for (uint32_t col = 0; col < 4; ++col)
+        glVertexAttribPointer(vtx_attr.model + col, 4, GL_FLOAT, GL_FALSE,
+                              sizeof(glm::mat4),
+                              (GLvoid *)(sizeof(glm::vec4) * col));
+      set_decode_(gfx_def);
+
+      // a single command each: the levels differ in their vertex arrays
+      // and decode values, and GL 4.3 gives shaders no draw index
+      glext.multi_draw_elements_indirect(
+          mode, gfx_def.idx_type,
+          (const void *)(cmd_offset + (GLintptr)cmd_stride * l), 1, 0);
+    }
+  }
 };
 
 #endif
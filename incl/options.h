@@ -0,0 +1,61 @@
+#ifndef __OPTIONS_H__
+#define __OPTIONS_H__
+
+#include "base.h"
+
+// program options, as given on the command line
+struct options_t {
+  // name of a benchmark to run instead of the demo, or NULL
+  const char *bench;
+  // instruction set level of the batch integrator (simd_level_t), or -1 to
+  // use the best level the host supports
+  int simd;
+  // broad-phase collision algorithm (broadphase_mode_t)
+  int broadphase;
+  // job system worker threads; -1 picks one per hardware thread, less the
+  // render thread's
+  int threads;
+  // simulation steps per second
+  float sim_hz;
+  // step the simulation on the render thread instead of its own
+  bool sim_sync;
+  // frames to render offscreen without a window, or 0 to open one
+  int headless;
+  // size of offscreen frames, in pixels
+  int width, height;
+  // file (or "|command") to capture frames to, or NULL
+  const char *capture;
+  // frame rate written into captured streams
+  int capture_fps;
+  // directory of the mesh cache (see mesh-cache.h), or NULL, the
+  // default, to always generate meshes and write nothing
+  const char *mesh_cache;
+  // keep the stream buffer persistently mapped where the context allows
+  bool persistent_map;
+  // where objects the camera cannot see are culled (cull_mode_t)
+  int cull;
+  // screen-space error, in pixels, each object's level of detail is held
+  // to; 0 always draws the finest level
+  float lod_error;
+  // file to write a Chrome trace to at exit, or NULL not to record one
+  const char *trace;
+  // objects to spawn, or 0 for the demo's own layout of ten
+  int objects;
+  // segments around the finest sphere level; it has half as many rings
+  int sphere_segments;
+  // seconds each headless frame advances
+  float frame_dt;
+  // file to write a frame time report to (see frame-report.h), or NULL
+  const char *report;
+  // report to compare with, failing the run if it is slower, or NULL
+  const char *baseline;
+  // percentage slower than the baseline a run may be
+  float max_regression;
+};
+
+// initial definition in options.cpp
+extern options_t opts;
+
+extern void parse_options(int argc, char const *argv[]);
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "base.h"
+#include "trace.h"
+#include "stream-buffer.h"
+
+#include <thread>
+
+// Hierarchical frame profiler. CPU scopes are timed with tsamplr_t and may
+// nest; GPU scopes are timed with GL_TIME_ELAPSED queries, which GL does
+// not let nest, so they wrap the top-level passes of a frame. Each frame
+// in flight has its own set of queries, and one more: every frame reads
+// the sets that are ready, oldest first, and waits only for the set it is
+// about to reuse, which the stream buffer's fences have long since seen
+// the GPU finish. So GPU times arrive a few frames late but are never
+// lost. Scopes opened on any thread but the one that called init() are
+// ignored.
+struct profiler_t {
+  static const uint32_t max_scopes = 64;     // CPU scopes a frame
+  static const uint32_t max_gpu_scopes = 8;  // GPU scopes a frame
+  static const uint32_t history = 128;       // frames kept for the panel
+  static const uint32_t max_totals = 64;     // scopes summed for report()
+  static const uint32_t query_sets = stream_buffer_t::frames_in_flight + 1;
+
+  struct cpu_scope_t {
+    const char *name;
+    uint32_t depth;
+    tsamplr_t::storage_t begin, end;
+  };
+
+  struct gpu_scope_t {
+    const char *name;
+    double ms;
+  };
+
+  struct frame_t {
+    uint64_t index;
+    tsamplr_t::storage_t begin, end;
+    cpu_scope_t cpu[max_scopes];
+    uint32_t cpu_count;
+    gpu_scope_t gpu[max_gpu_scopes];
+    uint32_t gpu_count;
+    bool gpu_valid; // the GPU times have been read
+
+    inline double cpu_ms(void) const {
+      return tsamplr_t::convert(end - begin, tsamplr_t::_ms_);
+    }
+    double gpu_ms(void) const;
+  };
+
+  profiler_t(void);
+
+  // needs the GL context
+  void init(void);
+  void teardown(void);
+
+  void begin_frame(void);
+  void end_frame(void);
+  // read the GPU times of every ended frame, waiting for the GPU
+  void flush(void);
+
+  // open a CPU scope, returning what to close it with. "name" must
+  // outlive the profiler: scopes keep the pointer, not a copy.
+  uint32_t push_cpu(const char *name);
+  void pop_cpu(uint32_t scope);
+
+  // open and close a GPU scope; at most one is open at a time
+  void push_gpu(const char *name);
+  void pop_gpu(void);
+
+  // the newest frame with its GPU times, or NULL before there is one
+  const frame_t *latest(void) const;
+  // frame "index" once ended, or NULL if it is not, or no longer kept
+  const frame_t *frame(uint64_t index) const;
+
+  // flame graph of latest(), and the recent frame times, in the current
+  // ImGui window
+  void draw_panel(void);
+  // average time of every scope over the frames profiled so far
+  void report(void) const;
+
+private:
+  // a scope's time summed over every frame, for report()
+  struct total_t {
+    const char *name;
+    uint32_t depth;
+    bool gpu;
+    double ms;
+    uint64_t frames;
+  };
+
+  void add_total(const char *name, uint32_t depth, bool gpu, double ms);
+  bool read_queries(uint32_t set, bool wait);
+  void read_ready(uint64_t wait_below);
+
+  inline frame_t &current(void) { return frames[frame_count % history]; }
+
+  std::thread::id owner;
+  std::vector<frame_t> frames; // the last "history", by index
+  uint64_t frame_count;
+  uint64_t latest_gpu; // the newest frame with its GPU times, or ~0
+  bool in_frame;
+  uint32_t depth; // CPU scopes open
+
+  // the sets of queries, used by frames in turn, and the frame whose
+  // results each holds, or ~0 once read
+  GLuint queries[query_sets][max_gpu_scopes];
+  uint64_t query_frame[query_sets];
+  bool gpu_open;
+
+  total_t totals[max_totals];
+  uint32_t total_count;
+  double frame_ms; // summed over every frame
+};
+
+// initial definition in profiler.cpp
+extern profiler_t profiler;
+
+// time the rest of the enclosing block on the CPU, and record it in the
+// trace
+struct profile_scope_t {
+  trace_scope_t traced;
+  uint32_t scope;
+  explicit profile_scope_t(const char *name)
+      : traced(name), scope(profiler.push_cpu(name)) {}
+  ~profile_scope_t(void) { profiler.pop_cpu(scope); }
+};
+
+// time the GL commands issued in the rest of the enclosing block
+struct gpu_profile_scope_t {
+  explicit gpu_profile_scope_t(const char *name) { profiler.push_gpu(name); }
+  ~gpu_profile_scope_t(void) { profiler.pop_gpu(); }
+};
+
+#define PROFILE_CAT_(a, b) a##b
+#define PROFILE_CAT(a, b) PROFILE_CAT_(a, b)
+#define PROFILE_SCOPE(name)                                                    \
+  profile_scope_t PROFILE_CAT(profile_scope_, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name)                                                \
+  gpu_profile_scope_t PROFILE_CAT(gpu_profile_scope_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef __READBACK_H__
+#define __READBACK_H__
+
+#include "base.h"
+
+#include <functional>
+
+// Reads frames back through a ring of pixel pack buffers. read() only
+// queues the copy from the framebuffer into a buffer, so it returns at
+// once; the pixels are collected frames later, after the GPU has
+// signalled the fence placed behind the copy.
+struct readback_t {
+  // "rgba" holds height rows of width RGBA8 pixels, bottom row first
+  typedef std::function<void(const uint8_t *rgba, uint64_t frame,
+                             tsamplr_t::storage_t issued)>
+      sink_fn_t;
+
+  readback_t(void) : width(0), height(0), head(0), count(0) {}
+
+  // "depth" buffers of width x height pixels
+  void init(int width, int height, uint32_t depth);
+  void teardown(void);
+
+  // buffers in the ring; 0 until init()
+  inline uint32_t depth(void) const { return (uint32_t)slots.size(); }
+  inline bool full(void) const { return count == slots.size(); }
+  inline uint32_t pending(void) const { return count; }
+  inline uint32_t frame_bytes(void) const { return width * height * 4; }
+
+  // queue a copy of the bound read framebuffer, tagged "frame". The ring
+  // must not be full.
+  void read(uint64_t frame);
+
+  // hand every finished frame to "sink", oldest first. With "wait", block
+  // until at least the oldest frame is done. Returns the frames collected.
+  uint32_t collect(const sink_fn_t &sink, bool wait);
+
+private:
+  struct slot_t {
+    GLuint pbo;
+    GLsync fence;
+    uint64_t frame;
+    tsamplr_t::storage_t issued; // when read() was called
+  };
+
+  uint32_t width, height;
+  std::vector<slot_t> slots;
+  uint32_t head;  // next slot to read into
+  uint32_t count; // slots in flight, ending at head
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include "base.h"
+
+// the type tag of an entity. Entities are grouped by type so that each
+// type's update and render is a linear sweep over its own block.
+enum entity_type_t { ENTITY_SPHERE = 0, ENTITY_CUBE, ENTITY_TYPE_COUNT };
+
+// structure-of-arrays storage for every entity of one type
+struct entity_block_t {
+  std::vector<float> pos_x, pos_y, pos_z;
+  std::vector<float> vel_x, vel_y, vel_z;
+  std::vector<float> mass;
+  std::vector<glm::mat4> model;
+
+  inline uint32_t size(void) const { return (uint32_t)mass.size(); }
+
+  inline glm::vec3 get_pos(uint32_t i) const {
+    return glm::vec3(pos_x[i], pos_y[i], pos_z[i]);
+  }
+
+  inline glm::vec3 get_vel(uint32_t i) const {
+    return glm::vec3(vel_x[i], vel_y[i], vel_z[i]);
+  }
+
+  uint32_t add(glm::vec3 pos, float mass);
+  void reserve(uint32_t count);
+  void clear(void);
+};
+
+// handle to an entity in the scene
+struct entity_t {
+  entity_type_t type;
+  uint32_t idx;
+};
+
+struct scene_t {
+  entity_block_t blocks[ENTITY_TYPE_COUNT];
+
+  // simulated time, in seconds
+  double time;
+
+  scene_t(void) : time(0.0) {}
+
+  inline entity_block_t &operator[](entity_type_t type) {
+    return blocks[type];
+  }
+
+  inline const entity_block_t &operator[](entity_type_t type) const {
+    return blocks[type];
+  }
+
+  entity_t spawn(entity_type_t type, glm::vec3 pos, float mass);
+  uint32_t size(void) const;
+  void clear(void);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __SHADER_H__
+#define __SHADER_H__
+
+#include "base.h"
+#include "gl-state.h"
+
+#include <unordered_map>
+
+// A linked shader program whose active uniforms and attributes are
+// reflected once, at link time. Uniforms are addressed through handles
+// looked up once (typically at init) rather than by name every frame, and
+// each setter remembers the last value uploaded so that setting the same
+// value again costs no GL call.
+struct shader_program_t {
+  // index into the uniform table; -1 for uniforms the program lacks (e.g.
+  // optimised out), which setters silently ignore
+  typedef int32_t uniform_t;
+
+  GLuint handle;
+
+  shader_program_t(void) : handle(0), uploads(0), skipped(0) {}
+
+  // compile, link and reflect; exits with the build log on failure
+  void create(const char *vs_src, const char *fs_src);
+  // as create, for a compute program (GL 4.3)
+  void create_compute(const char *cs_src);
+  void destroy(void);
+
+  inline void use(void) const { gl_state.use_program(handle); }
+
+  // handle of the named uniform; array uniforms are found by their plain
+  // name, without "[0]"
+  uniform_t uniform(const char *name) const;
+  // location of the named vertex attribute, or -1
+  GLint attrib(const char *name) const;
+  // read the named uniform block from buffer binding point "binding".
+  // Returns false if the program has no such block.
+  bool bind_block(const char *name, GLuint binding);
+
+  // the program must be in use
+  void set(uniform_t u, GLint v);
+  void set(uniform_t u, GLuint v);
+  void set(uniform_t u, GLfloat v);
+  void set(uniform_t u, const glm::vec2 &v);
+  void set(uniform_t u, const glm::vec3 &v);
+  void set(uniform_t u, const glm::vec4 &v);
+  void set(uniform_t u, const glm::mat4 &v);
+  void set(uniform_t u, const glm::mat4 *v, GLsizei count);
+
+  // uploads made and skipped as redundant, since create()
+  uint32_t uploads, skipped;
+
+private:
+  struct uniform_info_t {
+    GLint location;
+    GLenum type;
+    GLint size;      // array length
+    uint32_t offset; // of the last value in "shadow"
+    bool known;      // whether "shadow" holds the current value
+  };
+
+  std::vector<uniform_info_t> uniforms;
+  std::unordered_map<std::string, uniform_t> uniform_index;
+  std::unordered_map<std::string, GLint> attrib_locations;
+
+  // last value set of each uniform
+  std::vector<uint8_t> shadow;
+
+  void reflect(void);
+  // record "data" as the value of "u", returning false if it already was
+  bool changed(uniform_t u, GLenum type, const void *data, size_t bytes);
+};
+
+#endif
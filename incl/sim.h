@@ -0,0 +1,118 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include "base.h"
+#include "scene.h"
+#include "collision.h"
+
+#include <atomic>
+#include <thread>
+
+// Single-producer, single-consumer exchange of whole values. The producer
+// fills write_buffer() and publishes it; the consumer acquires the most
+// recently published value. Neither side ever waits for the other: values
+// the consumer did not get to in time are overwritten.
+template <typename T> struct triple_buffer_t {
+  triple_buffer_t(void) : back(0), front(1), middle(2) {}
+
+  // producer side
+  inline T &write_buffer(void) { return bufs[back]; }
+
+  inline void publish(void) {
+    back = middle.exchange(back | fresh_bit, std::memory_order_acq_rel) &
+           index_mask;
+  }
+
+  // consumer side: returns true if a value newer than read_buffer() has
+  // been swapped in
+  inline bool acquire(void) {
+    if (!(middle.load(std::memory_order_relaxed) & fresh_bit))
+      return false;
+    front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+    return true;
+  }
+
+  inline const T &read_buffer(void) const { return bufs[front]; }
+
+private:
+  static const uint32_t fresh_bit = 4;
+  static const uint32_t index_mask = 3;
+
+  T bufs[3];
+  uint32_t back, front;
+  // index of the buffer between the two sides, plus "fresh_bit" when it
+  // holds a value the consumer has not seen
+  std::atomic<uint32_t> middle;
+};
+
+// the state the renderer needs from one simulation step
+struct sim_snapshot_t {
+  // simulated time of "pos"; "prev_pos" is one step earlier
+  double time;
+  uint64_t step;
+  std::vector<glm::vec3> pos[ENTITY_TYPE_COUNT];
+  std::vector<glm::vec3> prev_pos[ENTITY_TYPE_COUNT];
+
+  sim_snapshot_t(void) : time(0.0), step(0) {}
+
+  // model matrices of every entity of "type", a fraction "alpha" of the
+  // way from "prev_pos" to "pos"
+  void interpolate(entity_type_t type, float alpha,
+                   std::vector<glm::mat4> *models) const;
+
+  // as above, the positions alone
+  void interpolate(entity_type_t type, float alpha,
+                   std::vector<glm::vec3> *positions) const;
+};
+
+// Advances the scene with a fixed time step, either when asked to (step,
+// advance_to) or on a thread of its own paced against the wall clock
+// (start). Every batch of steps is published as a snapshot for the render
+// thread, which should not touch "scene" while the thread runs.
+struct sim_t {
+  scene_t scene;
+  broadphase_t broadphase;
+
+  // length of one step, in seconds
+  double step_dt;
+
+  // most steps advance_to takes in one go (0: no limit); beyond that the
+  // simulation slows down rather than spiralling
+  uint32_t max_catchup;
+
+  triple_buffer_t<sim_snapshot_t> snapshots;
+
+  sim_t(void) : step_dt(0.01), max_catchup(8), steps(0), running(false) {}
+
+  // one fixed step
+  void step(void);
+
+  // step until the next step would pass "t" (or max_catchup steps have
+  // been taken), then publish. Returns the number of steps taken.
+  uint32_t advance_to(double t);
+
+  // hand the current state to the reader
+  void publish(void);
+
+  // run the simulation on its own thread, with simulated time following
+  // the wall clock from now on
+  void start(void);
+  void stop(void);
+  inline bool is_running(void) const { return running; }
+
+private:
+  collider_set_t colliders;
+  std::vector<body_pair_t> pairs;
+  std::vector<contact_t> contacts;
+
+  // positions before the latest step
+  std::vector<glm::vec3> prev_pos[ENTITY_TYPE_COUNT];
+
+  uint64_t steps;
+  std::atomic<bool> running;
+  std::thread thread;
+
+  void run(void);
+};
+
+#endif
@@ -2,28 +2,27 @@
 #define __SPHERE_H__
 
 #include "object.h"
+#include "scene.h"
 
-struct sphere_t : public object_t, public gfx_obj_t<sphere_t> {
-  sphere_t(void) : object_t(), gfx_obj_t<sphere_t>() {}
+// radius of the sphere mesh, in world units
+static const float sphere_radius = 1.0f;
 
-  virtual ~sphere_t(void) {}
+// behaviour and graphics resources shared by every sphere entity
+struct sphere_t : public gfx_obj_t<sphere_t> {
+  static void setup(void);
+  static void teardown(void);
 
-  virtual void setup(glm::vec3 pos) override final;
-  virtual void teardown(void) override final;
+  // advance by "dt" seconds; callers keep dt fixed (see sim_t)
+  static void update(entity_block_t *blk, float dt);
 
-  void update(float dt);
-  void render(GLuint shdr_prog);
+  // draw spheres grouped by level of detail, "lod_instances[l]" of level l,
+  // with one instanced draw call per level
+  static void render(const glm::mat4 *models, const uint32_t *lod_instances);
 
-private:
-  struct physical_state_t{
-    glm::vec3 force, accl, crnt_vel, prev_vel;
-    float mass;
-  } state;
-  bool check_collisions();
-
-  
+  // draw the spheres a gpu_culler_t found visible, with one indirect draw
+  // per level of detail
+  static void render_indirect(GLuint instances, GLuint commands,
+                              GLintptr cmd_offset, GLsizei cmd_stride);
 };
 
-
-
 #endif
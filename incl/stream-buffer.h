@@ -0,0 +1,73 @@
+#ifndef __STREAM_BUFFER_H__
+#define __STREAM_BUFFER_H__
+
+#include "base.h"
+
+// One buffer object that all data rewritten every frame (instance
+// matrices, GUI geometry, uniforms) is sub-allocated from, instead of each
+// user respecifying its own buffer with glBufferData, which makes the
+// driver find new storage or wait for the GPU.
+//
+// The buffer is split into one region per frame in flight. A frame fills
+// its region front to back; end_frame() fences it and moves on to the
+// next, waiting only if the GPU is still reading that one. Where the
+// context has ARB_buffer_storage the buffer stays mapped, persistently and
+// coherently, and map()/unmap() cost nothing; otherwise each map() maps
+// just its range, unsynchronised, since the fences already guarantee the
+// GPU is done with it.
+struct stream_buffer_t {
+  static const uint32_t frames_in_flight = 3;
+
+  // the buffer object. It changes when a frame outgrows its region and the
+  // buffer is replaced by a larger one, so users bind it afresh after each
+  // map() rather than caching it.
+  GLuint handle;
+
+  // bytes the last frame used, frames that had to wait for the GPU, and
+  // times the buffer has been grown
+  uint64_t last_frame_bytes, stalls, grows;
+
+  stream_buffer_t(void)
+      : handle(0), last_frame_bytes(0), stalls(0), grows(0), persistent(false),
+        region_size(0), frame(0), head(0), base(NULL) {}
+
+  // a buffer of "region_bytes" per frame; "persistent" asks for a
+  // persistent mapping, used if the context supports it
+  void init(GLsizeiptr region_bytes, bool persistent);
+  void teardown(void);
+
+  inline bool is_persistent(void) const { return persistent; }
+
+  // reserve "size" bytes at a multiple of "align" bytes from the start of
+  // the buffer, setting "*offset" to where they are, and return where to
+  // write them. The memory is write-only, and must be filled and unmap()ed
+  // before anything else is mapped or drawn. GL_ARRAY_BUFFER is left bound
+  // to the buffer.
+  void *map(GLsizeiptr size, GLsizeiptr align, GLintptr *offset);
+  void unmap(void);
+
+  // the frame's commands have all been issued: fence its region and make
+  // the next one current
+  void end_frame(void);
+
+private:
+  bool persistent;
+  GLsizeiptr region_size;
+  uint32_t frame;   // current region
+  GLsizeiptr head;  // next free byte in it
+  uint8_t *base;    // the persistent mapping, or NULL
+  GLsync fences[frames_in_flight];
+
+  // buffers replaced this frame, deleted at its end: deleting a buffer
+  // unbinds it everywhere, and ranges of it are bound for the frame
+  std::vector<GLuint> retired;
+
+  void create(GLsizeiptr region_bytes);
+  void retire(void);
+  void release_retired(void);
+};
+
+// initial definition in stream-buffer.cpp
+extern stream_buffer_t stream_buf;
+
+#endif
@@ -41,6 +41,11 @@ public:
 
   inline void sample(void) {
     t0 = t1;
+    t1 = now();
+  }
+
+  // current reading of the underlying monotonic clock
+  static inline storage_t now(void) {
 #ifdef __linux__
     timespec time_spec;
     int err = clock_gettime(CLOCK_MONOTONIC, &time_spec);
@@ -49,7 +54,7 @@ public:
       exit(1);
     }
 
-    t1 = (time_spec.tv_sec * 1000000000) + time_spec.tv_nsec;
+    return (time_spec.tv_sec * 1000000000) + time_spec.tv_nsec;
 #else
 #if _WIN32
     LARGE_INTEGER time_spec;
@@ -58,7 +63,7 @@ public:
       perror("QueryPerformanceCounter(&time_spec)");
       exit(1);
     }
-    t1 = time_spec.QuadPart;
+    return time_spec.QuadPart;
 #endif // _WIN32
 #endif
   }
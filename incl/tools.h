@@ -1,4 +1,3 @@
-
 #ifndef __TOOLS_H__
 #define __TOOLS_H__
 
@@ -17,14 +16,86 @@ enum mesh_type {
   DISC,
   SPHERE,
   CUBE,
-  TORUS
+  TORUS,
+  ICOSPHERE,
+  CYLINDER,
+  CONE,
+  CAPSULE
 };
 
+// Size parameters by type, centred on the origin with any axis along y:
+// SPHERE:    diameter, segments around, rings from pole to pole
+// ICOSPHERE: diameter, subdivision levels
+// TORUS:     radius of the ring, radius of the tube
+// DISC:      diameter (facing +y)
+// CYLINDER:  diameter, height (capped)
+// CONE:      diameter of the base, height (apex up, base capped)
+// CAPSULE:   diameter, height from tip to tip
+//
+// TORUS, DISC, CYLINDER, CONE and CAPSULE are surfaces of revolution
+// with "res_u" segments around the axis and "res_v" along the profile
+// (around the tube, from the centre out, along the side, or over the
+// two caps). They are cheap enough to regenerate every frame.
 struct mesh_create_info_t {
   mesh_type type;
   float sz_param0, sz_param1, sz_param2;
+  uint32_t res_u, res_v;
+};
+
+// number of elements in each array of a mesh
+struct mesh_size_t {
+  size_t vtx, idx, txcrd, norm;
 };
 
+extern const char *mesh_type_name(mesh_type type);
+
+// exact array sizes of the mesh "info" describes, without generating it
+extern mesh_size_t mesh_data_size(const mesh_create_info_t *info);
+
+// generate the mesh "info" describes into "out", quietly. Each array is
+// resized to its exact size before it is written, so a mesh_t that already
+// has the capacity (from an earlier mesh, or reserved by the caller) is
+// refilled without allocating. Large meshes are generated in parallel on
+// the job system; the result does not depend on the thread count.
+extern void generate_mesh_data(const mesh_create_info_t *info, mesh_t *out);
+
+// How a mesh's vertices are laid out on the GPU
+enum vertex_layout_t {
+  // one float array per attribute and 32-bit indices: 32 bytes a vertex
+  VTX_LAYOUT_SEPARATE = 0,
+  // interleaved packed_vtx_t, and 16-bit indices where the vertex count
+  // allows: 16 bytes a vertex
+  VTX_LAYOUT_PACKED
+};
+
+// A quantised vertex. Positions are 16-bit integers spanning the mesh's
+// bounding box (see vtx_decode_t), normals are octahedral-encoded snorm16
+// pairs and texture coordinates are 16-bit integers spanning the largest
+// coordinate's magnitude, so tiling coordinates survive.
+struct packed_vtx_t {
+  int16_t pos[4]; // w is padding
+  int16_t nrm[2];
+  int16_t txcrd[2];
+};
+
+// Turns packed positions back into mesh space: pos * scale + bias. The w
+// of "scale" is 1 when normals are octahedral-encoded, 0 when they are
+// plain vectors; texture coordinates are txcrd * bias.w.
+struct vtx_decode_t {
+  glm::vec4 scale;
+  glm::vec4 bias;
+};
+
+// quantise the vertices of "m" into "out", which is resized to fit
+extern vtx_decode_t pack_vertices(const mesh_t *m,
+                                  std::vector<packed_vtx_t> *out);
+// whether the indices of "m" fit in 16 bits
+extern bool fits_16bit_indices(const mesh_t *m);
+// narrow the indices of "m" into "out", which is resized to fit
+extern void pack_indices(const mesh_t *m, std::vector<uint16_t> *out);
+
+// as generate_mesh_data, then optimised for the vertex cache and vertex
+// fetch (see mesh-opt.h), logging what was made
 extern void create_mesh_data(const mesh_create_info_t *info, mesh_t *out);
 extern void destroy_mesh_data(mesh_t *ptr);
 
@@ -0,0 +1,97 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "base.h"
+
+#include <atomic>
+
+// Trace recorder, for chrome://tracing and Perfetto. Each thread records
+// begin/end events into a ring of its own, which only it writes, so
+// recording takes no lock: a timestamp from tsamplr_t::now() and a store.
+// A thread that records more than ring_size events keeps the newest.
+// dump() writes every ring as Chrome trace JSON and can run while other
+// threads keep recording: it copies a ring, then rereads its head and
+// drops the events that may have been overwritten meanwhile, as a seqlock
+// reader would. Copying slots another thread may be writing is formally a
+// data race (and so reported by TSan), but no torn event is ever written.
+// While stopped, a TRACE_SCOPE costs one relaxed load; built without
+// ENABLE_TRACE, nothing at all.
+#if ENABLE_TRACE
+
+struct trace_t {
+  static const uint32_t ring_size = 1 << 16; // events kept per thread
+
+  trace_t(void) : recording(false), origin(0) {}
+
+  void start(void);
+  void stop(void);
+  inline bool active(void) const {
+    return recording.load(std::memory_order_relaxed);
+  }
+
+  // "name" must outlive the trace: events keep the pointer, not a copy
+  void begin(const char *name);
+  void end(const char *name);
+
+  // name the calling thread in the trace
+  void name_thread(const char *name);
+
+  // write the events recorded so far to "path"; false if it cannot
+  bool dump(const char *path) const;
+
+private:
+  std::atomic<bool> recording;
+  tsamplr_t::storage_t origin; // time 0 of the trace
+};
+
+// record the rest of the enclosing block, if the trace is recording as
+// it starts
+struct trace_scope_t {
+  const char *name;
+  explicit trace_scope_t(const char *name);
+  ~trace_scope_t(void);
+};
+
+#else
+
+struct trace_t {
+  inline void start(void) {}
+  inline void stop(void) {}
+  inline bool active(void) const { return false; }
+  inline void begin(const char *) {}
+  inline void end(const char *) {}
+  inline void name_thread(const char *) {}
+  inline bool dump(const char *) const { return false; }
+};
+
+struct trace_scope_t {
+  explicit trace_scope_t(const char *) {}
+};
+
+#endif
+
+// initial definition in trace.cpp
+extern trace_t trace;
+
+#if ENABLE_TRACE
+inline trace_scope_t::trace_scope_t(const char *name)
+    : name(trace.active() ? name : NULL) {
+  if (this->name)
+    trace.begin(this->name);
+}
+
+inline trace_scope_t::~trace_scope_t(void) {
+  if (name)
+    trace.end(name);
+}
+#endif
+
+#define TRACE_CAT_(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT_(a, b)
+#if ENABLE_TRACE
+#define TRACE_SCOPE(name) trace_scope_t TRACE_CAT(trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+#endif
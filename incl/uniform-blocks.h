@@ -0,0 +1,30 @@
+#ifndef __UNIFORM_BLOCKS_H__
+#define __UNIFORM_BLOCKS_H__
+
+#include "base.h"
+#include "camera.h"
+
+// Uniform blocks shared by every program, each read from a fixed buffer
+// binding point. A program declares the block with the GLSL below and
+// attaches it with shader_program_t::bind_block. The data is written once
+// a frame into the stream buffer, however many programs and draws use it.
+enum uniform_binding_t { UBO_CAMERA = 0, UBO_BINDING_COUNT };
+
+// the std140 layout of "camera_block"
+struct camera_block_t {
+  glm::mat4 view, proj, view_proj;
+  glm::vec4 eye; // world-space camera position, w = 1
+};
+
+#define CAMERA_BLOCK_GLSL                                                     \
+  "layout(std140) uniform camera_block {\n"                                   \
+  "  mat4 view;\n"                                                            \
+  "  mat4 proj;\n"                                                            \
+  "  mat4 view_proj;\n"                                                       \
+  "  vec4 eye;\n"                                                             \
+  "} camera;\n"
+
+// fill camera_block for "cam" and bind it to UBO_CAMERA, for the frame
+extern void upload_camera_block(const camera_t &cam);
+
+#endif
@@ -0,0 +1,913 @@
+#include "bench.h"
+#include "base.h"
+#include "scene.h"
+#include "sphere.h"
+#include "cube.h"
+#include "integrator.h"
+#include "collision.h"
+#include "jobs.h"
+#include "sim.h"
+#include "tools.h"
+#include "mesh-opt.h"
+#include "mesh-import.h"
+#include "culling.h"
+
+#include <cprintf/cprintf.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <tuple>
+
+// time "iters" invocations of fn, returning the mean in milliseconds
+template <typename F> static double time_ms(int iters, F fn) {
+  tsamplr_t::storage_t elapsed = 0;
+  {
+    tsamplr_t ts(&elapsed);
+    for (int i = 0; i < iters; ++i)
+      fn();
+  }
+  return tsamplr_t::convert(elapsed, tsamplr_t::_ms_) / iters;
+}
+
+// number of timed iterations giving roughly "work" entity updates in total
+static int iters_for(uint32_t count, uint32_t work) {
+  return (int)glm::max(1U, work / count);
+}
+
+//--------------------------------------------------------------------
+//	scene layout: heap-allocated polymorphic objects vs. the SoA store
+//--------------------------------------------------------------------
+
+// replica of the pointer-chasing layout the scene store replaced
+struct legacy_object_t {
+  legacy_object_t(void) : mat(glm::mat4(1.0f)), pos(0.0f) {}
+  virtual ~legacy_object_t(void) {}
+
+  glm::mat4 mat;
+  glm::vec3 pos;
+};
+
+struct legacy_sphere_t : public legacy_object_t {
+  struct physical_state_t {
+    glm::vec3 force, accl, crnt_vel, prev_vel;
+    float mass;
+  } state;
+
+  void update(float dt) {
+    dt = glm::clamp(dt, 0.0f, 0.01f);
+    const glm::vec3 fgrav = {0.0f, -9.8f, 0.0f};
+    const glm::vec3 fnorm = -fgrav;
+    state.force = fgrav;
+    if ((pos.y - 1.0f) < 1.0f)
+      state.force += fnorm;
+    state.accl = (state.force / state.mass);
+    state.crnt_vel = (state.prev_vel + state.accl) * dt;
+    pos += state.crnt_vel * dt;
+    state.prev_vel = state.crnt_vel;
+    mat = glm::translate(glm::mat4(1.0f), pos);
+  }
+};
+
+struct legacy_cube_t : public legacy_object_t {
+  void update(float dt) {
+    static float t = 0;
+    t += dt;
+    pos.y = sin(t) + 1.0f;
+    mat = glm::translate(glm::mat4(1.0), pos);
+  }
+};
+
+static bool bench_scene_layout(void) {
+  const float dt = 1.0f / 60.0f;
+  const uint32_t counts[] = {1000, 10000, 100000, 1000000};
+
+  printf("%10s %14s %14s %9s\n", "entities", "legacy [ms]", "soa [ms]",
+         "speedup");
+
+  for (uint32_t count : counts) {
+    std::mt19937 rng(count);
+    std::uniform_real_distribution<float> coord(-100.0f, 100.0f);
+
+    std::vector<std::unique_ptr<legacy_object_t>> objects(count);
+    scene_t scene;
+    scene[ENTITY_SPHERE].reserve(count / 2 + 1);
+    scene[ENTITY_CUBE].reserve(count / 2 + 1);
+
+    for (uint32_t i = 0; i < count; ++i) {
+      glm::vec3 pos(coord(rng), coord(rng) + 100.0f, coord(rng));
+      if (i & 1) {
+        legacy_sphere_t *s = new legacy_sphere_t;
+        s->state.force = s->state.accl = glm::vec3(0.0f);
+        s->state.crnt_vel = s->state.prev_vel = glm::vec3(0.0f);
+        s->state.mass = 0.01f;
+        s->pos = pos;
+        objects[i].reset(s);
+        scene.spawn(ENTITY_SPHERE, pos, 0.01f);
+      } else {
+        legacy_cube_t *c = new legacy_cube_t;
+        c->pos = pos;
+        objects[i].reset(c);
+        scene.spawn(ENTITY_CUBE, pos, 1.0f);
+      }
+    }
+
+    const int iters = iters_for(count, 20000000);
+
+    double legacy_ms = time_ms(iters, [&](void) {
+      for (auto &obj : objects) {
+        void *ptr = (void *)dynamic_cast<legacy_sphere_t *>(obj.get());
+        if (ptr) {
+          ((legacy_sphere_t *)ptr)->update(dt);
+          continue;
+        }
+
+        ptr = (void *)dynamic_cast<legacy_cube_t *>(obj.get());
+        if (ptr)
+          ((legacy_cube_t *)ptr)->update(dt);
+      }
+    });
+
+    double soa_ms = time_ms(iters, [&](void) {
+      scene.time += dt;
+      sphere_t::update(&scene[ENTITY_SPHERE], dt);
+      cube_t::update(&scene[ENTITY_CUBE], (float)scene.time);
+    });
+
+    printf("%10u %14.4f %14.4f %8.2fx\n", count, legacy_ms, soa_ms,
+           legacy_ms / soa_ms);
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	sphere integrator: scalar reference vs. vector paths
+//--------------------------------------------------------------------
+
+// how far a vector path may end up from the scalar one. Positions stay
+// within a few hundred units, where a float step is about 3e-5: this
+// allows a few steps, as from a compiler contracting into FMAs, and
+// nothing that is a bug.
+static const float integrator_tolerance = 1e-4f;
+
+static bool bench_integrator(void) {
+  const float dt = 0.01f;
+  const int steps = 64; // per timed iteration
+  const uint32_t counts[] = {1000, 10000, 100000, 1000000};
+
+  printf("host supports: %s\n", simd_name(simd_detect()));
+  printf("%10s %8s %14s %12s %9s %12s\n", "spheres", "level", "step [ms]",
+         "Mspheres/s", "speedup", "max |diff|");
+  bool passed = true;
+
+  for (uint32_t count : counts) {
+    std::mt19937 rng(count);
+    std::uniform_real_distribution<float> coord(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> mass(0.005f, 0.05f);
+
+    entity_block_t initial;
+    initial.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+      initial.add(glm::vec3(coord(rng), coord(rng) + 100.0f, coord(rng)),
+                  mass(rng));
+
+    // the reference result every level is compared against
+    entity_block_t reference = initial;
+    for (int s = 0; s < steps; ++s)
+      integrate_spheres_with(SIMD_SCALAR, &reference, dt, 0, count);
+
+    const int iters = iters_for(count * steps, 50000000);
+    double scalar_ms = 0.0;
+
+    for (int l = 0; l <= (int)simd_detect(); ++l) {
+      const simd_level_t level = (simd_level_t)l;
+
+      entity_block_t blk = initial;
+      for (int s = 0; s < steps; ++s)
+        integrate_spheres_with(level, &blk, dt, 0, count);
+
+      float max_diff = 0.0f;
+      for (uint32_t i = 0; i < count; ++i)
+        max_diff = glm::max(
+            max_diff,
+            glm::max(glm::abs(blk.pos_x[i] - reference.pos_x[i]),
+                     glm::max(glm::abs(blk.pos_y[i] - reference.pos_y[i]),
+                              glm::abs(blk.pos_z[i] - reference.pos_z[i]))));
+
+      double ms = time_ms(iters, [&](void) {
+                    for (int s = 0; s < steps; ++s)
+                      integrate_spheres_with(level, &blk, dt, 0, count);
+                  }) /
+                  steps;
+      if (level == SIMD_SCALAR)
+        scalar_ms = ms;
+
+      const bool within = max_diff <= integrator_tolerance;
+      passed &= within;
+      printf("%10u %8s %14.4f %12.2f %8.2fx %12g%s\n", count,
+             simd_name(level), ms, (count / 1000000.0) / (ms / 1000.0),
+             scalar_ms / ms, max_diff, within ? "" : " TOO FAR");
+    }
+  }
+  return passed;
+}
+
+//--------------------------------------------------------------------
+//	broad phase: spatial hash grid vs. sweep-and-prune
+//--------------------------------------------------------------------
+
+static bool bench_broadphase(void) {
+  const uint32_t counts[] = {1000, 10000, 100000};
+  const char *mode_names[] = {"grid", "sap"};
+
+  printf("%9s %6s %12s %12s %10s %12s %9s\n", "bodies", "mode", "build [ms]",
+         "query [ms]", "pairs", "Mpairs/s", "verified");
+
+  for (uint32_t count : counts) {
+    // keep the density (and so the pairs per body) constant across counts
+    const float half_width = 0.5f * std::cbrt(count * 12.0f);
+
+    std::mt19937 rng(count);
+    std::uniform_real_distribution<float> coord(-half_width, half_width);
+    std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+
+    collider_set_t set;
+    for (uint32_t i = 0; i < count; ++i) {
+      glm::vec3 c(coord(rng), coord(rng), coord(rng));
+      entity_t ent = {ENTITY_SPHERE, i};
+      if (i % 4)
+        set.add(c, glm::vec3(sphere_radius), SHAPE_SPHERE, ent);
+      else
+        set.add(c, glm::vec3(cube_half_size), SHAPE_BOX, ent);
+    }
+
+    // the exhaustive answer, where that is affordable
+    size_t expected = 0;
+    const bool verify = count <= 10000;
+    if (verify) {
+      for (uint32_t i = 0; i < count; ++i)
+        for (uint32_t j = i + 1; j < count; ++j) {
+          glm::vec3 d = glm::abs(set.centre[i] - set.centre[j]);
+          glm::vec3 e = set.extent[i] + set.extent[j];
+          expected += (d.x <= e.x && d.y <= e.y && d.z <= e.z);
+        }
+    }
+
+    for (int m = 0; m < 2; ++m) {
+      broadphase_t bp;
+      bp.mode = (broadphase_mode_t)m;
+      bp.build(set);
+
+      // per-frame rebuild cost, after every body has moved a little
+      collider_set_t moved = set;
+      for (uint32_t i = 0; i < count; ++i)
+        moved.centre[i] += glm::vec3(jitter(rng), jitter(rng), jitter(rng));
+
+      const int iters = iters_for(count, 2000000);
+      double build_ms = time_ms(iters, [&](void) { bp.build(moved); });
+
+      std::vector<body_pair_t> pairs;
+      double query_ms = time_ms(iters, [&](void) {
+        pairs.clear();
+        bp.find_pairs(moved, &pairs);
+      });
+
+      // verify against the unmoved set
+      const char *verified = "-";
+      if (verify) {
+        broadphase_t check;
+        check.mode = bp.mode;
+        check.build(set);
+        std::vector<body_pair_t> found;
+        check.find_pairs(set, &found);
+        verified = found.size() == expected ? "yes" : "NO";
+      }
+
+      printf("%9u %6s %12.4f %12.4f %10zu %12.2f %9s\n", count,
+             mode_names[m], build_ms, query_ms, pairs.size(),
+             (pairs.size() / 1000000.0) / ((build_ms + query_ms) / 1000.0),
+             verified);
+    }
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	physics step scaling with the job system's thread count
+//--------------------------------------------------------------------
+
+// FNV-1a over the raw bytes of the positions, to compare runs exactly
+static uint64_t hash_positions(const scene_t &scene) {
+  uint64_t h = 1469598103934665603ULL;
+  auto mix = [&](const std::vector<float> &col) {
+    const uint8_t *bytes = (const uint8_t *)col.data();
+    for (size_t i = 0; i < col.size() * sizeof(float); ++i)
+      h = (h ^ bytes[i]) * 1099511628211ULL;
+  };
+  for (uint32_t t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+    mix(scene.blocks[t].pos_x);
+    mix(scene.blocks[t].pos_y);
+    mix(scene.blocks[t].pos_z);
+  }
+  return h;
+}
+
+static bool bench_physics_threads(void) {
+  const uint32_t count = 100000;
+  const int steps = 32;
+  const float dt = 0.01f;
+
+  // the bench owns the job system while it runs
+  const uint32_t restore = jobs.num_threads() - 1;
+  const uint32_t hw = glm::max(1U, std::thread::hardware_concurrency());
+
+  // always go up to a few threads, so determinism is checked even on
+  // small machines
+  std::vector<uint32_t> thread_counts = {1};
+  for (uint32_t t = 2; t < glm::max(hw, 4U); t *= 2)
+    thread_counts.push_back(t);
+  thread_counts.push_back(glm::max(hw, 4U));
+
+  printf("%u spheres + cubes, %d steps\n", count, steps);
+  printf("%8s %12s %9s %18s\n", "threads", "step [ms]", "speedup",
+         "state hash");
+
+  double single_ms = 0.0;
+  uint64_t reference_hash = 0;
+
+  for (uint32_t threads : thread_counts) {
+    jobs.teardown();
+    jobs.init(threads - 1); // 0 workers: the caller alone
+
+    std::mt19937 rng(count);
+    const float half_width = 0.5f * std::cbrt(count * 12.0f);
+    std::uniform_real_distribution<float> coord(-half_width, half_width);
+
+    sim_t sim;
+    sim.step_dt = dt;
+    for (uint32_t i = 0; i < count; ++i) {
+      glm::vec3 pos(coord(rng), coord(rng) + half_width, coord(rng));
+      sim.scene.spawn(i % 4 ? ENTITY_SPHERE : ENTITY_CUBE, pos, 0.01f);
+    }
+
+    double ms = time_ms(steps, [&](void) { sim.step(); });
+
+    const uint64_t h = hash_positions(sim.scene);
+    if (threads == 1) {
+      single_ms = ms;
+      reference_hash = h;
+    }
+
+    printf("%8u %12.4f %8.2fx %18.16llx%s\n", threads, ms, single_ms / ms,
+           (unsigned long long)h, h == reference_hash ? "" : " MISMATCH");
+  }
+
+  jobs.teardown();
+  jobs.init(restore);
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	simulation thread: inline stepping vs. snapshots
+//--------------------------------------------------------------------
+
+// Frame-thread cost of keeping the simulation going: stepping it inline
+// versus consuming snapshots from the simulation thread. Frames are paced
+// at 60 Hz for one second, with the simulation at several rates.
+static bool bench_sim_thread(void) {
+  const uint32_t count = 20000;
+  const double frame_dt = 1.0 / 60.0;
+  const int frames = 60;
+  const float rates[] = {60.0f, 240.0f, 1000.0f};
+
+  printf("%u spheres + cubes, %d frames at 60 Hz\n", count, frames);
+  printf("%8s %8s %15s %15s %12s\n", "sim [Hz]", "mode", "avg frame [ms]",
+         "max frame [ms]", "steps/s");
+
+  for (float hz : rates) {
+    for (int threaded = 0; threaded < 2; ++threaded) {
+      std::mt19937 rng(count);
+      const float half_width = 0.5f * std::cbrt(count * 12.0f);
+      std::uniform_real_distribution<float> coord(-half_width, half_width);
+
+      sim_t sim;
+      sim.step_dt = 1.0 / hz;
+      for (uint32_t i = 0; i < count; ++i) {
+        glm::vec3 pos(coord(rng), coord(rng) + half_width, coord(rng));
+        sim.scene.spawn(i % 4 ? ENTITY_SPHERE : ENTITY_CUBE, pos, 0.01f);
+      }
+      sim.publish();
+
+      std::vector<glm::mat4> models[ENTITY_TYPE_COUNT];
+      double render_time = 0.0, total_ms = 0.0, max_ms = 0.0;
+
+      const tsamplr_t::storage_t start = tsamplr_t::now();
+      if (threaded)
+        sim.start();
+
+      for (int f = 0; f < frames; ++f) {
+        tsamplr_t::storage_t frame_ns = 0;
+        {
+          tsamplr_t sampler(&frame_ns);
+          render_time += frame_dt;
+          if (!threaded)
+            sim.advance_to(render_time);
+
+          sim.snapshots.acquire();
+          const sim_snapshot_t &snap = sim.snapshots.read_buffer();
+          render_time =
+              glm::clamp(render_time, snap.time, snap.time + sim.step_dt);
+          const float alpha = (float)((render_time - snap.time) / sim.step_dt);
+          for (int t = 0; t < ENTITY_TYPE_COUNT; ++t)
+            snap.interpolate((entity_type_t)t, alpha, &models[t]);
+        }
+
+        const double ms = tsamplr_t::convert(frame_ns, tsamplr_t::_ms_);
+        total_ms += ms;
+        max_ms = glm::max(max_ms, ms);
+
+        const double wait = frame_dt - ms * 0.001;
+        if (wait > 0.0)
+          std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+      }
+
+      sim.stop();
+
+      const double elapsed =
+          tsamplr_t::convert(tsamplr_t::now() - start, tsamplr_t::_s_);
+      printf("%8.0f %8s %15.4f %15.4f %12.1f\n", hz,
+             threaded ? "thread" : "inline", total_ms / frames, max_ms,
+             sim.scene.time / sim.step_dt / elapsed);
+    }
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	procedural mesh generation
+//--------------------------------------------------------------------
+
+// Generation time of each mesh type over increasing resolution: into a
+// fresh mesh (allocating), and refilling one that already has the storage,
+// on one thread and on all of them.
+static bool bench_meshgen(void) {
+  const uint32_t restore = jobs.num_threads() - 1;
+
+  const struct {
+    const char *name;
+    mesh_type type;
+    uint32_t res[4]; // 0 ends the list
+  } cases[] = {
+      {"grid", GRID, {256, 1024, 2048, 4096}},
+      {"sphere", SPHERE, {64, 256, 1024, 2048}},
+      {"icosphere", ICOSPHERE, {3, 5, 7, 9}}, // subdivision levels
+      {"torus", TORUS, {64, 256, 1024, 2048}},
+      {"capsule", CAPSULE, {64, 256, 1024, 2048}},
+      {"cube", CUBE, {1, 0}}, // fixed resolution
+  };
+
+  printf("%9s %6s %10s %12s %12s %12s %9s %10s\n", "mesh", "res",
+         "vertices", "fresh [ms]", "1 thr [ms]", "all [ms]", "speedup",
+         "Mvtx/s");
+
+  for (const auto &c : cases) {
+    for (uint32_t r = 0; r < 4 && c.res[r]; ++r) {
+      const uint32_t res = c.res[r];
+      mesh_create_info_t mci = {c.type, 1.0f, 1.0f, 1.0f, 0, 0};
+      if (c.type == GRID)
+        mci.sz_param0 = mci.sz_param1 = (float)res;
+      else if (c.type == SPHERE)
+        mci.sz_param0 = 2.0f, mci.sz_param1 = mci.sz_param2 = (float)res;
+      else if (c.type == ICOSPHERE)
+        mci.sz_param0 = 2.0f, mci.sz_param1 = (float)res;
+      else if (c.type != CUBE)
+        mci.sz_param1 = 0.25f, mci.res_u = mci.res_v = res;
+
+      const size_t vtx = mesh_data_size(&mci).vtx;
+      const int iters = iters_for((uint32_t)vtx, 1 << 24);
+
+      mesh_t reused;
+      double fresh_ms = time_ms(iters, [&](void) {
+        mesh_t m;
+        generate_mesh_data(&mci, &m);
+      });
+
+      // give it the storage first, so that neither column pays for it
+      generate_mesh_data(&mci, &reused);
+
+      jobs.teardown();
+      jobs.init(0); // no workers: the caller alone
+      double single_ms =
+          time_ms(iters, [&](void) { generate_mesh_data(&mci, &reused); });
+
+      jobs.teardown();
+      jobs.init(job_system_t::auto_workers);
+      double all_ms =
+          time_ms(iters, [&](void) { generate_mesh_data(&mci, &reused); });
+
+      printf("%9s %6u %10zu %12.4f %12.4f %12.4f %8.2fx %10.1f\n", c.name,
+             res, vtx, fresh_ms, single_ms, all_ms, single_ms / all_ms,
+             vtx / all_ms / 1000.0);
+    }
+  }
+
+  jobs.teardown();
+  jobs.init(restore);
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	vertex cache optimisation
+//--------------------------------------------------------------------
+
+// Simulated vertex cache behaviour of each generator's own triangle order
+// against the Tipsify order (with overdraw-sorted clusters), and the cost
+// of the optimisation passes.
+static bool bench_meshopt(void) {
+  const struct {
+    const char *name;
+    mesh_create_info_t mci;
+  } cases[] = {
+      {"grid 256", {GRID, 256.0f, 256.0f, 0.0f, 0, 0}},
+      {"grid 1024", {GRID, 1024.0f, 1024.0f, 0.0f, 0, 0}},
+      {"sphere 32", {SPHERE, 2.0f, 32.0f, 16.0f, 0, 0}},
+      {"sphere 512", {SPHERE, 2.0f, 512.0f, 256.0f, 0, 0}},
+      {"icosphere 5", {ICOSPHERE, 2.0f, 5.0f, 0.0f, 0, 0}},
+      {"icosphere 7", {ICOSPHERE, 2.0f, 7.0f, 0.0f, 0, 0}},
+      {"torus 256", {TORUS, 1.0f, 0.25f, 0.0f, 256, 256}},
+      {"cylinder 64", {CYLINDER, 1.0f, 2.0f, 0.0f, 64, 8}},
+  };
+
+  printf("FIFO cache of %u vertices\n", vertex_cache_size);
+  printf("%12s %10s %16s %16s %8s %12s %12s\n", "mesh", "triangles",
+         "ACMR", "ATVR", "kept", "cache [ms]", "fetch [ms]");
+
+  for (const auto &c : cases) {
+    mesh_t m;
+    generate_mesh_data(&c.mci, &m);
+    const vertex_cache_stats_t before = analyze_vertex_cache(&m);
+
+    bool reordered = false;
+    const double cache_ms =
+        time_ms(1, [&](void) { reordered = optimize_vertex_cache(&m); });
+    const double fetch_ms = time_ms(1, [&](void) { optimize_vertex_fetch(&m); });
+    const vertex_cache_stats_t after = analyze_vertex_cache(&m);
+
+    printf("%12s %10zu %7.3f -> %5.3f %7.3f -> %5.3f %8s %12.3f %12.3f\n",
+           c.name, m.idx_data.size() / 3, before.acmr, after.acmr, before.atvr,
+           after.atvr, reordered ? "tipsify" : "input", cache_ms, fetch_ms);
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	mesh import
+//--------------------------------------------------------------------
+
+// write "m" as OBJ, with texture coordinates and normals when "full"
+static void write_obj(const char *path, const mesh_t &m, bool full) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "ERROR: failed to write %s\n", path);
+    exit(1);
+  }
+  for (const glm::vec3 &v : m.vtx_data)
+    fprintf(f, "v %.6f %.6f %.6f\n", v.x, v.y, v.z);
+  if (full) {
+    for (const glm::vec2 &t : m.txcrd_data)
+      fprintf(f, "vt %.6f %.6f\n", t.x, t.y);
+    for (const glm::vec3 &n : m.norm_data)
+      fprintf(f, "vn %.6f %.6f %.6f\n", n.x, n.y, n.z);
+  }
+  for (size_t i = 0; i < m.idx_data.size(); i += 3) {
+    const uint32_t a = m.idx_data[i] + 1, b = m.idx_data[i + 1] + 1,
+                   c = m.idx_data[i + 2] + 1;
+    if (full)
+      fprintf(f, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c,
+              c);
+    else
+      fprintf(f, "f %u %u %u\n", a, b, c);
+  }
+  fclose(f);
+}
+
+// write "m" as little-endian binary PLY with normals
+static void write_ply(const char *path, const mesh_t &m) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "ERROR: failed to write %s\n", path);
+    exit(1);
+  }
+  fprintf(f,
+          "ply\nformat binary_little_endian 1.0\nelement vertex %zu\n"
+          "property float x\nproperty float y\nproperty float z\n"
+          "property float nx\nproperty float ny\nproperty float nz\n"
+          "element face %zu\nproperty list uchar int vertex_indices\n"
+          "end_header\n",
+          m.vtx_data.size(), m.idx_data.size() / 3);
+  for (size_t i = 0; i < m.vtx_data.size(); i++) {
+    fwrite(&m.vtx_data[i], sizeof(glm::vec3), 1, f);
+    fwrite(&m.norm_data[i], sizeof(glm::vec3), 1, f);
+  }
+  const uint8_t three = 3;
+  for (size_t i = 0; i < m.idx_data.size(); i += 3) {
+    fwrite(&three, 1, 1, f);
+    fwrite(&m.idx_data[i], sizeof(uint32_t), 3, f);
+  }
+  fclose(f);
+}
+
+// the usual first OBJ reader: line by line through iostreams, with a map
+// from corner to vertex
+static void naive_import_obj(const char *path, mesh_t *m) {
+  std::ifstream in(path);
+  std::vector<glm::vec3> pos, nrm;
+  std::vector<glm::vec2> txcrd;
+  std::map<std::tuple<int, int, int>, uint32_t> vertices;
+  *m = mesh_t();
+
+  std::string line, tag, corner;
+  while (std::getline(in, line)) {
+    std::istringstream ss(line);
+    ss >> tag;
+    if (tag == "v") {
+      glm::vec3 v;
+      ss >> v.x >> v.y >> v.z;
+      pos.push_back(v);
+    } else if (tag == "vt") {
+      glm::vec2 t;
+      ss >> t.x >> t.y;
+      txcrd.push_back(t);
+    } else if (tag == "vn") {
+      glm::vec3 n;
+      ss >> n.x >> n.y >> n.z;
+      nrm.push_back(n);
+    } else if (tag == "f") {
+      std::vector<uint32_t> face;
+      while (ss >> corner) {
+        int v = 0, t = 0, n = 0;
+        if (sscanf(corner.c_str(), "%d/%d/%d", &v, &t, &n) != 3)
+          sscanf(corner.c_str(), "%d", &v);
+        auto it = vertices.find(std::make_tuple(v, t, n));
+        if (it == vertices.end()) {
+          it = vertices.insert({std::make_tuple(v, t, n),
+                                (uint32_t)m->vtx_data.size()}).first;
+          m->vtx_data.push_back(pos[v - 1]);
+          if (t)
+            m->txcrd_data.push_back(txcrd[t - 1]);
+          if (n)
+            m->norm_data.push_back(nrm[n - 1]);
+        }
+        face.push_back(it->second);
+      }
+      for (size_t k = 2; k < face.size(); k++) {
+        m->idx_data.push_back(face[0]);
+        m->idx_data.push_back(face[k - 1]);
+        m->idx_data.push_back(face[k]);
+      }
+    }
+  }
+}
+
+// "name" in the temporary directory, so that benchmarks leave nothing
+// behind in the current one
+static std::string temp_path(const char *name) {
+#ifdef _WIN32
+  const char *dir = getenv("TEMP");
+  const char sep = '\\';
+#else
+  const char *dir = getenv("TMPDIR");
+  const char sep = '/';
+#endif
+  if (!dir || !*dir)
+    dir = "/tmp";
+  return std::string(dir) + sep + name;
+}
+
+// Import throughput of icospheres written as OBJ (positions only, which
+// needs no vertex deduplication, and with texture coordinates and normals,
+// which does) and as binary PLY: an iostream reader against the importer
+// on one thread and on all of them. "vs naive" compares the two readers
+// on one thread.
+static bool bench_import(void) {
+  const uint32_t restore = jobs.num_threads() - 1;
+  const std::string obj = temp_path("bench-import.obj"),
+                    ply = temp_path("bench-import.ply");
+  const char *path[] = {obj.c_str(), ply.c_str()};
+
+  printf("%9s %6s %10s %9s %12s %12s %12s %9s %9s\n", "file", "level",
+         "triangles", "MB", "naive [ms]", "1 thr [ms]", "all [ms]",
+         "vs naive", "MB/s");
+
+  for (uint32_t level = 6; level <= 8; level++) {
+    const mesh_create_info_t mci = {ICOSPHERE, 2.0f, (float)level, 0.0f, 0,
+                                    0};
+    mesh_t src;
+    generate_mesh_data(&mci, &src);
+
+    for (uint32_t format = 0; format < 3; format++) {
+      const char *file = path[format == 2];
+      if (format < 2)
+        write_obj(file, src, format == 1);
+      else
+        write_ply(file, src);
+
+      FILE *f = fopen(file, "rb");
+      fseek(f, 0, SEEK_END);
+      const double mb = ftell(f) / (1024.0 * 1024.0);
+      fclose(f);
+
+      mesh_t naive, m;
+      double naive_ms = 0.0;
+      if (format < 2)
+        naive_ms = time_ms(1, [&](void) { naive_import_obj(file, &naive); });
+
+      // once untimed, so that neither column pays for the storage
+      import_mesh(file, &m);
+
+      jobs.teardown();
+      jobs.init(0); // no workers: the caller alone
+      const double single_ms = time_ms(1, [&](void) { import_mesh(file, &m); });
+
+      jobs.teardown();
+      jobs.init(job_system_t::auto_workers);
+      const double all_ms = time_ms(1, [&](void) { import_mesh(file, &m); });
+
+      if (m.idx_data.size() != src.idx_data.size() ||
+          (format < 2 && m.vtx_data.size() != naive.vtx_data.size()))
+        fprintf(stderr, "WARNING: %s imported with %zu vertices, %zu "
+                        "triangles\n",
+                file, m.vtx_data.size(), m.idx_data.size() / 3);
+
+      const char *names[] = {"obj v", "obj v/t/n", "ply"};
+      if (format < 2)
+        printf("%9s %6u %10zu %9.1f %12.1f %12.1f %12.1f %8.1fx %9.0f\n",
+               names[format], level, src.idx_data.size() / 3, mb, naive_ms,
+               single_ms, all_ms, naive_ms / single_ms, mb / all_ms * 1000.0);
+      else
+        printf("%9s %6u %10zu %9.1f %12s %12.1f %12.1f %9s %9.0f\n",
+               names[format], level, src.idx_data.size() / 3, mb, "-",
+               single_ms, all_ms, "-", mb / all_ms * 1000.0);
+    }
+  }
+
+  remove(path[0]);
+  remove(path[1]);
+  jobs.teardown();
+  jobs.init(restore);
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	frustum culling: every object vs. the bounding-volume hierarchy
+//--------------------------------------------------------------------
+
+// A world far wider than the view, with the camera at its centre: the
+// sphere test of every object against the time to refit (after every
+// object has moved a little) or rebuild the hierarchy and walk it.
+// "verified" compares the visible set with the exhaustive test's.
+static bool bench_cull(void) {
+  const uint32_t counts[] = {10000, 100000, 1000000};
+  const float radius[ENTITY_TYPE_COUNT] = {sphere_radius,
+                                           cube_half_size * 1.7320508f};
+
+  frustum_t frustum;
+  frustum.extract(glm::perspective(glm::radians(60.0f), 1.5f, 1.0f, 500.0f) *
+                  glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f),
+                              glm::vec3(1.0f, 2.0f, -1.0f),
+                              glm::vec3(0.0f, 1.0f, 0.0f)));
+
+  printf("host supports: %s\n", simd_name(simd_detect()));
+  printf("%9s %10s %8s %12s %12s %12s %9s\n", "objects", "method",
+         "visible", "update [ms]", "cull [ms]", "speedup", "verified");
+
+  for (uint32_t count : counts) {
+    // keep the density constant across counts: a 10 unit square per object
+    const float half_width = 0.5f * std::sqrt(count * 10.0f);
+
+    std::mt19937 rng(count);
+    std::uniform_real_distribution<float> coord(-half_width, half_width);
+    std::uniform_real_distribution<float> height(0.0f, 20.0f);
+    std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+
+    std::vector<glm::vec3> pos[ENTITY_TYPE_COUNT];
+    for (uint32_t i = 0; i < count; ++i)
+      pos[i % 4 ? ENTITY_SPHERE : ENTITY_CUBE].push_back(
+          glm::vec3(coord(rng), height(rng), coord(rng)));
+
+    std::vector<glm::vec3> moved[ENTITY_TYPE_COUNT];
+    for (int t = 0; t < ENTITY_TYPE_COUNT; ++t)
+      for (const glm::vec3 &p : pos[t])
+        moved[t].push_back(p + glm::vec3(jitter(rng), jitter(rng),
+                                         jitter(rng)));
+
+    const int iters = iters_for(count, 20000000);
+
+    std::vector<uint32_t> expected[ENTITY_TYPE_COUNT];
+    const double brute_ms = time_ms(iters, [&](void) {
+      for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+        expected[t].clear();
+        for (uint32_t i = 0; i < (uint32_t)moved[t].size(); ++i)
+          if (frustum.test_sphere(moved[t][i], radius[t]))
+            expected[t].push_back(i);
+      }
+    });
+    size_t visible = 0;
+    for (int t = 0; t < ENTITY_TYPE_COUNT; ++t)
+      visible += expected[t].size();
+    printf("%9u %10s %8zu %12s %12.4f %12s %9s\n", count, "all", visible,
+           "-", brute_ms, "-", "-");
+
+    for (int l = 0; l <= glm::min((int)simd_detect(), (int)SIMD_SSE); ++l) {
+      const simd_level_t level = (simd_level_t)l;
+      for (int rebuild = 0; rebuild < 2; ++rebuild) {
+        bvh_t bvh;
+        cull_stats_t stats;
+        bvh.update(pos, radius, &stats);
+        // a ratio of 0 makes every update rebuild
+        bvh.rebuild_ratio = rebuild ? 0.0f : 1000.0f;
+
+        std::vector<uint32_t> found[ENTITY_TYPE_COUNT];
+        const double update_ms = time_ms(iters, [&](void) {
+          bvh.update(rebuild ? pos : moved, radius, &stats);
+          bvh.update(moved, radius, &stats);
+        }) / 2;
+        const double cull_ms = time_ms(iters, [&](void) {
+          bvh.cull_with(level, frustum, found, &stats);
+        });
+
+        bool same = true;
+        for (int t = 0; t < ENTITY_TYPE_COUNT; ++t)
+          same = same && found[t] == expected[t];
+
+        char method[32];
+        snprintf(method, sizeof(method), "%s %s", rebuild ? "build" : "refit",
+                 simd_name(level));
+        printf("%9u %10s %8u %12.4f %12.4f %11.2fx %9s\n", count, method,
+               stats.visible, update_ms, cull_ms,
+               brute_ms / (update_ms + cull_ms), same ? "yes" : "NO");
+      }
+    }
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	registry
+//--------------------------------------------------------------------
+
+struct bench_t {
+  const char *name;
+  const char *desc;
+  bool (*fn)(void); // false if a result failed its check
+};
+
+static const bench_t benchmarks[] = {
+    {"scene", "entity update: polymorphic objects vs. SoA scene store",
+     bench_scene_layout},
+    {"integrator", "sphere integration: scalar vs. SSE vs. AVX2",
+     bench_integrator},
+    {"broadphase", "collision broad phase: hash grid vs. sweep-and-prune",
+     bench_broadphase},
+    {"threads", "physics step vs. job system thread count (determinism)",
+     bench_physics_threads},
+    {"sim", "frame-thread cost: inline simulation vs. simulation thread",
+     bench_sim_thread},
+    {"meshgen", "procedural mesh generation vs. resolution and threads",
+     bench_meshgen},
+    {"meshopt", "vertex cache order: generated vs. Tipsify (ACMR/ATVR)",
+     bench_meshopt},
+    {"import", "OBJ/PLY import: iostream reader vs. mapped parallel parser",
+     bench_import},
+    {"cull", "frustum culling: test every object vs. BVH refit/rebuild",
+     bench_cull},
+};
+
+static const uint32_t num_benchmarks = sizeof(benchmarks) / sizeof(bench_t);
+
+bool bench_run(const char *name, bool *passed) {
+  *passed = true;
+  if (!strcmp(name, "list")) {
+    for (uint32_t i = 0; i < num_benchmarks; ++i)
+      printf("%-12s %s\n", benchmarks[i].name, benchmarks[i].desc);
+    return true;
+  }
+
+  for (uint32_t i = 0; i < num_benchmarks; ++i) {
+    if (!strcmp(name, benchmarks[i].name)) {
+      cprintf(L"$c*`begin$? benchmark %s\n", name);
+      *passed = benchmarks[i].fn();
+      if (*passed)
+        cprintf(L"benchmark %s $g*done$?`!\n", name);
+      else
+        cprintf(L"benchmark %s $r*failed$? its checks\n", name);
+      return true;
+    }
+  }
+
+  return false;
+}
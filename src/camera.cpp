@@ -34,6 +34,14 @@ void camera_t::apply(float dt) {
   }
 }
 
+void camera_t::follow_path(float t, float radius) {
+  const float r = radius * (1.0f + 0.5f * sinf(0.31f * t));
+  const float height = 5.0f + 3.0f * sinf(0.23f * t);
+  this->pos = target + glm::vec3(r * cosf(0.5f * t), height,
+                                 r * sinf(0.5f * t));
+  this->matrix = glm::lookAt(pos, target, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
 void camera_t::orient(float dt) {
   static const glm::vec2 centre(window_width / 2, window_height / 2);
   static double xpos = 0, ypos = 0;
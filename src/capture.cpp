@@ -0,0 +1,249 @@
+#include "capture.h"
+
+#include <cprintf/cprintf.hpp>
+#include <cstring>
+
+// pixel buffers in flight, and frames queued for the writer
+static const uint32_t readback_depth = 3;
+static const uint32_t writer_depth = 4;
+
+bool capture_t::init(const char *path, int width, int height, int fps,
+                     bool lossless) {
+  assert(!active() && "Capture is already running!");
+
+  piped = path[0] == '|';
+  if (piped)
+    out = popen(path + 1, "w");
+  else
+    out = fopen(path, "wb");
+  if (!out) {
+    fprintf(stderr, "ERROR: failed to open capture output: %s\n", path);
+    return false;
+  }
+
+  const size_t len = strlen(path);
+  format = (len > 4 && !strcmp(path + len - 4, ".ppm")) ? CAPTURE_PPM
+                                                        : CAPTURE_Y4M;
+  this->width = width;
+  this->height = height;
+  this->lossless = lossless;
+
+  if (format == CAPTURE_Y4M)
+    fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height,
+            fps);
+
+  sink = [this](const uint8_t *rgba, uint64_t frame,
+                tsamplr_t::storage_t issued) { enqueue(rgba, frame, issued); };
+
+  frames.resize(writer_depth);
+  idle.clear();
+  ready.clear();
+  for (uint32_t i = 0; i < writer_depth; ++i) {
+    frames[i].rgba.resize((size_t)width * height * 4);
+    idle.push_back(i);
+  }
+
+  memset(&stats_, 0, sizeof(stats_));
+  stopping = false;
+  writer = std::thread(&capture_t::writer_main, this);
+
+  cprintf(L"capturing %dx%d %s to $c*%s$?\n", width, height,
+          format == CAPTURE_PPM ? "ppm" : "y4m", path);
+  return true;
+}
+
+void capture_t::teardown(void) {
+  if (!active())
+    return;
+
+  while (readback.pending())
+    readback.collect(sink, true);
+  readback.teardown();
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  frame_ready.notify_one();
+  writer.join();
+
+  if (piped)
+    pclose(out);
+  else
+    fclose(out);
+  out = NULL;
+
+  const capture_stats_t s = stats();
+  cprintf(L"capture: $c*%llu$? frames written, dropped %llu (readback) + "
+          L"%llu (writer), latency avg %.3f ms, max %.3f ms\n",
+          (unsigned long long)s.written,
+          (unsigned long long)s.dropped_readback,
+          (unsigned long long)s.dropped_writer,
+          s.written ? s.latency_sum_ms / s.written : 0.0, s.latency_max_ms);
+
+  frames.clear();
+}
+
+void capture_t::grab(uint64_t frame) {
+  // only made once needed, as callers of submit() never need it
+  if (!readback.depth())
+    readback.init(width, height, readback_depth);
+  if (readback.full())
+    readback.collect(sink, lossless);
+
+  if (readback.full()) {
+    std::lock_guard<std::mutex> guard(lock);
+    stats_.dropped_readback++;
+    return;
+  }
+
+  readback.read(frame);
+
+  std::lock_guard<std::mutex> guard(lock);
+  stats_.captured++;
+}
+
+void capture_t::poll(void) { readback.collect(sink, false); }
+
+void capture_t::submit(const uint8_t *rgba, uint64_t frame,
+                       tsamplr_t::storage_t issued) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stats_.captured++;
+  }
+  enqueue(rgba, frame, issued);
+}
+
+capture_stats_t capture_t::stats(void) {
+  std::lock_guard<std::mutex> guard(lock);
+  return stats_;
+}
+
+void capture_t::enqueue(const uint8_t *rgba, uint64_t frame,
+                        tsamplr_t::storage_t issued) {
+  uint32_t i;
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    if (idle.empty()) {
+      if (!lossless) {
+        stats_.dropped_writer++;
+        return;
+      }
+      frame_idle.wait(guard, [this](void) { return !idle.empty(); });
+    }
+    i = idle.back();
+    idle.pop_back();
+  }
+
+  frame_t &f = frames[i];
+  memcpy(f.rgba.data(), rgba, f.rgba.size());
+  f.frame = frame;
+  f.issued = issued;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    ready.push_back(i);
+  }
+  frame_ready.notify_one();
+}
+
+void capture_t::writer_main(void) {
+  while (true) {
+    uint32_t i;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      frame_ready.wait(guard,
+                       [this](void) { return stopping || !ready.empty(); });
+      if (ready.empty())
+        break; // stopping, with everything written
+      i = ready.front();
+      ready.pop_front();
+    }
+
+    write_frame(frames[i]);
+    const double ms =
+        tsamplr_t::convert(tsamplr_t::now() - frames[i].issued,
+                           tsamplr_t::_ms_);
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      idle.push_back(i);
+      stats_.written++;
+      stats_.latency_sum_ms += ms;
+      stats_.latency_max_ms = glm::max(stats_.latency_max_ms, ms);
+    }
+    frame_idle.notify_one();
+  }
+}
+
+// BT.601 full range ("jpeg") conversion in 8.8 fixed point
+static inline uint8_t rgb_to_y(int r, int g, int b) {
+  return (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+static inline uint8_t rgb_to_u(int r, int g, int b) {
+  return (uint8_t)glm::clamp((-43 * r - 85 * g + 128 * b + 128) / 256 + 128,
+                             0, 255);
+}
+
+static inline uint8_t rgb_to_v(int r, int g, int b) {
+  return (uint8_t)glm::clamp((128 * r - 107 * g - 21 * b + 128) / 256 + 128,
+                             0, 255);
+}
+
+void capture_t::write_frame(const frame_t &f) {
+  const uint32_t stride = width * 4;
+  // GL rows run bottom to top
+  auto pixel = [&](int x, int y) -> const uint8_t * {
+    return f.rgba.data() + (height - 1 - y) * stride + x * 4;
+  };
+
+  if (format == CAPTURE_PPM) {
+    scratch.resize(width * height * 3);
+    uint8_t *dst = scratch.data();
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        const uint8_t *p = pixel(x, y);
+        *dst++ = p[0];
+        *dst++ = p[1];
+        *dst++ = p[2];
+      }
+    }
+
+    fprintf(out, "P6\n%d %d\n255\n", width, height);
+    fwrite(scratch.data(), 1, scratch.size(), out);
+    return;
+  }
+
+  // 4:2:0, averaging each 2x2 block (clamped at odd edges) for chroma
+  const int cw = (width + 1) / 2, ch = (height + 1) / 2;
+  scratch.resize(width * height + 2 * cw * ch);
+  uint8_t *y_plane = scratch.data();
+  uint8_t *u_plane = y_plane + width * height;
+  uint8_t *v_plane = u_plane + cw * ch;
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const uint8_t *p = pixel(x, y);
+      y_plane[y * width + x] = rgb_to_y(p[0], p[1], p[2]);
+    }
+  }
+
+  for (int cy = 0; cy < ch; ++cy) {
+    for (int cx = 0; cx < cw; ++cx) {
+      const int x0 = 2 * cx, y0 = 2 * cy;
+      const int x1 = glm::min(x0 + 1, width - 1);
+      const int y1 = glm::min(y0 + 1, height - 1);
+      const uint8_t *q[4] = {pixel(x0, y0), pixel(x1, y0), pixel(x0, y1),
+                             pixel(x1, y1)};
+      const int r = (q[0][0] + q[1][0] + q[2][0] + q[3][0] + 2) / 4;
+      const int g = (q[0][1] + q[1][1] + q[2][1] + q[3][1] + 2) / 4;
+      const int b = (q[0][2] + q[1][2] + q[2][2] + q[3][2] + 2) / 4;
+      u_plane[cy * cw + cx] = rgb_to_u(r, g, b);
+      v_plane[cy * cw + cx] = rgb_to_v(r, g, b);
+    }
+  }
+
+  fputs("FRAME\n", out);
+  fwrite(scratch.data(), 1, scratch.size(), out);
+}
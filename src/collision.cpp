@@ -0,0 +1,365 @@
+#include "collision.h"
+#include "sphere.h"
+#include "cube.h"
+#include "jobs.h"
+
+#include <algorithm>
+
+void collider_set_t::add(glm::vec3 c, glm::vec3 e, shape_t s, entity_t ent) {
+  centre.push_back(c);
+  extent.push_back(e);
+  shape.push_back((uint8_t)s);
+  entity.push_back(ent);
+}
+
+void collider_set_t::clear(void) {
+  centre.clear();
+  extent.clear();
+  shape.clear();
+  entity.clear();
+}
+
+void collider_set_t::gather(const scene_t &scene) {
+  clear();
+
+  const entity_block_t &spheres = scene[ENTITY_SPHERE];
+  const entity_block_t &cubes = scene[ENTITY_CUBE];
+
+  const uint32_t count = spheres.size() + cubes.size();
+  centre.reserve(count);
+  extent.reserve(count);
+  shape.reserve(count);
+  entity.reserve(count);
+
+  for (uint32_t i = 0; i < spheres.size(); ++i) {
+    entity_t ent = {ENTITY_SPHERE, i};
+    add(spheres.get_pos(i), glm::vec3(sphere_radius), SHAPE_SPHERE, ent);
+  }
+
+  for (uint32_t i = 0; i < cubes.size(); ++i) {
+    entity_t ent = {ENTITY_CUBE, i};
+    add(cubes.get_pos(i), glm::vec3(cube_half_size), SHAPE_BOX, ent);
+  }
+}
+
+//--------------------------------------------------------------------
+//	broad phase
+//--------------------------------------------------------------------
+
+static inline bool overlap(const glm::vec3 &min_a, const glm::vec3 &max_a,
+                           const glm::vec3 &min_b, const glm::vec3 &max_b) {
+  return (min_a.x <= max_b.x && min_b.x <= max_a.x) &&
+         (min_a.y <= max_b.y && min_b.y <= max_a.y) &&
+         (min_a.z <= max_b.z && min_b.z <= max_a.z);
+}
+
+static inline uint32_t hash_cell(const glm::ivec3 &c, uint32_t mask) {
+  return (((uint32_t)c.x * 73856093U) ^ ((uint32_t)c.y * 19349663U) ^
+          ((uint32_t)c.z * 83492791U)) &
+         mask;
+}
+
+void broadphase_t::build(const collider_set_t &set) {
+  const uint32_t n = set.size();
+
+  aabb_min.resize(n);
+  aabb_max.resize(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    aabb_min[i] = set.centre[i] - set.extent[i];
+    aabb_max[i] = set.centre[i] + set.extent[i];
+  }
+
+  if (mode == BROADPHASE_GRID)
+    build_grid(set);
+  else
+    build_sap(set);
+}
+
+void broadphase_t::find_pairs(const collider_set_t &set,
+                              std::vector<body_pair_t> *out) const {
+  assert(set.size() == aabb_min.size() && "Broad phase is out of date!");
+
+  jobs.parallel_gather(
+      set.size(), 1024, out,
+      [this](uint32_t begin, uint32_t end, std::vector<body_pair_t> *o) {
+        if (mode == BROADPHASE_GRID)
+          find_pairs_grid(begin, end, o);
+        else
+          find_pairs_sap(begin, end, o);
+      });
+}
+
+void broadphase_t::build_grid(const collider_set_t &set) {
+  const uint32_t n = set.size();
+
+  // cells at least as wide as the largest collider, so that overlapping
+  // colliders are never more than one cell apart
+  float max_extent = 0.0f;
+  for (uint32_t i = 0; i < n; ++i)
+    max_extent = glm::max(max_extent,
+                          glm::max(set.extent[i].x,
+                                   glm::max(set.extent[i].y, set.extent[i].z)));
+  cell_size = glm::max(2.0f * max_extent, 1e-3f);
+
+  uint32_t buckets = 64;
+  while (buckets < 2 * n)
+    buckets <<= 1;
+  bucket_mask = buckets - 1;
+
+  const float inv_cell = 1.0f / cell_size;
+  cell.resize(n);
+  bucket_start.assign(buckets + 1, 0);
+
+  // counting sort of the colliders by bucket
+  for (uint32_t i = 0; i < n; ++i) {
+    const glm::vec3 &c = set.centre[i];
+    cell[i] = glm::ivec3((int)std::floor(c.x * inv_cell),
+                         (int)std::floor(c.y * inv_cell),
+                         (int)std::floor(c.z * inv_cell));
+    bucket_start[hash_cell(cell[i], bucket_mask) + 1]++;
+  }
+
+  for (uint32_t b = 0; b < buckets; ++b)
+    bucket_start[b + 1] += bucket_start[b];
+
+  // bounds and cells are copied into bucket order too, so that scanning a
+  // bucket reads contiguous memory
+  std::vector<uint32_t> fill(bucket_start.begin(), bucket_start.end() - 1);
+  cell_bodies.resize(n);
+  sorted_cell.resize(n);
+  sorted_min.resize(n);
+  sorted_max.resize(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    const uint32_t s = fill[hash_cell(cell[i], bucket_mask)]++;
+    cell_bodies[s] = i;
+    sorted_cell[s] = cell[i];
+    sorted_min[s] = aabb_min[i];
+    sorted_max[s] = aabb_max[i];
+  }
+}
+
+// queries of the colliders in bucket slots [begin, end)
+void broadphase_t::find_pairs_grid(uint32_t begin, uint32_t end,
+                                   std::vector<body_pair_t> *out) const {
+  // a pair of colliders in neighbouring cells is found from exactly one of
+  // them when only the 13 "forward" neighbours (and one's own cell) are
+  // searched
+  static const int fwd[14][3] = {
+      {0, 0, 0},   {1, 0, 0},  {-1, 1, 0}, {0, 1, 0},  {1, 1, 0},
+      {-1, -1, 1}, {0, -1, 1}, {1, -1, 1}, {-1, 0, 1}, {0, 0, 1},
+      {1, 0, 1},   {-1, 1, 1}, {0, 1, 1},  {1, 1, 1}};
+
+  // visit the colliders in bucket order, so that neighbouring queries touch
+  // the same buckets
+  for (uint32_t si = begin; si < end; ++si) {
+    const uint32_t i = cell_bodies[si];
+    const glm::ivec3 ci = sorted_cell[si];
+    const glm::vec3 min_i = sorted_min[si], max_i = sorted_max[si];
+
+    for (uint32_t k = 0; k < 14; ++k) {
+      const glm::ivec3 c(ci.x + fwd[k][0], ci.y + fwd[k][1],
+                         ci.z + fwd[k][2]);
+      const uint32_t b = hash_cell(c, bucket_mask);
+
+      for (uint32_t s = bucket_start[b]; s < bucket_start[b + 1]; ++s) {
+        // distinct cells may share a bucket: only take j from the cell it
+        // actually lies in. Within one's own cell, each pair is taken once.
+        if (!(sorted_cell[s] == c) || (k == 0 && s <= si))
+          continue;
+
+        if (overlap(min_i, max_i, sorted_min[s], sorted_max[s])) {
+          const uint32_t j = cell_bodies[s];
+          body_pair_t p = {glm::min(i, j), glm::max(i, j)};
+          out->push_back(p);
+        }
+      }
+    }
+  }
+}
+
+void broadphase_t::build_sap(const collider_set_t &set) {
+  const uint32_t n = set.size();
+
+  // sweep along the axis on which the colliders are most spread out
+  glm::vec3 mean(0.0f), mean_sq(0.0f);
+  for (uint32_t i = 0; i < n; ++i) {
+    mean += set.centre[i];
+    mean_sq += set.centre[i] * set.centre[i];
+  }
+  const float inv_n = n ? 1.0f / n : 0.0f;
+  glm::vec3 variance = mean_sq * inv_n - (mean * inv_n) * (mean * inv_n);
+
+  int axis = 0;
+  if (variance.y > variance[axis])
+    axis = 1;
+  if (variance.z > variance[axis])
+    axis = 2;
+
+  const std::vector<glm::vec3> &lo = aabb_min;
+  auto less = [&](uint32_t a, uint32_t b) { return lo[a][axis] < lo[b][axis]; };
+
+  if (axis != sap_axis || sap_order.size() != n) {
+    sap_axis = axis;
+    sap_order.resize(n);
+    for (uint32_t i = 0; i < n; ++i)
+      sap_order[i] = i;
+    std::sort(sap_order.begin(), sap_order.end(), less);
+  } else {
+    // the previous order is nearly sorted: insertion sort is ~linear
+    for (uint32_t i = 1; i < n; ++i) {
+      const uint32_t v = sap_order[i];
+      uint32_t j = i;
+      for (; j > 0 && less(v, sap_order[j - 1]); --j)
+        sap_order[j] = sap_order[j - 1];
+      sap_order[j] = v;
+    }
+  }
+}
+
+// sweeps from the colliders at sorted positions [begin, end)
+void broadphase_t::find_pairs_sap(uint32_t begin, uint32_t end,
+                                  std::vector<body_pair_t> *out) const {
+  const uint32_t n = (uint32_t)sap_order.size();
+  const int axis = sap_axis;
+
+  for (uint32_t s = begin; s < end; ++s) {
+    const uint32_t i = sap_order[s];
+    const float hi = aabb_max[i][axis];
+
+    for (uint32_t t = s + 1; t < n; ++t) {
+      const uint32_t j = sap_order[t];
+      if (aabb_min[j][axis] > hi)
+        break;
+
+      if (overlap(aabb_min[i], aabb_max[i], aabb_min[j], aabb_max[j])) {
+        body_pair_t p = {glm::min(i, j), glm::max(i, j)};
+        out->push_back(p);
+      }
+    }
+  }
+}
+
+//--------------------------------------------------------------------
+//	narrow phase
+//--------------------------------------------------------------------
+
+static bool sphere_sphere(const glm::vec3 &ca, float ra, const glm::vec3 &cb,
+                          float rb, contact_t *c) {
+  const glm::vec3 d = cb - ca;
+  const float dist_sq = glm::dot(d, d);
+  const float r = ra + rb;
+  if (dist_sq >= r * r)
+    return false;
+
+  const float dist = std::sqrt(dist_sq);
+  c->normal = dist > 1e-6f ? d / dist : glm::vec3(0.0f, 1.0f, 0.0f);
+  c->depth = r - dist;
+  return true;
+}
+
+// normal points from the box towards the sphere
+static bool sphere_box(const glm::vec3 &cs, float r, const glm::vec3 &cb,
+                       const glm::vec3 &half, contact_t *c) {
+  const glm::vec3 rel = cs - cb;
+  const glm::vec3 closest = glm::clamp(rel, -half, half);
+  const glm::vec3 d = rel - closest;
+  const float dist_sq = glm::dot(d, d);
+
+  if (dist_sq > 1e-12f) {
+    if (dist_sq >= r * r)
+      return false;
+    const float dist = std::sqrt(dist_sq);
+    c->normal = d / dist;
+    c->depth = r - dist;
+    return true;
+  }
+
+  // the sphere's centre is inside the box: leave by the nearest face
+  const glm::vec3 gap = half - glm::abs(rel);
+  int axis = 0;
+  if (gap.y < gap[axis])
+    axis = 1;
+  if (gap.z < gap[axis])
+    axis = 2;
+
+  c->normal = glm::vec3(0.0f);
+  c->normal[axis] = rel[axis] < 0.0f ? -1.0f : 1.0f;
+  c->depth = gap[axis] + r;
+  return true;
+}
+
+static void narrow_phase_range(const collider_set_t &set,
+                               const body_pair_t *pairs, uint32_t begin,
+                               uint32_t end, std::vector<contact_t> *out) {
+  for (uint32_t p = begin; p < end; ++p) {
+    uint32_t a = pairs[p].a, b = pairs[p].b;
+    contact_t c = {a, b, glm::vec3(0.0f), 0.0f};
+    bool hit = false;
+
+    const shape_t sa = (shape_t)set.shape[a], sb = (shape_t)set.shape[b];
+    if (sa == SHAPE_SPHERE && sb == SHAPE_SPHERE) {
+      hit = sphere_sphere(set.centre[a], set.extent[a].x, set.centre[b],
+                          set.extent[b].x, &c);
+    } else if (sa == SHAPE_SPHERE && sb == SHAPE_BOX) {
+      // box is "a" so that the normal points from a to b
+      hit = sphere_box(set.centre[a], set.extent[a].x, set.centre[b],
+                       set.extent[b], &c);
+      c.a = b;
+      c.b = a;
+    } else if (sa == SHAPE_BOX && sb == SHAPE_SPHERE) {
+      hit = sphere_box(set.centre[b], set.extent[b].x, set.centre[a],
+                       set.extent[a], &c);
+    }
+
+    if (hit)
+      out->push_back(c);
+  }
+}
+
+void narrow_phase(const collider_set_t &set, const body_pair_t *pairs,
+                  size_t count, std::vector<contact_t> *out) {
+  jobs.parallel_gather(
+      (uint32_t)count, 2048, out,
+      [&](uint32_t begin, uint32_t end, std::vector<contact_t> *o) {
+        narrow_phase_range(set, pairs, begin, end, o);
+      });
+}
+
+// applied in contact order, which keeps the result deterministic
+void resolve_contacts(scene_t *scene, const collider_set_t &set,
+                      const std::vector<contact_t> &contacts) {
+  auto push = [&](uint32_t collider, const glm::vec3 &offset,
+                  const glm::vec3 &n) {
+    const entity_t &e = set.entity[collider];
+    entity_block_t &blk = (*scene)[e.type];
+
+    blk.pos_x[e.idx] += offset.x;
+    blk.pos_y[e.idx] += offset.y;
+    blk.pos_z[e.idx] += offset.z;
+
+    // cancel velocity towards the other body
+    const glm::vec3 v = blk.get_vel(e.idx);
+    const float vn = glm::dot(v, n);
+    if (vn < 0.0f) {
+      blk.vel_x[e.idx] -= vn * n.x;
+      blk.vel_y[e.idx] -= vn * n.y;
+      blk.vel_z[e.idx] -= vn * n.z;
+    }
+
+    blk.model[e.idx][3] = glm::vec4(blk.get_pos(e.idx), 1.0f);
+  };
+
+  for (const contact_t &c : contacts) {
+    const bool a_moves = set.shape[c.a] == SHAPE_SPHERE;
+    const bool b_moves = set.shape[c.b] == SHAPE_SPHERE;
+
+    if (a_moves && b_moves) {
+      push(c.a, -c.normal * (0.5f * c.depth), -c.normal);
+      push(c.b, c.normal * (0.5f * c.depth), c.normal);
+    } else if (b_moves) {
+      push(c.b, c.normal * c.depth, c.normal);
+    } else if (a_moves) {
+      push(c.a, -c.normal * c.depth, -c.normal);
+    }
+  }
+}
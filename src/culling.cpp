@@ -0,0 +1,509 @@
+#include "culling.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+// the SSE tests are built for the baseline target, so they need SSE2 in
+// it: always on x86-64, on 32-bit x86 only with -msse2 or /arch:SSE2
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) ||             \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_X86 1
+#include <immintrin.h>
+#else
+#define CULLING_X86 0
+#endif
+
+const char *cull_mode_name(cull_mode_t mode) {
+  switch (mode) {
+  case CULL_NONE:
+    return "none";
+  case CULL_CPU:
+    return "cpu";
+  case CULL_GPU:
+    return "gpu";
+  default:
+    return "unknown";
+  }
+}
+
+static const uint32_t all_planes = (1u << frustum_t::PLANE_COUNT) - 1;
+
+void frustum_t::extract(const glm::mat4 &m) {
+  // Gribb and Hartmann: each clip-space bound -w <= x, y, z <= w is a
+  // plane made of the fourth row of the matrix plus or minus another row
+  glm::vec4 row[4];
+  for (int r = 0; r < 4; ++r)
+    row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+  planes[PLANE_LEFT] = row[3] + row[0];
+  planes[PLANE_RIGHT] = row[3] - row[0];
+  planes[PLANE_BOTTOM] = row[3] + row[1];
+  planes[PLANE_TOP] = row[3] - row[1];
+  planes[PLANE_NEAR] = row[3] + row[2];
+  planes[PLANE_FAR] = row[3] - row[2];
+
+  for (glm::vec4 &p : planes)
+    p = p / glm::length(glm::vec3(p));
+}
+
+// distance of a point from a plane, summed in the order the vector paths
+// use so that every path makes the same decisions
+static inline float plane_dist(const glm::vec4 &p, float x, float y,
+                               float z) {
+  return (p.x * x + p.y * y) + (p.z * z + p.w);
+}
+
+bool frustum_t::test_sphere(const glm::vec3 &c, float r) const {
+  for (const glm::vec4 &p : planes)
+    if (plane_dist(p, c.x, c.y, c.z) < -r)
+      return false;
+  return true;
+}
+
+void bvh_t::clear(void) {
+  nodes.clear();
+  items.clear();
+  sph_x.clear();
+  sph_y.clear();
+  sph_z.clear();
+  sph_r.clear();
+  for (uint32_t &c : counts)
+    c = 0;
+  built_cost = cost = 0.0f;
+}
+
+void bvh_t::update(const std::vector<glm::vec3> pos[ENTITY_TYPE_COUNT],
+                   const float radius[ENTITY_TYPE_COUNT],
+                   cull_stats_t *stats) {
+  tsamplr_t::storage_t start = tsamplr_t::now();
+
+  // entities were added or removed: the old tree means nothing
+  bool same = true;
+  uint32_t total = 0;
+  for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+    same = same && counts[t] == pos[t].size() && !nodes.empty();
+    total += (uint32_t)pos[t].size();
+  }
+
+  if (!same) {
+    items.clear();
+    items.reserve(total);
+    for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+      counts[t] = (uint32_t)pos[t].size();
+      for (uint32_t i = 0; i < counts[t]; ++i)
+        items.push_back({(entity_type_t)t, i});
+    }
+  }
+
+  bound(pos, radius);
+  if (same) {
+    cost = refit();
+    same = cost <= rebuild_ratio * built_cost;
+  }
+  if (!same)
+    build();
+
+  stats->objects = total;
+  stats->rebuilt = !same;
+  stats->update_ms =
+      tsamplr_t::convert(tsamplr_t::now() - start, tsamplr_t::_ms_);
+}
+
+void bvh_t::bound(const std::vector<glm::vec3> pos[ENTITY_TYPE_COUNT],
+                  const float radius[ENTITY_TYPE_COUNT]) {
+  // padded so that a leaf's spheres can always be loaded four at a time
+  const uint32_t n = (uint32_t)items.size();
+  sph_x.resize(n + 3);
+  sph_y.resize(n + 3);
+  sph_z.resize(n + 3);
+  sph_r.resize(n + 3);
+
+  jobs.parallel_for(n, 4096, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i) {
+      const glm::vec3 &p = pos[items[i].type][items[i].idx];
+      sph_x[i] = p.x;
+      sph_y[i] = p.y;
+      sph_z[i] = p.z;
+      sph_r[i] = radius[items[i].type];
+    }
+  });
+}
+
+void bvh_t::build(void) {
+  const uint32_t n = (uint32_t)items.size();
+  nodes.clear();
+  built_cost = cost = 0.0f;
+  if (!n)
+    return;
+
+  // build_node sorts "order"; the items follow once the tree is made
+  order.resize(n);
+  for (uint32_t i = 0; i < n; ++i)
+    order[i] = {{sph_x[i], sph_y[i], sph_z[i]}, i};
+  build_node(0, n, -1, 0);
+
+  std::vector<entity_t> old_items(items);
+  std::vector<float> old_r(sph_r);
+  for (uint32_t i = 0; i < n; ++i) {
+    const build_item_t &o = order[i];
+    items[i] = old_items[o.item];
+    sph_x[i] = o.centre[0];
+    sph_y[i] = o.centre[1];
+    sph_z[i] = o.centre[2];
+    sph_r[i] = old_r[o.item];
+  }
+
+  built_cost = cost = refit();
+}
+
+int32_t bvh_t::build_node(uint32_t first, uint32_t size, int32_t parent,
+                          uint32_t slot) {
+  const int32_t id = (int32_t)nodes.size();
+  node_t node;
+  memset((void *)&node, 0, sizeof(node));
+  for (int s = 0; s < 4; ++s)
+    node.child[s] = -1;
+  node.first = first;
+  node.size = size;
+  node.parent = parent;
+  node.slot = slot;
+  nodes.push_back(node);
+
+  // halve the largest part at the median of its centres along their
+  // widest axis, until there are four parts or all of them fit a leaf
+  uint32_t part_first[4] = {first}, part_size[4] = {size};
+  uint32_t parts = 1;
+  while (parts < 4) {
+    uint32_t widest = 0;
+    for (uint32_t p = 1; p < parts; ++p)
+      if (part_size[p] > part_size[widest])
+        widest = p;
+    if (part_size[widest] <= leaf_size)
+      break;
+
+    build_item_t *begin = order.data() + part_first[widest];
+    build_item_t *end = begin + part_size[widest];
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (build_item_t *i = begin; i < end; ++i) {
+      const glm::vec3 c(i->centre[0], i->centre[1], i->centre[2]);
+      lo = glm::min(lo, c);
+      hi = glm::max(hi, c);
+    }
+    const glm::vec3 extent = hi - lo;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z
+                         ? 0
+                         : (extent.y >= extent.z ? 1 : 2);
+
+    const uint32_t half = part_size[widest] / 2;
+    std::nth_element(begin, begin + half, end,
+                     [axis](const build_item_t &a, const build_item_t &b) {
+                       return a.centre[axis] < b.centre[axis];
+                     });
+
+    // the upper half goes right after the lower, keeping parts in order
+    for (uint32_t p = parts; p > widest + 1; --p) {
+      part_first[p] = part_first[p - 1];
+      part_size[p] = part_size[p - 1];
+    }
+    part_first[widest + 1] = part_first[widest] + half;
+    part_size[widest + 1] = part_size[widest] - half;
+    part_size[widest] = half;
+    ++parts;
+  }
+
+  for (uint32_t p = 0; p < parts; ++p) {
+    if (part_size[p] <= leaf_size) {
+      nodes[id].child[p] = (int32_t)part_first[p];
+      nodes[id].count[p] = part_size[p];
+    } else {
+      // "nodes" may move while the child is built
+      const int32_t child = build_node(part_first[p], part_size[p], id, p);
+      nodes[id].child[p] = child;
+    }
+  }
+  return id;
+}
+
+static inline float surface_area(float dx, float dy, float dz) {
+  return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+float bvh_t::refit(void) {
+  const uint32_t count = (uint32_t)nodes.size();
+
+  // the leaves are independent of each other
+  jobs.parallel_for(count, 256, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i) {
+      node_t &n = nodes[i];
+      for (int s = 0; s < 4; ++s) {
+        if (!n.count[s])
+          continue;
+        float lo_x = FLT_MAX, lo_y = FLT_MAX, lo_z = FLT_MAX;
+        float hi_x = -FLT_MAX, hi_y = -FLT_MAX, hi_z = -FLT_MAX;
+        const uint32_t e = n.child[s] + n.count[s];
+        for (uint32_t j = n.child[s]; j < e; ++j) {
+          lo_x = glm::min(lo_x, sph_x[j] - sph_r[j]);
+          lo_y = glm::min(lo_y, sph_y[j] - sph_r[j]);
+          lo_z = glm::min(lo_z, sph_z[j] - sph_r[j]);
+          hi_x = glm::max(hi_x, sph_x[j] + sph_r[j]);
+          hi_y = glm::max(hi_y, sph_y[j] + sph_r[j]);
+          hi_z = glm::max(hi_z, sph_z[j] + sph_r[j]);
+        }
+        n.min_x[s] = lo_x;
+        n.min_y[s] = lo_y;
+        n.min_z[s] = lo_z;
+        n.max_x[s] = hi_x;
+        n.max_y[s] = hi_y;
+        n.max_z[s] = hi_z;
+      }
+    }
+  });
+
+  // inner boxes from the bottom up: children come after their parents
+  float area = 0.0f;
+  for (uint32_t i = count; i-- > 0;) {
+    const node_t &n = nodes[i];
+    float lo_x = FLT_MAX, lo_y = FLT_MAX, lo_z = FLT_MAX;
+    float hi_x = -FLT_MAX, hi_y = -FLT_MAX, hi_z = -FLT_MAX;
+    for (int s = 0; s < 4; ++s) {
+      if (n.child[s] < 0)
+        continue;
+      lo_x = glm::min(lo_x, n.min_x[s]);
+      lo_y = glm::min(lo_y, n.min_y[s]);
+      lo_z = glm::min(lo_z, n.min_z[s]);
+      hi_x = glm::max(hi_x, n.max_x[s]);
+      hi_y = glm::max(hi_y, n.max_y[s]);
+      hi_z = glm::max(hi_z, n.max_z[s]);
+      area += surface_area(n.max_x[s] - n.min_x[s], n.max_y[s] - n.min_y[s],
+                           n.max_z[s] - n.min_z[s]);
+    }
+    if (n.parent < 0)
+      continue;
+    node_t &p = nodes[n.parent];
+    p.min_x[n.slot] = lo_x;
+    p.min_y[n.slot] = lo_y;
+    p.min_z[n.slot] = lo_z;
+    p.max_x[n.slot] = hi_x;
+    p.max_y[n.slot] = hi_y;
+    p.max_z[n.slot] = hi_z;
+  }
+  return area;
+}
+
+// Tests the four child boxes of "n" against the planes in "mask". Returns
+// a bit per slot that is in use and not wholly outside any plane; for
+// those, crossed[s] is the planes the box crosses (is not wholly inside).
+// The box's corner farthest along a plane's normal decides whether it is
+// outside, the nearest whether it is inside.
+static uint32_t test_boxes_scalar(const bvh_t::node_t &n, const frustum_t &f,
+                                  uint32_t mask, uint32_t crossed[4]) {
+  uint32_t pass = 0;
+  for (int s = 0; s < 4; ++s) {
+    if (n.child[s] < 0)
+      continue;
+    crossed[s] = 0;
+    bool out = false;
+    for (int p = 0; p < frustum_t::PLANE_COUNT && !out; ++p) {
+      if (!(mask & (1u << p)))
+        continue;
+      const glm::vec4 &pl = f.planes[p];
+      const float far_x = pl.x >= 0.0f ? n.max_x[s] : n.min_x[s];
+      const float far_y = pl.y >= 0.0f ? n.max_y[s] : n.min_y[s];
+      const float far_z = pl.z >= 0.0f ? n.max_z[s] : n.min_z[s];
+      const float near_x = pl.x >= 0.0f ? n.min_x[s] : n.max_x[s];
+      const float near_y = pl.y >= 0.0f ? n.min_y[s] : n.max_y[s];
+      const float near_z = pl.z >= 0.0f ? n.min_z[s] : n.max_z[s];
+      out = plane_dist(pl, far_x, far_y, far_z) < 0.0f;
+      if (plane_dist(pl, near_x, near_y, near_z) < 0.0f)
+        crossed[s] |= 1u << p;
+    }
+    if (!out)
+      pass |= 1u << s;
+  }
+  return pass;
+}
+
+// Tests the "count" (at most four) spheres from "first" against the planes
+// in "mask". Returns a bit per sphere that is not wholly outside.
+static uint32_t test_spheres_scalar(const float *x, const float *y,
+                                    const float *z, const float *r,
+                                    uint32_t count, const frustum_t &f,
+                                    uint32_t mask) {
+  uint32_t pass = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    bool out = false;
+    for (int p = 0; p < frustum_t::PLANE_COUNT && !out; ++p) {
+      const glm::vec4 &pl = f.planes[p];
+      out = (mask & (1u << p)) &&
+            plane_dist(pl, x[i], y[i], z[i]) < -r[i];
+    }
+    if (!out)
+      pass |= 1u << i;
+  }
+  return pass;
+}
+
+#if CULLING_X86
+static uint32_t test_boxes_sse(const bvh_t::node_t &n, const frustum_t &f,
+                               uint32_t mask, uint32_t crossed[4]) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 min_x = _mm_loadu_ps(n.min_x), max_x = _mm_loadu_ps(n.max_x);
+  const __m128 min_y = _mm_loadu_ps(n.min_y), max_y = _mm_loadu_ps(n.max_y);
+  const __m128 min_z = _mm_loadu_ps(n.min_z), max_z = _mm_loadu_ps(n.max_z);
+
+  uint32_t used = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(
+      _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)n.child),
+                      _mm_set1_epi32(-1))));
+  uint32_t out = 0;
+  for (int s = 0; s < 4; ++s)
+    crossed[s] = 0;
+
+  for (int p = 0; p < frustum_t::PLANE_COUNT; ++p) {
+    if (!(mask & (1u << p)))
+      continue;
+    const glm::vec4 &pl = f.planes[p];
+    const __m128 nx = _mm_set1_ps(pl.x), ny = _mm_set1_ps(pl.y),
+                 nz = _mm_set1_ps(pl.z), d = _mm_set1_ps(pl.w);
+
+    // which corner is farthest is the same for every box
+    const __m128 far_d = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(nx, pl.x >= 0.0f ? max_x : min_x),
+                   _mm_mul_ps(ny, pl.y >= 0.0f ? max_y : min_y)),
+        _mm_add_ps(_mm_mul_ps(nz, pl.z >= 0.0f ? max_z : min_z), d));
+    const __m128 near_d = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(nx, pl.x >= 0.0f ? min_x : max_x),
+                   _mm_mul_ps(ny, pl.y >= 0.0f ? min_y : max_y)),
+        _mm_add_ps(_mm_mul_ps(nz, pl.z >= 0.0f ? min_z : max_z), d));
+
+    out |= (uint32_t)_mm_movemask_ps(_mm_cmplt_ps(far_d, zero));
+    const uint32_t cross =
+        (uint32_t)_mm_movemask_ps(_mm_cmplt_ps(near_d, zero));
+    for (int s = 0; s < 4; ++s)
+      crossed[s] |= ((cross >> s) & 1u) << p;
+
+    if (!(used & ~out))
+      break;
+  }
+  return used & ~out;
+}
+
+static uint32_t test_spheres_sse(const float *x, const float *y,
+                                 const float *z, const float *r,
+                                 uint32_t count, const frustum_t &f,
+                                 uint32_t mask) {
+  const __m128 cx = _mm_loadu_ps(x), cy = _mm_loadu_ps(y),
+               cz = _mm_loadu_ps(z);
+  const __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r));
+
+  uint32_t out = 0;
+  for (int p = 0; p < frustum_t::PLANE_COUNT; ++p) {
+    if (!(mask & (1u << p)))
+      continue;
+    const glm::vec4 &pl = f.planes[p];
+    const __m128 dist = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl.x), cx),
+                   _mm_mul_ps(_mm_set1_ps(pl.y), cy)),
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl.z), cz), _mm_set1_ps(pl.w)));
+    out |= (uint32_t)_mm_movemask_ps(_mm_cmplt_ps(dist, neg_r));
+  }
+  return ~out & ((1u << count) - 1);
+}
+#endif
+
+void bvh_t::cull(const frustum_t &f,
+                 std::vector<uint32_t> visible[ENTITY_TYPE_COUNT],
+                 cull_stats_t *stats) const {
+  cull_with(simd_get_level(), f, visible, stats);
+}
+
+void bvh_t::cull_with(simd_level_t level, const frustum_t &f,
+                      std::vector<uint32_t> visible[ENTITY_TYPE_COUNT],
+                      cull_stats_t *stats) const {
+  tsamplr_t::storage_t start = tsamplr_t::now();
+
+  typedef uint32_t (*test_boxes_fn)(const node_t &, const frustum_t &,
+                                    uint32_t, uint32_t *);
+  typedef uint32_t (*test_spheres_fn)(const float *, const float *,
+                                      const float *, const float *, uint32_t,
+                                      const frustum_t &, uint32_t);
+  test_boxes_fn test_boxes = test_boxes_scalar;
+  test_spheres_fn test_spheres = test_spheres_scalar;
+#if CULLING_X86
+  if (level >= SIMD_SSE) {
+    test_boxes = test_boxes_sse;
+    test_spheres = test_spheres_sse;
+  }
+#endif
+
+  for (int t = 0; t < ENTITY_TYPE_COUNT; ++t)
+    visible[t].clear();
+
+  auto accept = [&](uint32_t first, uint32_t count) {
+    for (uint32_t i = first; i < first + count; ++i)
+      visible[items[i].type].push_back(items[i].idx);
+  };
+
+  // node, and the planes its box crosses; the rest it is wholly inside
+  struct pending_t {
+    int32_t node;
+    uint32_t planes;
+  };
+  pending_t stack[64];
+  uint32_t depth = 0;
+  uint32_t tested = 0;
+  if (!nodes.empty())
+    stack[depth++] = {0, all_planes};
+
+  while (depth) {
+    const pending_t top = stack[--depth];
+    const node_t &n = nodes[top.node];
+
+    uint32_t crossed[4];
+    const uint32_t pass = test_boxes(n, f, top.planes, crossed);
+    for (int s = 0; s < 4; ++s)
+      tested += n.child[s] >= 0;
+
+    // in reverse, so that the first child is popped first
+    for (int s = 4; s-- > 0;) {
+      if (!(pass & (1u << s)))
+        continue;
+      const bool leaf = n.count[s] != 0;
+      const uint32_t planes = crossed[s] & top.planes;
+
+      if (!planes) {
+        if (leaf)
+          accept(n.child[s], n.count[s]);
+        else
+          accept(nodes[n.child[s]].first, nodes[n.child[s]].size);
+      } else if (leaf) {
+        const uint32_t i = n.child[s];
+        const uint32_t in =
+            test_spheres(&sph_x[i], &sph_y[i], &sph_z[i], &sph_r[i],
+                         n.count[s], f, planes);
+        for (uint32_t j = 0; j < n.count[s]; ++j)
+          if (in & (1u << j))
+            accept(i + j, 1);
+      } else {
+        assert(depth < sizeof(stack) / sizeof(stack[0]) &&
+               "Hierarchy too deep!");
+        stack[depth++] = {n.child[s], planes};
+      }
+    }
+  }
+
+  // submit in entity order, whatever order the tree found them in
+  uint32_t found = 0;
+  for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+    std::sort(visible[t].begin(), visible[t].end());
+    found += (uint32_t)visible[t].size();
+  }
+
+  stats->objects = (uint32_t)items.size();
+  stats->visible = found;
+  stats->culled = stats->objects - found;
+  stats->nodes_tested = tested;
+  stats->cull_ms =
+      tsamplr_t::convert(tsamplr_t::now() - start, tsamplr_t::_ms_);
+}
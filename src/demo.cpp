@@ -5,18 +5,30 @@
 #include "camera.h"
 #include "cube.h"
 #include "sphere.h"
-#include <memory>
+#include "sim.h"
+#include "options.h"
+#include "shader.h"
+#include "gl-state.h"
+#include "uniform-blocks.h"
+#include "culling.h"
+#include "gpu-cull.h"
+#include "jobs.h"
+#include "profiler.h"
 
-static GLint shdr_prog = 0;
+#include <random>
+
+static shader_program_t shdr_prog;
 
 const char *vs_src = R"vs(
 #version 330
-
-uniform mat4 u_mvp;
-uniform mat3 u_norm_mtrx;
+)vs" CAMERA_BLOCK_GLSL R"vs(
 
 layout(location = 0) in vec3 a_pos;
 layout(location = 1) in vec3 a_nrm;
+layout(location = 4) in mat4 a_model; // per-instance
+// per-mesh vtx_decode_t; w of the scale says a_nrm is octahedral
+layout(location = 8) in vec4 a_pos_scale;
+layout(location = 9) in vec3 a_pos_bias;
 
 out vs_data {
   vec3 colr;
@@ -24,10 +36,21 @@ out vs_data {
 }
 output_;
 
+vec3 oct_decode(vec2 e) {
+  vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0f);
+  n.xy += vec2(n.x >= 0.0f ? -t : t, n.y >= 0.0f ? -t : t);
+  return normalize(n);
+}
+
 void main(void) {
-  output_.norm = u_norm_mtrx * a_nrm;
-  output_.colr = normalize(a_pos).xyz;
-  gl_Position = u_mvp * vec4(a_pos, 1.0f);
+  vec3 pos = a_pos * a_pos_scale.xyz + a_pos_bias;
+  vec3 nrm = a_pos_scale.w > 0.5f ? oct_decode(a_nrm.xy) : a_nrm;
+
+  // model matrices carry no non-uniform scale
+  output_.norm = mat3(a_model) * nrm;
+  output_.colr = normalize(pos).xyz;
+  gl_Position = camera.view_proj * a_model * vec4(pos, 1.0f);
 }
 )vs";
 
@@ -45,31 +68,86 @@ layout(location = 0) out vec4 frag;
 void main(void) { frag = vec4(input_.colr, 1.0f); }
 )vs";
 
-static std::vector<std::unique_ptr<object_t>> objects;
+static sim_t sim;
+
+// time the renderer is showing, plus one simulation step. Kept within a
+// step of the latest snapshot so the two clocks cannot drift apart.
+static double render_time = 0.0;
+
+// interpolated positions of each entity type, the indices of those the
+// camera may see, the same grouped by level of detail and their model
+// matrices, reused between frames
+static std::vector<glm::vec3> positions[ENTITY_TYPE_COUNT];
+static std::vector<uint32_t> visible[ENTITY_TYPE_COUNT];
+static std::vector<uint32_t> by_lod[ENTITY_TYPE_COUNT];
+static std::vector<glm::mat4> models[ENTITY_TYPE_COUNT];
+
+// the level of detail of every entity, kept for select_lods' hysteresis
+static std::vector<uint8_t> lods[ENTITY_TYPE_COUNT];
+
+static bvh_t bvh;
+static gpu_culler_t gpu_culler;
+
+// opts.cull, unless the context cannot cull on the GPU
+static cull_mode_t cull_mode = CULL_CPU;
+
+// radius of the sphere around each entity type, centred on its position
+static const float bound_radius[ENTITY_TYPE_COUNT] = {
+    sphere_radius,              // ENTITY_SPHERE
+    cube_half_size * 1.7320508f // ENTITY_CUBE, to a corner
+};
 
 bool demo_app_t::init(int argc, char const *argv[]) {
   bool rt = true;
   cprintf(L"$c*`begin$? demo setup\n");
 
-  GLuint vs = create_shader(GL_VERTEX_SHADER, vs_src);
-  GLuint fs = create_shader(GL_FRAGMENT_SHADER, fs_src);
-  shdr_prog = create_shader_program(2, vs, fs);
+  shdr_prog.create(vs_src, fs_src);
+  shdr_prog.bind_block("camera_block", UBO_CAMERA);
 
-  glDeleteShader(vs);
-  glDeleteShader(vs);
+  sphere_t::setup();
+  cube_t::setup();
 
-  objects.resize(10);
-  int i = -8;
-  for (auto &obj : objects) {
-    if (i < 0)
-      obj = std::unique_ptr<object_t>(new sphere_t);
-    else
-      obj = std::unique_ptr<object_t>(new cube_t);
+  cull_mode = (cull_mode_t)opts.cull;
+  if (cull_mode == CULL_GPU && !gpu_culler.init()) {
+    fprintf(stderr, "WARNING: culling on the GPU needs GL 4.3; culling on "
+                    "the CPU instead\n");
+    cull_mode = CULL_CPU;
+  }
+  cprintf(L"culling: $c*%s$?\n", cull_mode_name(cull_mode));
 
-    obj->setup({i, 5.0f, i & 1 ? i : -i});
-    i += 2;
+  sim.broadphase.mode = (broadphase_mode_t)opts.broadphase;
+  sim.step_dt = 1.0 / opts.sim_hz;
+
+  if (opts.objects) {
+    // spheres and cubes in turn, dropped over a square that grows with
+    // their number, the same each run
+    extent = 0.5f * sqrtf(6.0f * opts.objects);
+    std::mt19937 rng(opts.objects);
+    std::uniform_real_distribution<float> coord(-extent, extent);
+    std::uniform_real_distribution<float> height(1.0f, 10.0f);
+    for (int i = 0; i < opts.objects; ++i) {
+      const float x = coord(rng), y = height(rng), z = coord(rng);
+      if (i & 1)
+        sim.scene.spawn(ENTITY_CUBE, glm::vec3(x, y, z), 1.0f);
+      else
+        sim.scene.spawn(ENTITY_SPHERE, glm::vec3(x, y, z), 0.01f);
+    }
+  } else {
+    extent = 10.0f;
+    for (int i = -8; i < 12; i += 2) {
+      glm::vec3 pos = {(float)i, 5.0f, (float)(i & 1 ? i : -i)};
+      if (i < 0)
+        sim.scene.spawn(ENTITY_SPHERE, pos, 0.01f);
+      else
+        sim.scene.spawn(ENTITY_CUBE, pos, 1.0f);
+    }
   }
 
+  render_time = sim.scene.time;
+  sim.publish();
+  if (!opts.sim_sync)
+    sim.start();
+
   if (rt)
     cprintf(L"demo setup $g*success$?`!\n");
   return rt;
@@ -79,8 +157,13 @@ bool demo_app_t::teardown(void) {
   bool rt = true;
   cprintf(L"$c*`begin$? demo teardown\n");
 
-  for (auto &obj : objects)
-    obj->teardown();
+  sim.stop();
+  sim.scene.clear();
+  bvh.clear();
+  gpu_culler.teardown();
+  sphere_t::teardown();
+  cube_t::teardown();
+  shdr_prog.destroy();
 
   if (rt)
     cprintf(L"demo teardown $g*success$?`!\n");
@@ -88,42 +171,131 @@ bool demo_app_t::teardown(void) {
 }
 
 void demo_app_t::update(float dt) {
+  render_time += dt;
 
-  for (auto &obj : objects) {
-    void *ptr = (void *)dynamic_cast<sphere_t *>(obj.get());
-    if (ptr) {
-      ((sphere_t *)ptr)->update(dt);
-      continue;
-    }
-
-    ptr = (void *)dynamic_cast<cube_t *>(obj.get());
-    if (ptr) {
-      ((cube_t *)ptr)->update(dt);
-      continue;
-    }
-
-    assert(0 && "Invalid pointer casting!");
+  // otherwise the simulation thread keeps up by itself
+  if (!sim.is_running()) {
+    PROFILE_SCOPE("simulate");
+    sim.advance_to(render_time);
   }
 }
 
 void demo_app_t::input(int key, int scancode, int action, int mods) {}
 
 void demo_app_t::render(void) {
-  // draw cubes
+  assert(shdr_prog.handle && "Invalid program handle!");
+  gl_state.enable(GL_DEPTH_TEST);
+
+  // show the state one step behind render_time, between the two most
+  // recent simulation steps
+  sim.snapshots.acquire();
+  const sim_snapshot_t &snap = sim.snapshots.read_buffer();
+  render_time = glm::clamp(render_time, snap.time, snap.time + sim.step_dt);
+  const float alpha = (float)((render_time - snap.time) / sim.step_dt);
+
+  {
+    PROFILE_SCOPE("interpolate");
+    for (int t = 0; t < ENTITY_TYPE_COUNT; ++t)
+      snap.interpolate((entity_type_t)t, alpha, &positions[t]);
+  }
 
-  for (auto &obj : objects) {
-    void *ptr = (void *)dynamic_cast<sphere_t *>(obj.get());
-    if (ptr) {
-      ((sphere_t *)ptr)->render(shdr_prog);
-      continue;
+  frustum_t frustum;
+  frustum.extract(cam.get_proj() * cam.get_matrix());
+
+  lod_view_t lod_view;
+  lod_view.setup(cam, (float)window_height, opts.lod_error);
+  const lod_chain_t chains[ENTITY_TYPE_COUNT] = {
+      sphere_t::lod_chain(), // ENTITY_SPHERE
+      cube_t::lod_chain()    // ENTITY_CUBE
+  };
+  GLsizei idx_count[ENTITY_TYPE_COUNT][max_lods] = {};
+  for (uint32_t l = 0; l < chains[ENTITY_SPHERE].count; ++l)
+    idx_count[ENTITY_SPHERE][l] = sphere_t::gfx_lods[l].idx_count;
+  for (uint32_t l = 0; l < chains[ENTITY_CUBE].count; ++l)
+    idx_count[ENTITY_CUBE][l] = cube_t::gfx_lods[l].idx_count;
+
+  // the compute pass leaves one indirect draw per entity type and level
+  if (cull_mode == CULL_GPU) {
+    {
+      PROFILE_SCOPE("cull");
+      gpu_culler.cull(positions, bound_radius, chains, idx_count, lod_view,
+                      frustum, &cull_stats, &lod_stats);
     }
 
-    ptr = (void *)dynamic_cast<cube_t *>(obj.get());
-    if (ptr) {
-      ((cube_t *)ptr)->render(shdr_prog);
-      continue;
+    PROFILE_SCOPE("draw");
+    shdr_prog.use();
+    sphere_t::render_indirect(gpu_culler.instances, gpu_culler.commands,
+                              gpu_culler_t::command_offset(ENTITY_SPHERE),
+                              gpu_culler_t::command_stride);
+    cube_t::render_indirect(gpu_culler.instances, gpu_culler.commands,
+                            gpu_culler_t::command_offset(ENTITY_CUBE),
+                            gpu_culler_t::command_stride);
+    return;
+  }
+
+  if (cull_mode == CULL_CPU) {
+    PROFILE_SCOPE("cull");
+    bvh.update(positions, bound_radius, &cull_stats);
+    bvh.cull(frustum, visible, &cull_stats);
+  } else {
+    cull_stats = cull_stats_t();
+    for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+      visible[t].resize(positions[t].size());
+      for (uint32_t i = 0; i < (uint32_t)visible[t].size(); ++i)
+        visible[t][i] = i;
+      cull_stats.objects += (uint32_t)visible[t].size();
     }
+    cull_stats.visible = cull_stats.objects;
+  }
+
+  // the level of each visible entity, then the visible entities grouped
+  // by level with a counting sort, which keeps them in order within one
+  uint32_t lod_instances[ENTITY_TYPE_COUNT][max_lods] = {};
+  lod_stats = lod_stats_t();
+  {
+    PROFILE_SCOPE("lod");
+    for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+      const uint32_t n = (uint32_t)visible[t].size();
+      const uint32_t *idx = visible[t].data();
+      lods[t].resize(positions[t].size(), 0);
+      select_lods(lod_view, chains[t], bound_radius[t], positions[t].data(),
+                  idx, n, lods[t].data());
+
+      uint32_t *counts = lod_instances[t];
+      for (uint32_t i = 0; i < n; ++i)
+        ++counts[lods[t][idx[i]]];
+      uint32_t start[max_lods];
+      for (uint32_t l = 0, sum = 0; l < max_lods; sum += counts[l++])
+        start[l] = sum;
+      by_lod[t].resize(n);
+      for (uint32_t i = 0; i < n; ++i)
+        by_lod[t][start[lods[t][idx[i]]]++] = idx[i];
+
+      for (uint32_t l = 0; l < chains[t].count; ++l) {
+        lod_stats.instances[l] += counts[l];
+        lod_stats.triangles += (uint64_t)counts[l] * (idx_count[t][l] / 3);
+      }
+    }
+  }
 
-    assert(0 && "Invalid pointer casting!");
+  {
+    PROFILE_SCOPE("models");
+    for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+      const glm::vec3 *pos = positions[t].data();
+      const uint32_t *idx = by_lod[t].data();
+      models[t].resize(by_lod[t].size());
+      glm::mat4 *out = models[t].data();
+      jobs.parallel_for(
+          (uint32_t)by_lod[t].size(), 4096, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i)
+              out[i] = glm::translate(glm::mat4(1.0), pos[idx[i]]);
+          });
+    }
   }
+
+  // one draw call per entity type and level, of the visible entities only
+  PROFILE_SCOPE("draw");
+  shdr_prog.use();
+  sphere_t::render(models[ENTITY_SPHERE].data(), lod_instances[ENTITY_SPHERE]);
+  cube_t::render(models[ENTITY_CUBE].data(), lod_instances[ENTITY_CUBE]);
 }
@@ -0,0 +1,194 @@
+#include "frame-report.h"
+
+#include <algorithm>
+#include <cstring>
+
+sample_stats_t sample_stats(std::vector<double> samples) {
+  sample_stats_t s = {0.0, 0.0, 0.0, 0.0, 0.0, (uint32_t)samples.size()};
+  if (samples.empty())
+    return s;
+
+  std::sort(samples.begin(), samples.end());
+  const size_t n = samples.size();
+  auto rank = [&](double p) {
+    const size_t r = (size_t)ceil(p * n);
+    return samples[std::min(std::max<size_t>(r, 1), n) - 1];
+  };
+
+  double sum = 0.0;
+  for (double v : samples)
+    sum += v;
+  s.mean = sum / n;
+  s.p50 = rank(0.50);
+  s.p95 = rank(0.95);
+  s.p99 = rank(0.99);
+  s.max = samples.back();
+  return s;
+}
+
+frame_report_t::frame_report_t(void)
+    : frames(0), warmup(0), objects(0), sphere_segments(0), dt(0.0f),
+      lod_error(0.0f), cull(""), gpu_dropped(0), rss_kb(0), peak_rss_kb(0), stream_bytes(0),
+      hash(0) {}
+
+void frame_report_t::sample_memory(void) {
+  rss_kb = peak_rss_kb = 0;
+#ifdef __linux__
+  FILE *fp = fopen("/proc/self/status", "r");
+  if (!fp)
+    return;
+  char line[256];
+  while (fgets(line, sizeof(line), fp)) {
+    unsigned long long kb;
+    if (sscanf(line, "VmRSS: %llu kB", &kb) == 1)
+      rss_kb = kb;
+    else if (sscanf(line, "VmHWM: %llu kB", &kb) == 1)
+      peak_rss_kb = kb;
+  }
+  fclose(fp);
+#endif
+}
+
+static void write_stats(FILE *fp, const char *name,
+                        const std::vector<double> &samples) {
+  const sample_stats_t s = sample_stats(samples);
+  fprintf(fp,
+          "  \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, "
+          "\"p99\": %.4f, \"max\": %.4f, \"count\": %u},\n",
+          name, s.mean, s.p50, s.p95, s.p99, s.max, s.count);
+}
+
+bool frame_report_t::write(const char *path) const {
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    fprintf(stderr, "ERROR: failed to open report file %s\n", path);
+    return false;
+  }
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"frames\": %u,\n  \"warmup\": %u,\n", frames, warmup);
+  fprintf(fp, "  \"dt\": %.6f,\n", dt);
+  fprintf(fp, "  \"objects\": %u,\n  \"sphere_segments\": %u,\n", objects,
+          sphere_segments);
+  fprintf(fp, "  \"cull\": \"%s\",\n  \"lod_error\": %.3f,\n", cull,
+          lod_error);
+  write_stats(fp, "frame_ms", frame_ms);
+  write_stats(fp, "cpu_ms", cpu_ms);
+  write_stats(fp, "gpu_ms", gpu_ms);
+  fprintf(fp, "  \"gpu_frames_dropped\": %u,\n", gpu_dropped);
+  fprintf(fp,
+          "  \"memory\": {\"rss_kb\": %llu, \"peak_rss_kb\": %llu, "
+          "\"stream_bytes_per_frame\": %llu},\n",
+          (unsigned long long)rss_kb, (unsigned long long)peak_rss_kb,
+          (unsigned long long)stream_bytes);
+  fprintf(fp, "  \"frame_hash\": \"%.16llx\"\n}\n", (unsigned long long)hash);
+
+  const bool ok = !ferror(fp);
+  fclose(fp);
+  if (!ok)
+    fprintf(stderr, "ERROR: failed to write report file %s\n", path);
+  return ok;
+}
+
+// the number at "key" in a report as write() lays it out: in the object
+// at "section", or at the top level if "section" is NULL
+static bool find_number(const std::string &json, const char *section,
+                        const char *key, double *out) {
+  size_t at = 0, end = json.size();
+  if (section) {
+    at = json.find(std::string("\"") + section + "\"");
+    if (at == std::string::npos)
+      return false;
+    end = json.find('}', at);
+  }
+  at = json.find(std::string("\"") + key + "\":", at);
+  if (at == std::string::npos || at > end)
+    return false;
+  return sscanf(json.c_str() + at + strlen(key) + 3, "%lf", out) == 1;
+}
+
+bool frame_report_t::check(const char *path, float max_regression) const {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "ERROR: failed to open baseline %s\n", path);
+    return false;
+  }
+  std::string json;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    json.append(buf, n);
+  fclose(fp);
+
+  // times of different scenes say nothing about each other. The step
+  // moves the camera along its path and the LOD error picks the meshes
+  // drawn, so they count too; they are compared as write() rounds them.
+  const struct {
+    const char *key;
+    double value, tolerance;
+  } scene[] = {{"frames", (double)frames, 0.0},
+               {"objects", (double)objects, 0.0},
+               {"sphere_segments", (double)sphere_segments, 0.0},
+               {"dt", (double)dt, 0.5e-6},
+               {"lod_error", (double)lod_error, 0.5e-3}};
+  for (const auto &s : scene) {
+    double v;
+    if (!find_number(json, NULL, s.key, &v) ||
+        fabs(v - s.value) > s.tolerance) {
+      fprintf(stderr, "ERROR: baseline %s was not run with %s %g\n", path,
+              s.key, s.value);
+      return false;
+    }
+  }
+  // GPU percentiles missing frames lean towards the fast ones
+  double dropped;
+  if (!find_number(json, NULL, "gpu_frames_dropped", &dropped)) {
+    fprintf(stderr, "ERROR: baseline %s does not say whether GPU times are "
+                    "missing; write it again\n",
+            path);
+    return false;
+  }
+  if (gpu_dropped || dropped) {
+    fprintf(stderr, "ERROR: GPU times missing for %u frames here, %g in "
+                    "baseline %s\n",
+            gpu_dropped, dropped, path);
+    return false;
+  }
+  if (json.find(std::string("\"cull\": \"") + cull + "\"") ==
+      std::string::npos) {
+    fprintf(stderr, "ERROR: baseline %s was not run with cull %s\n", path,
+            cull);
+    return false;
+  }
+
+  // and below a tenth of a millisecond, timer noise swamps any change
+  const double limit = 1.0 + max_regression / 100.0, noise_ms = 0.1;
+  const struct {
+    const char *name;
+    const std::vector<double> &samples;
+  } sets[] = {{"frame_ms", frame_ms}, {"cpu_ms", cpu_ms}, {"gpu_ms", gpu_ms}};
+  bool ok = true;
+  for (const auto &set : sets) {
+    const sample_stats_t s = sample_stats(set.samples);
+    const struct {
+      const char *key;
+      double value;
+    } stats[] = {{"p50", s.p50}, {"p95", s.p95}};
+    for (const auto &stat : stats) {
+      double base;
+      if (!s.count || !find_number(json, set.name, stat.key, &base))
+        continue;
+      const bool slower =
+          stat.value > base * limit && stat.value - base > noise_ms;
+      printf("%-8s %s: %8.3f ms, baseline %8.3f ms (%+.1f%%)%s\n", set.name,
+             stat.key, stat.value, base,
+             base > 0.0 ? 100.0 * (stat.value / base - 1.0) : 0.0,
+             slower ? " REGRESSED" : "");
+      ok &= !slower;
+    }
+  }
+  if (!ok)
+    fprintf(stderr, "ERROR: more than %.1f%% slower than baseline %s\n",
+            max_regression, path);
+  return ok;
+}
@@ -0,0 +1,53 @@
+#include "gl-ext.h"
+
+#include <cstring>
+
+glext_t glext = {};
+
+template <typename T> static T load_proc(GLADloadproc load, const char *name) {
+  T proc = (T)load(name);
+  if (!proc) {
+    fprintf(stderr, "ERROR: failed to load GL entry point %s\n", name);
+    exit(1);
+  }
+  return proc;
+}
+
+bool glext_supported(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; ++i) {
+    const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+    if (ext && !strcmp(ext, name))
+      return true;
+  }
+  return false;
+}
+
+void glext_load(GLADloadproc load) {
+  glext.vertex_attrib_divisor =
+      load_proc<glext_vertex_attrib_divisor_fn>(load, "glVertexAttribDivisor");
+
+  // a loader may hand out entry points the context cannot use, so only
+  // take them when it says it has them
+  const bool core_4_4 =
+      GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4);
+  glext.buffer_storage =
+      core_4_4 || glext_supported("GL_ARB_buffer_storage")
+          ? (glext_buffer_storage_fn)load("glBufferStorage")
+          : NULL;
+
+  // the compute culling shader is GLSL 4.30, so the extensions alone would
+  // not do
+  const bool core_4_3 =
+      GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3);
+  if (core_4_3) {
+    glext.dispatch_compute =
+        load_proc<glext_dispatch_compute_fn>(load, "glDispatchCompute");
+    glext.memory_barrier =
+        load_proc<glext_memory_barrier_fn>(load, "glMemoryBarrier");
+    glext.multi_draw_elements_indirect =
+        load_proc<glext_multi_draw_elements_indirect_fn>(
+            load, "glMultiDrawElementsIndirect");
+  }
+}
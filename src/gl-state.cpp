@@ -0,0 +1,273 @@
+#include "gl-state.h"
+
+gl_state_t gl_state;
+
+// marks a value the shadow does not know
+static const GLuint unknown = ~0U;
+
+static gl_state_t::buffer_slot_t buffer_slot(GLenum target) {
+  switch (target) {
+  case GL_ARRAY_BUFFER:
+    return gl_state_t::BUF_ARRAY;
+  case GL_ELEMENT_ARRAY_BUFFER:
+    return gl_state_t::BUF_ELEMENT_ARRAY;
+  case GL_PIXEL_PACK_BUFFER:
+    return gl_state_t::BUF_PIXEL_PACK;
+  case GL_PIXEL_UNPACK_BUFFER:
+    return gl_state_t::BUF_PIXEL_UNPACK;
+  case GL_UNIFORM_BUFFER:
+    return gl_state_t::BUF_UNIFORM;
+  default:
+    assert(0 && "Untracked buffer target!");
+    return gl_state_t::BUF_SLOT_COUNT;
+  }
+}
+
+static const GLenum buffer_targets[gl_state_t::BUF_SLOT_COUNT] = {
+    GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_PIXEL_PACK_BUFFER,
+    GL_PIXEL_UNPACK_BUFFER, GL_UNIFORM_BUFFER};
+
+static gl_state_t::cap_slot_t cap_slot(GLenum cap) {
+  switch (cap) {
+  case GL_DEPTH_TEST:
+    return gl_state_t::CAP_DEPTH_TEST;
+  case GL_BLEND:
+    return gl_state_t::CAP_BLEND;
+  case GL_CULL_FACE:
+    return gl_state_t::CAP_CULL_FACE;
+  case GL_SCISSOR_TEST:
+    return gl_state_t::CAP_SCISSOR_TEST;
+  default:
+    assert(0 && "Untracked capability!");
+    return gl_state_t::CAP_SLOT_COUNT;
+  }
+}
+
+static const GLenum caps[gl_state_t::CAP_SLOT_COUNT] = {
+    GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_SCISSOR_TEST};
+
+void gl_state_t::reset(void) {
+  cur.program = 0;
+  cur.vertex_array = 0;
+  for (GLuint &b : cur.buffers)
+    b = 0;
+  cur.draw_framebuffer = cur.read_framebuffer = 0;
+  cur.active_texture = 0;
+  for (GLuint &t : cur.texture_2d)
+    t = 0;
+  for (GLuint &c : cur.caps)
+    c = 0;
+  cur.blend_equation = GL_FUNC_ADD;
+  cur.blend_src = GL_ONE;
+  cur.blend_dst = GL_ZERO;
+  cur.line_width = 1.0f;
+
+  issued = skipped = 0;
+}
+
+void gl_state_t::invalidate(void) {
+  cur.program = unknown;
+  cur.vertex_array = unknown;
+  for (GLuint &b : cur.buffers)
+    b = unknown;
+  cur.draw_framebuffer = cur.read_framebuffer = unknown;
+  cur.active_texture = unknown;
+  for (GLuint &t : cur.texture_2d)
+    t = unknown;
+  for (GLuint &c : cur.caps)
+    c = unknown;
+  cur.blend_equation = cur.blend_src = cur.blend_dst = unknown;
+  cur.line_width = -1.0f;
+
+  issued = skipped = 0;
+}
+
+void gl_state_t::restore(const snapshot_t &s) {
+  if (s.program != unknown)
+    use_program(s.program);
+  if (s.vertex_array != unknown)
+    bind_vertex_array(s.vertex_array);
+  // the element buffer came back with its vertex array
+  for (uint32_t i = 0; i < BUF_SLOT_COUNT; ++i)
+    if (i != BUF_ELEMENT_ARRAY && s.buffers[i] != unknown)
+      bind_buffer(buffer_targets[i], s.buffers[i]);
+
+  if (s.draw_framebuffer != unknown)
+    bind_framebuffer(GL_DRAW_FRAMEBUFFER, s.draw_framebuffer);
+  if (s.read_framebuffer != unknown)
+    bind_framebuffer(GL_READ_FRAMEBUFFER, s.read_framebuffer);
+
+  for (uint32_t u = 0; u < max_texture_units; ++u) {
+    if (s.texture_2d[u] != unknown && s.texture_2d[u] != cur.texture_2d[u]) {
+      active_texture(GL_TEXTURE0 + u);
+      bind_texture(GL_TEXTURE_2D, s.texture_2d[u]);
+    }
+  }
+  if (s.active_texture != unknown)
+    active_texture(GL_TEXTURE0 + s.active_texture);
+
+  for (uint32_t i = 0; i < CAP_SLOT_COUNT; ++i)
+    if (s.caps[i] != unknown)
+      set_cap(caps[i], s.caps[i] != 0);
+
+  if (s.blend_equation != unknown)
+    blend_equation(s.blend_equation);
+  if (s.blend_src != unknown && s.blend_dst != unknown)
+    blend_func(s.blend_src, s.blend_dst);
+  if (s.line_width >= 0.0f)
+    line_width(s.line_width);
+}
+
+void gl_state_t::use_program(GLuint program) {
+  if (update(&cur.program, program))
+    glUseProgram(program);
+}
+
+void gl_state_t::bind_vertex_array(GLuint vao) {
+  if (update(&cur.vertex_array, vao)) {
+    glBindVertexArray(vao);
+    // the element buffer binding is the new vertex array's own
+    cur.buffers[BUF_ELEMENT_ARRAY] = unknown;
+  }
+}
+
+void gl_state_t::bind_buffer(GLenum target, GLuint buffer) {
+  if (update(&cur.buffers[buffer_slot(target)], buffer))
+    glBindBuffer(target, buffer);
+}
+
+void gl_state_t::bind_buffer_range(GLenum target, GLuint index,
+                                   GLuint buffer, GLintptr offset,
+                                   GLsizeiptr size) {
+  cur.buffers[buffer_slot(target)] = buffer;
+  ++issued;
+  glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void gl_state_t::bind_framebuffer(GLenum target, GLuint fbo) {
+  bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+  bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+  assert((draw || read) && "Invalid framebuffer target!");
+
+  // one call covers both when both change
+  draw = draw && cur.draw_framebuffer != fbo;
+  read = read && cur.read_framebuffer != fbo;
+  if (!draw && !read) {
+    ++skipped;
+    return;
+  }
+
+  ++issued;
+  if (draw)
+    cur.draw_framebuffer = fbo;
+  if (read)
+    cur.read_framebuffer = fbo;
+  glBindFramebuffer(draw && read ? GL_FRAMEBUFFER
+                                 : (draw ? GL_DRAW_FRAMEBUFFER
+                                         : GL_READ_FRAMEBUFFER),
+                    fbo);
+}
+
+void gl_state_t::active_texture(GLenum unit) {
+  assert(unit - GL_TEXTURE0 < max_texture_units && "Untracked texture unit!");
+  if (update(&cur.active_texture, unit - GL_TEXTURE0))
+    glActiveTexture(unit);
+}
+
+void gl_state_t::bind_texture(GLenum target, GLuint texture) {
+  assert(target == GL_TEXTURE_2D && "Untracked texture target!");
+
+  // an unknown unit means GL may be anywhere; bind without recording
+  if (cur.active_texture == unknown) {
+    ++issued;
+    glBindTexture(target, texture);
+    return;
+  }
+
+  if (update(&cur.texture_2d[cur.active_texture], texture))
+    glBindTexture(target, texture);
+}
+
+void gl_state_t::set_cap(GLenum cap, bool on) {
+  if (!update(&cur.caps[cap_slot(cap)], (GLuint)on))
+    return;
+  if (on)
+    glEnable(cap);
+  else
+    glDisable(cap);
+}
+
+void gl_state_t::enable(GLenum cap) { set_cap(cap, true); }
+
+void gl_state_t::disable(GLenum cap) { set_cap(cap, false); }
+
+void gl_state_t::blend_equation(GLenum mode) {
+  if (update(&cur.blend_equation, mode))
+    glBlendEquation(mode);
+}
+
+void gl_state_t::blend_func(GLenum src, GLenum dst) {
+  if (cur.blend_src == src && cur.blend_dst == dst) {
+    ++skipped;
+    return;
+  }
+  cur.blend_src = src;
+  cur.blend_dst = dst;
+  ++issued;
+  glBlendFunc(src, dst);
+}
+
+void gl_state_t::line_width(GLfloat width) {
+  if (update(&cur.line_width, width))
+    glLineWidth(width);
+}
+
+void gl_state_t::delete_buffers(GLsizei n, const GLuint *buffers) {
+  for (GLsizei i = 0; i < n; ++i) {
+    if (!buffers[i])
+      continue;
+    for (GLuint &b : cur.buffers)
+      if (b == buffers[i])
+        b = 0;
+  }
+  glDeleteBuffers(n, buffers);
+}
+
+void gl_state_t::delete_vertex_arrays(GLsizei n, const GLuint *arrays) {
+  for (GLsizei i = 0; i < n; ++i) {
+    if (arrays[i] && cur.vertex_array == arrays[i]) {
+      cur.vertex_array = 0;
+      cur.buffers[BUF_ELEMENT_ARRAY] = unknown;
+    }
+  }
+  glDeleteVertexArrays(n, arrays);
+}
+
+void gl_state_t::delete_textures(GLsizei n, const GLuint *textures) {
+  for (GLsizei i = 0; i < n; ++i) {
+    if (!textures[i])
+      continue;
+    for (GLuint &t : cur.texture_2d)
+      if (t == textures[i])
+        t = 0;
+  }
+  glDeleteTextures(n, textures);
+}
+
+void gl_state_t::delete_program(GLuint program) {
+  if (program && cur.program == program)
+    use_program(0);
+  glDeleteProgram(program);
+}
+
+void gl_state_t::delete_framebuffers(GLsizei n, const GLuint *fbos) {
+  for (GLsizei i = 0; i < n; ++i) {
+    if (!fbos[i])
+      continue;
+    if (cur.draw_framebuffer == fbos[i])
+      cur.draw_framebuffer = 0;
+    if (cur.read_framebuffer == fbos[i])
+      cur.read_framebuffer = 0;
+  }
+  glDeleteFramebuffers(n, fbos);
+}
@@ -0,0 +1,344 @@
+#include "gpu-cull.h"
+#include "gl-ext.h"
+#include "gl-state.h"
+#include "jobs.h"
+
+#include <cstring>
+
+static const uint32_t group_size = 64;
+
+// the head of the "objects" buffer, laid out as std430 lays out the block
+struct objects_header_t {
+  glm::vec4 planes[frustum_t::PLANE_COUNT];
+  glm::vec4 eye;          // xyz, and lod_view_t::px_per_unit in w
+  glm::vec4 lod_error[4]; // of each entity type, by level
+  GLuint first[4];        // first sphere of each entity type; the rest unused
+  GLuint lod_count[4];    // levels of each entity type
+  GLuint count;           // spheres
+  float tolerance, hysteresis;
+  GLuint pad;
+};
+
+static_assert(sizeof(objects_header_t) == 224,
+              "objects_header_t must match its std430 layout");
+static_assert(ENTITY_TYPE_COUNT <= 4, "objects_header_t::first is too small");
+static_assert(max_lods == 4, "objects_header_t::lod_error is too small");
+
+// the "commands" buffer: a command per entity type and level, and where
+// the second pass has got to in filling each
+struct commands_t {
+  gpu_culler_t::draw_cmd_t cmds[4 * max_lods];
+  GLuint cursors[4 * max_lods];
+};
+
+static const char *cs_src = R"cs(
+#version 430
+layout(local_size_x = 64) in;
+
+struct draw_cmd {
+  uint count;
+  uint instance_count;
+  uint first_index;
+  int base_vertex;
+  uint base_instance;
+};
+
+layout(std430, binding = 0) readonly buffer objects_block {
+  vec4 planes[6];
+  vec4 eye;
+  vec4 lod_error[4];
+  uint first[4];
+  uint lod_count[4];
+  uint count;
+  float tolerance;
+  float hysteresis;
+  vec4 spheres[]; // centre, radius
+};
+
+// a command per entity type and level, t * 4 + level
+layout(std430, binding = 1) buffer commands_block {
+  draw_cmd cmds[16];
+  uint cursors[16];
+};
+
+layout(std430, binding = 2) writeonly buffer instances_block {
+  mat4 models[];
+};
+
+// the level of each entity in the low byte, kept from frame to frame,
+// and 0x100 if it is visible this frame
+layout(std430, binding = 3) buffer lods_block { uint lods[]; };
+
+// 0 to cull and count, 1 to place the model matrices
+uniform int u_pass;
+
+const uint visible_bit = 0x100u;
+
+void main(void) {
+  uint i = gl_GlobalInvocationID.x;
+
+  // by now every count is final: lay the commands' instances out one
+  // after the other, by type and then by level, for the draws. The
+  // second pass cannot wait for these, and adds the counts up itself.
+  if (u_pass == 1 && i == 0u) {
+    for (uint t = 0u; t < 4u; ++t) {
+      uint base = first[t];
+      for (uint l = 0u; l < 4u; ++l) {
+        cmds[t * 4u + l].base_instance = base;
+        base += cmds[t * 4u + l].instance_count;
+      }
+    }
+  }
+  if (i >= count)
+    return;
+
+  vec4 s = spheres[i];
+  uint lod = lods[i] & 0xffu;
+
+  // unused types start at "count", past every sphere
+  uint t = 0u;
+  while (t < 3u && i >= first[t + 1u])
+    ++t;
+
+  if (u_pass == 0) {
+    for (int p = 0; p < 6; ++p)
+      if (dot(planes[p].xyz, s.xyz) + planes[p].w < -s.w) {
+        lods[i] = lod;
+        return;
+      }
+
+    // as select_lods does
+    uint n = lod_count[t];
+    if (n < 2u || tolerance <= 0.0f) {
+      lod = 0u;
+    } else {
+      float dist = max(length(s.xyz - eye.xyz) - s.w, 1e-3f);
+      float px = eye.w / dist;
+      lod = min(lod, n - 1u);
+      while (lod > 0u && lod_error[t][lod] * px > tolerance)
+        --lod;
+      while (lod + 1u < n && lod_error[t][lod + 1u] * px <
+                                 tolerance * hysteresis)
+        ++lod;
+    }
+    lods[i] = lod | visible_bit;
+    atomicAdd(cmds[t * 4u + lod].instance_count, 1u);
+    return;
+  }
+
+  if ((lods[i] & visible_bit) == 0u)
+    return;
+  // in no particular order within a command
+  uint slot = first[t];
+  for (uint l = 0u; l < lod; ++l)
+    slot += cmds[t * 4u + l].instance_count;
+  slot += atomicAdd(cursors[t * 4u + lod], 1u);
+  models[slot] = mat4(vec4(1.0f, 0.0f, 0.0f, 0.0f),
+                      vec4(0.0f, 1.0f, 0.0f, 0.0f),
+                      vec4(0.0f, 0.0f, 1.0f, 0.0f), vec4(s.xyz, 1.0f));
+}
+)cs";
+
+// the alignment GL requires of shader storage buffer ranges
+static GLsizeiptr storage_alignment(void) {
+  static GLint align = 0;
+  if (!align)
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+  return glm::max(align, 1);
+}
+
+bool gpu_culler_t::init(void) {
+  if (!glext.dispatch_compute || !glext.multi_draw_elements_indirect)
+    return false;
+
+  program.create_compute(cs_src);
+
+  glGenBuffers(1, &commands);
+  glGenBuffers(1, &instances);
+  glGenBuffers(1, &lods);
+  glGenBuffers(frames_in_flight, counts);
+
+  // not tracked by gl_state, which has no copy targets
+  glBindBuffer(GL_COPY_WRITE_BUFFER, commands);
+  glBufferData(GL_COPY_WRITE_BUFFER, sizeof(commands_t), NULL,
+               GL_DYNAMIC_DRAW);
+  for (uint32_t f = 0; f < frames_in_flight; ++f) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, counts[f]);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(commands_t::cmds), NULL,
+                 GL_STREAM_READ);
+    fences[f] = 0;
+  }
+
+  capacity = 0;
+  objects = 0;
+  frame = 0;
+  return true;
+}
+
+void gpu_culler_t::teardown(void) {
+  if (!ready())
+    return;
+  program.destroy();
+  for (uint32_t f = 0; f < frames_in_flight; ++f)
+    if (fences[f]) {
+      glDeleteSync(fences[f]);
+      fences[f] = 0;
+    }
+  gl_state.delete_buffers(1, &commands);
+  gl_state.delete_buffers(1, &instances);
+  gl_state.delete_buffers(1, &lods);
+  gl_state.delete_buffers(frames_in_flight, counts);
+  commands = instances = lods = 0;
+  capacity = 0;
+  objects = 0;
+}
+
+void gpu_culler_t::cull(const std::vector<glm::vec3> pos[ENTITY_TYPE_COUNT],
+                        const float radius[ENTITY_TYPE_COUNT],
+                        const lod_chain_t chains[ENTITY_TYPE_COUNT],
+                        const GLsizei idx_count[ENTITY_TYPE_COUNT][max_lods],
+                        const lod_view_t &view, const frustum_t &f,
+                        cull_stats_t *stats, lod_stats_t *lod_stats) {
+  assert(ready() && "GPU culling is not available!");
+  tsamplr_t::storage_t start = tsamplr_t::now();
+
+  objects_header_t header;
+  memset((void *)&header, 0, sizeof(header));
+  for (int p = 0; p < frustum_t::PLANE_COUNT; ++p)
+    header.planes[p] = f.planes[p];
+  header.eye = glm::vec4(view.eye, view.px_per_unit);
+  for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+    header.first[t] = header.count;
+    header.count += (GLuint)pos[t].size();
+    header.lod_count[t] = chains[t].count;
+    for (uint32_t l = 0; l < chains[t].count; ++l)
+      header.lod_error[t][l] = chains[t].error[l];
+  }
+  for (int t = ENTITY_TYPE_COUNT; t < 4; ++t)
+    header.first[t] = header.count;
+  header.tolerance = view.tolerance;
+  header.hysteresis = view.hysteresis;
+  const uint32_t total = header.count;
+
+  // every command starts the frame with no instances; the second pass
+  // sets base_instance
+  commands_t cmds;
+  memset((void *)&cmds, 0, sizeof(cmds));
+  for (int t = 0; t < ENTITY_TYPE_COUNT; ++t)
+    for (uint32_t l = 0; l < chains[t].count; ++l)
+      cmds.cmds[t * max_lods + l].count = (GLuint)idx_count[t][l];
+  glBindBuffer(GL_COPY_WRITE_BUFFER, commands);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(cmds), &cmds);
+
+  if (total > capacity) {
+    capacity = glm::max(total, capacity * 2);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, instances);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(glm::mat4) * capacity, NULL,
+                 GL_DYNAMIC_COPY);
+  }
+
+  // the levels are kept by index, which only means the same entity while
+  // the counts stay the same: start again from level 0 otherwise
+  if (total != objects) {
+    objects = total;
+    std::vector<GLuint> zeros(glm::max(total, 1U), 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, lods);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * zeros.size(),
+                 zeros.data(), GL_DYNAMIC_COPY);
+  }
+
+  // the spheres, through the stream buffer
+  const GLsizeiptr bytes = sizeof(header) + sizeof(glm::vec4) * total;
+  GLintptr offset;
+  uint8_t *dst = (uint8_t *)stream_buf.map(bytes, storage_alignment(), &offset);
+  memcpy(dst, &header, sizeof(header));
+  glm::vec4 *spheres = (glm::vec4 *)(dst + sizeof(header));
+  for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+    const glm::vec3 *p = pos[t].data();
+    glm::vec4 *out = spheres + header.first[t];
+    const float r = radius[t];
+    jobs.parallel_for((uint32_t)pos[t].size(), 4096,
+                      [&](uint32_t begin, uint32_t end) {
+                        for (uint32_t i = begin; i < end; ++i)
+                          out[i] = glm::vec4(p[i], r);
+                      });
+  }
+  stream_buf.unmap();
+
+  tsamplr_t::storage_t uploaded = tsamplr_t::now();
+
+  // not tracked by gl_state: only this pass binds storage buffers
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, stream_buf.handle, offset,
+                    bytes);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commands);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, instances);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, lods);
+
+  if (total) {
+    const GLuint groups = (total + group_size - 1) / group_size;
+    program.use();
+    program.set(program.uniform("u_pass"), 0);
+    glext.dispatch_compute(groups, 1, 1);
+    // the second pass reads the counts and levels the first left
+    glext.memory_barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    program.set(program.uniform("u_pass"), 1);
+    glext.dispatch_compute(groups, 1, 1);
+  }
+  glext.memory_barrier(GL_COMMAND_BARRIER_BIT |
+                       GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                       GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  // keep this frame's counts, and read those of the oldest frame kept,
+  // which the GPU has most likely finished by now
+  const uint32_t slot = frame % frames_in_flight;
+  glBindBuffer(GL_COPY_READ_BUFFER, commands);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, counts[slot]);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                      sizeof(cmds.cmds));
+  fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  uint32_t visible = total;
+  *lod_stats = lod_stats_t();
+  if (++frame >= frames_in_flight) {
+    const uint32_t oldest = frame % frames_in_flight;
+    // glGetBufferSubData would wait on the copy without saying so: poll
+    // the fence, and only if the GPU is that far behind, wait on it
+    GLenum status = glClientWaitSync(fences[oldest], 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      status = glClientWaitSync(fences[oldest], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                GL_TIMEOUT_IGNORED);
+    if (status == GL_WAIT_FAILED) {
+      fprintf(stderr, "ERROR: failed to wait on a culling stats fence\n");
+      exit(1);
+    }
+    glDeleteSync(fences[oldest]);
+    fences[oldest] = 0;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, counts[oldest]);
+    const void *src = glMapBufferRange(GL_COPY_READ_BUFFER, 0,
+                                       sizeof(cmds.cmds), GL_MAP_READ_BIT);
+    if (!src) {
+      fprintf(stderr, "ERROR: failed to map culling stats buffer\n");
+      exit(1);
+    }
+    memcpy(cmds.cmds, src, sizeof(cmds.cmds));
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    visible = 0;
+    for (int t = 0; t < ENTITY_TYPE_COUNT; ++t)
+      for (uint32_t l = 0; l < max_lods; ++l) {
+        const draw_cmd_t &c = cmds.cmds[t * max_lods + l];
+        visible += c.instance_count;
+        lod_stats->instances[l] += c.instance_count;
+        lod_stats->triangles += (uint64_t)c.instance_count * (c.count / 3);
+      }
+  }
+
+  const tsamplr_t::storage_t end = tsamplr_t::now();
+  stats->objects = total;
+  stats->visible = glm::min(visible, total);
+  stats->culled = total - stats->visible;
+  stats->nodes_tested = 0;
+  stats->rebuilt = false;
+  stats->update_ms = tsamplr_t::convert(uploaded - start, tsamplr_t::_ms_);
+  stats->cull_ms = tsamplr_t::convert(end - uploaded, tsamplr_t::_ms_);
+}
@@ -4,6 +4,8 @@
 #include "base.h"
 #include <imgui.h>
 #include "gui.h"
+#include "gl-state.h"
+#include "stream-buffer.h"
 
 // GL3W/GLFW
 //#include <GL/gl3w.h>
@@ -25,7 +27,7 @@ static int g_ShaderHandle = 0, g_VertHandle = 0, g_FragHandle = 0;
 static int g_AttribLocationTex = 0, g_AttribLocationProjMtx = 0;
 static int g_AttribLocationPosition = 0, g_AttribLocationUV = 0,
            g_AttribLocationColor = 0;
-static unsigned int g_VboHandle = 0, g_VaoHandle = 0, g_ElementsHandle = 0;
+static unsigned int g_VaoHandle = 0;
 
 // This is the main rendering function that you have to implement and provide to
 // ImGui (via setting up 'RenderDrawListsFn' in the ImGuiIO structure)
@@ -33,24 +35,18 @@ static unsigned int g_VboHandle = 0, g_VaoHandle = 0, g_ElementsHandle = 0;
 // - in your Render function, try translating your projection matrix by
 // (0.5f,0.5f) or (0.375f,0.375f)
 void imgui_RenderDrawLists(ImDrawData *draw_data) {
-  // Backup GL state
-  GLint last_program, last_texture, last_array_buffer,
-      last_element_array_buffer, last_vertex_array;
-  glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-  glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
-  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
-  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &last_element_array_buffer);
-  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
+  // Backup GL state (from the shadow; no driver queries)
+  const gl_state_t::snapshot_t last_state = gl_state.save();
 
   // Setup render state: alpha-blending enabled, no face culling, no depth
   // testing, scissor enabled
-  glEnable(GL_BLEND);
-  glBlendEquation(GL_FUNC_ADD);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glDisable(GL_CULL_FACE);
-  glDisable(GL_DEPTH_TEST);
-  glEnable(GL_SCISSOR_TEST);
-  glActiveTexture(GL_TEXTURE0);
+  gl_state.enable(GL_BLEND);
+  gl_state.blend_equation(GL_FUNC_ADD);
+  gl_state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  gl_state.disable(GL_CULL_FACE);
+  gl_state.disable(GL_DEPTH_TEST);
+  gl_state.enable(GL_SCISSOR_TEST);
+  gl_state.active_texture(GL_TEXTURE0);
 
   // Handle cases of screen coordinates != from framebuffer coordinates (e.g.
   // retina displays)
@@ -65,49 +61,90 @@ void imgui_RenderDrawLists(ImDrawData *draw_data) {
     { 0.0f, 0.0f, -1.0f, 0.0f },
     { -1.0f, 1.0f, 0.0f, 1.0f },
   };
-  glUseProgram(g_ShaderHandle);
+  gl_state.use_program(g_ShaderHandle);
   glUniform1i(g_AttribLocationTex, 0);
   glUniformMatrix4fv(g_AttribLocationProjMtx, 1, GL_FALSE,
                      &ortho_projection[0][0]);
-  glBindVertexArray(g_VaoHandle);
+  // Copy every command list into the stream buffer at once. Each list's
+  // indices count from its own first vertex, so the draws pass that as
+  // their base vertex, which needs the vertices at a multiple of their
+  // size.
+  if (!draw_data->TotalVtxCount || !draw_data->TotalIdxCount) {
+    gl_state.restore(last_state);
+    return;
+  }
 
+  // one map() for both, with the indices after the vertices: a second
+  // map() could replace the buffer and leave the vertices in the old one
+  const GLsizeiptr vtx_bytes =
+      (GLsizeiptr)draw_data->TotalVtxCount * sizeof(ImDrawVert);
+  const GLsizeiptr idx_bytes =
+      (GLsizeiptr)draw_data->TotalIdxCount * sizeof(ImDrawIdx);
+  GLintptr vtx_offset;
+  uint8_t *dst = (uint8_t *)stream_buf.map(
+      vtx_bytes + sizeof(ImDrawIdx) - 1 + idx_bytes, sizeof(ImDrawVert),
+      &vtx_offset);
+  const GLintptr idx_offset = (vtx_offset + vtx_bytes + sizeof(ImDrawIdx) - 1) /
+                              sizeof(ImDrawIdx) * sizeof(ImDrawIdx);
+
+  ImDrawVert *vtx_dst = (ImDrawVert *)dst;
   for (int n = 0; n < draw_data->CmdListsCount; n++) {
     const ImDrawList *cmd_list = draw_data->CmdLists[n];
-    const ImDrawIdx *idx_buffer_offset = 0;
+    memcpy(vtx_dst, &cmd_list->VtxBuffer.front(),
+           cmd_list->VtxBuffer.size() * sizeof(ImDrawVert));
+    vtx_dst += cmd_list->VtxBuffer.size();
+  }
 
-    glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
-    glBufferData(GL_ARRAY_BUFFER,
-                 (GLsizeiptr)cmd_list->VtxBuffer.size() * sizeof(ImDrawVert),
-                 (GLvoid *)&cmd_list->VtxBuffer.front(), GL_STREAM_DRAW);
+  ImDrawIdx *idx_dst = (ImDrawIdx *)(dst + (idx_offset - vtx_offset));
+  for (int n = 0; n < draw_data->CmdListsCount; n++) {
+    const ImDrawList *cmd_list = draw_data->CmdLists[n];
+    memcpy(idx_dst, &cmd_list->IdxBuffer.front(),
+           cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx));
+    idx_dst += cmd_list->IdxBuffer.size();
+  }
+  stream_buf.unmap();
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 (GLsizeiptr)cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx),
-                 (GLvoid *)&cmd_list->IdxBuffer.front(), GL_STREAM_DRAW);
+  // the stream buffer may have been replaced since the last frame
+  gl_state.bind_vertex_array(g_VaoHandle);
+  gl_state.bind_buffer(GL_ARRAY_BUFFER, stream_buf.handle);
+  gl_state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, stream_buf.handle);
+#define OFFSETOF(TYPE, ELEMENT) ((size_t) & (((TYPE *)0)->ELEMENT))
+  glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE,
+                        sizeof(ImDrawVert),
+                        (GLvoid *)OFFSETOF(ImDrawVert, pos));
+  glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE,
+                        sizeof(ImDrawVert), (GLvoid *)OFFSETOF(ImDrawVert, uv));
+  glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                        sizeof(ImDrawVert),
+                        (GLvoid *)OFFSETOF(ImDrawVert, col));
+#undef OFFSETOF
+
+  GLint base_vertex = (GLint)(vtx_offset / sizeof(ImDrawVert));
+  const ImDrawIdx *idx_buffer_offset = (const ImDrawIdx *)idx_offset;
+  for (int n = 0; n < draw_data->CmdListsCount; n++) {
+    const ImDrawList *cmd_list = draw_data->CmdLists[n];
 
     for (const ImDrawCmd *pcmd = cmd_list->CmdBuffer.begin();
          pcmd != cmd_list->CmdBuffer.end(); pcmd++) {
       if (pcmd->UserCallback) {
         pcmd->UserCallback(cmd_list, pcmd);
       } else {
-        glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
+        gl_state.bind_texture(GL_TEXTURE_2D,
+                              (GLuint)(intptr_t)pcmd->TextureId);
         glScissor((int)pcmd->ClipRect.x, (int)(fb_height - pcmd->ClipRect.w),
                   (int)(pcmd->ClipRect.z - pcmd->ClipRect.x),
                   (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
-        glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount,
-                       GL_UNSIGNED_SHORT, idx_buffer_offset);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount,
+                                 GL_UNSIGNED_SHORT, (GLvoid *)idx_buffer_offset,
+                                 base_vertex);
       }
       idx_buffer_offset += pcmd->ElemCount;
     }
+    base_vertex += cmd_list->VtxBuffer.size();
   }
 
   // Restore modified GL state
-  glUseProgram(last_program);
-  glBindTexture(GL_TEXTURE_2D, last_texture);
-  glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, last_element_array_buffer);
-  glBindVertexArray(last_vertex_array);
-  glDisable(GL_SCISSOR_TEST);
+  gl_state.restore(last_state);
 }
 
 static const char *imgui_GetClipboardText() {
@@ -163,7 +200,7 @@ void imgui_CreateFontsTexture() {
 
   // Create OpenGL texture
   glGenTextures(1, &g_FontTexture);
-  glBindTexture(GL_TEXTURE_2D, g_FontTexture);
+  gl_state.bind_texture(GL_TEXTURE_2D, g_FontTexture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
@@ -179,10 +216,7 @@ void imgui_CreateFontsTexture() {
 
 bool imgui_CreateDeviceObjects() {
   // Backup GL state
-  GLint last_texture, last_array_buffer, last_vertex_array;
-  glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
-  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
-  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
+  const gl_state_t::snapshot_t last_state = gl_state.save();
 
   const GLchar *vertex_shader =
       "#version 330\n"
@@ -227,33 +261,18 @@ bool imgui_CreateDeviceObjects() {
   g_AttribLocationUV = glGetAttribLocation(g_ShaderHandle, "UV");
   g_AttribLocationColor = glGetAttribLocation(g_ShaderHandle, "Color");
 
-  glGenBuffers(1, &g_VboHandle);
-  glGenBuffers(1, &g_ElementsHandle);
-
+  // the vertices and indices are in the stream buffer, which is bound
+  // when drawing
   glGenVertexArrays(1, &g_VaoHandle);
-  glBindVertexArray(g_VaoHandle);
-  glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
+  gl_state.bind_vertex_array(g_VaoHandle);
   glEnableVertexAttribArray(g_AttribLocationPosition);
   glEnableVertexAttribArray(g_AttribLocationUV);
   glEnableVertexAttribArray(g_AttribLocationColor);
 
-#define OFFSETOF(TYPE, ELEMENT) ((size_t) & (((TYPE *)0)->ELEMENT))
-  glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE,
-                        sizeof(ImDrawVert),
-                        (GLvoid *)OFFSETOF(ImDrawVert, pos));
-  glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE,
-                        sizeof(ImDrawVert), (GLvoid *)OFFSETOF(ImDrawVert, uv));
-  glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,
-                        sizeof(ImDrawVert),
-                        (GLvoid *)OFFSETOF(ImDrawVert, col));
-#undef OFFSETOF
-
   imgui_CreateFontsTexture();
 
   // Restore modified GL state
-  glBindTexture(GL_TEXTURE_2D, last_texture);
-  glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
-  glBindVertexArray(last_vertex_array);
+  gl_state.restore(last_state);
 
   return true;
 }
@@ -306,12 +325,8 @@ bool imgui_init(GLFWwindow *window, bool install_callbacks) {
 
 void imgui_shutdown() {
   if (g_VaoHandle)
-    glDeleteVertexArrays(1, &g_VaoHandle);
-  if (g_VboHandle)
-    glDeleteBuffers(1, &g_VboHandle);
-  if (g_ElementsHandle)
-    glDeleteBuffers(1, &g_ElementsHandle);
-  g_VaoHandle = g_VboHandle = g_ElementsHandle = 0;
+    gl_state.delete_vertex_arrays(1, &g_VaoHandle);
+  g_VaoHandle = 0;
 
   glDetachShader(g_ShaderHandle, g_VertHandle);
   glDeleteShader(g_VertHandle);
@@ -321,11 +336,11 @@ void imgui_shutdown() {
   glDeleteShader(g_FragHandle);
   g_FragHandle = 0;
 
-  glDeleteProgram(g_ShaderHandle);
+  gl_state.delete_program(g_ShaderHandle);
   g_ShaderHandle = 0;
 
   if (g_FontTexture) {
-    glDeleteTextures(1, &g_FontTexture);
+    gl_state.delete_textures(1, &g_FontTexture);
     ImGui::GetIO().Fonts->TexID = 0;
     g_FontTexture = 0;
   }
@@ -0,0 +1,165 @@
+#include "headless.h"
+#include "gl-ext.h"
+#include "gl-state.h"
+
+#include <cprintf/cprintf.hpp>
+
+#if HAVE_EGL
+// keep eglplatform.h from pulling in Xlib
+#define EGL_NO_X11 1
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+
+static void *egl_proc(const char *name) {
+  return (void *)eglGetProcAddress(name);
+}
+
+static bool egl_init(void) {
+  // the surfaceless platform needs no window system at all; fall back to
+  // the default display where it is not available
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+          "eglGetPlatformDisplayEXT");
+  if (get_platform_display)
+    egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                       EGL_DEFAULT_DISPLAY, NULL);
+  if (egl_display == EGL_NO_DISPLAY)
+    egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major = 0, minor = 0;
+  if (egl_display == EGL_NO_DISPLAY ||
+      !eglInitialize(egl_display, &major, &minor)) {
+    cprintf(L"$y*WARNING$?: no EGL display: 0x%x\n", eglGetError());
+    egl_display = EGL_NO_DISPLAY;
+    return false;
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    cprintf(L"$y*WARNING$?: EGL has no desktop OpenGL\n");
+    eglTerminate(egl_display);
+    egl_display = EGL_NO_DISPLAY;
+    return false;
+  }
+
+  // we only ever render into framebuffer objects, so any config will do,
+  // or none where configless contexts are supported
+  const EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                   EGL_NONE};
+  EGLConfig config = (EGLConfig)0;
+  EGLint num_configs = 0;
+  eglChooseConfig(egl_display, config_attribs, &config, 1, &num_configs);
+  if (!num_configs)
+    config = (EGLConfig)0; // EGL_NO_CONFIG_KHR
+
+  const EGLint context_attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION, 3,
+      EGL_CONTEXT_MINOR_VERSION, 3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE};
+  egl_context =
+      eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+  if (egl_context == EGL_NO_CONTEXT ||
+      !eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                      egl_context)) {
+    cprintf(L"$y*WARNING$?: failed to create a surfaceless EGL context: "
+            L"0x%x\n",
+            eglGetError());
+    if (egl_context != EGL_NO_CONTEXT)
+      eglDestroyContext(egl_display, egl_context);
+    egl_context = EGL_NO_CONTEXT;
+    eglTerminate(egl_display);
+    egl_display = EGL_NO_DISPLAY;
+    return false;
+  }
+
+  cprintf(L"EGL $c*%d.%d$? surfaceless context\n", major, minor);
+  gladLoadGLLoader((GLADloadproc)egl_proc);
+  glext_load((GLADloadproc)egl_proc);
+  return true;
+}
+
+static void egl_teardown(void) {
+  if (egl_display == EGL_NO_DISPLAY)
+    return;
+
+  eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                 EGL_NO_CONTEXT);
+  eglDestroyContext(egl_display, egl_context);
+  eglTerminate(egl_display);
+  egl_context = EGL_NO_CONTEXT;
+  egl_display = EGL_NO_DISPLAY;
+}
+#endif // HAVE_EGL
+
+static bool glfw_hidden_init(void) {
+  if (!glfwInit())
+    return false;
+
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+  window = glfwCreateWindow(window_width, window_height, APP_NAME, NULL, NULL);
+  if (!window)
+    return false;
+
+  glfwMakeContextCurrent(window);
+  cprintf(L"hidden GLFW window context\n");
+  gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+  glext_load((GLADloadproc)glfwGetProcAddress);
+  return true;
+}
+
+bool headless_init(void) {
+#if HAVE_EGL
+  if (egl_init())
+    return true;
+#endif
+  return glfw_hidden_init();
+}
+
+void headless_teardown(void) {
+#if HAVE_EGL
+  egl_teardown();
+#endif
+}
+
+void offscreen_target_t::init(int width, int height) {
+  this->width = width;
+  this->height = height;
+
+  glGenRenderbuffers(1, &colour);
+  glBindRenderbuffer(GL_RENDERBUFFER, colour);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &fbo);
+  gl_state.bind_framebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, colour);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth);
+
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "ERROR: offscreen framebuffer incomplete: 0x%x\n", status);
+    exit(1);
+  }
+}
+
+void offscreen_target_t::teardown(void) {
+  gl_state.delete_framebuffers(1, &fbo);
+  glDeleteRenderbuffers(1, &colour);
+  glDeleteRenderbuffers(1, &depth);
+  fbo = colour = depth = 0;
+}
@@ -0,0 +1,235 @@
+#include "integrator.h"
+
+// SSE2 is part of x86-64; 32-bit x86 builds only get the SSE paths when
+// built for it (-msse2, /arch:SSE2), as they carry no target attribute
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) ||             \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INTEGRATOR_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define INTEGRATOR_X86 0
+#endif
+
+// per-function instruction set selection, so that the rest of the program
+// is still built for the baseline target
+#if INTEGRATOR_X86 && defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+static const float fgrav = -9.8f;
+static const float fnorm = -fgrav;
+
+// when a sphere is in contact with a plane L (the positive side)
+// The distance from the centre of the sphere P to the plane in the
+// length of the radius
+// L.P = r (writing L as a 4D vector L = <N, D>)
+// The relationship L.P can be written as:
+// N.P + D = r <=> N.P + (D-r) = 0
+// This is the same as saying point P lies on the plane L' given by:
+// L' = <N, D-r>
+// The plane L' is parallel to L. With the ground plane N = <0, 1, 0> so
+// N.P reduces to P.y, and if L.P >= r then there is no colision
+static const float radius = 1.0f;
+static const float plane_diff = (0.0f - radius);
+
+static simd_level_t active_level = SIMD_LEVEL_COUNT; // i.e. not yet chosen
+
+simd_level_t simd_detect(void) {
+  static simd_level_t detected = SIMD_LEVEL_COUNT;
+  if (detected != SIMD_LEVEL_COUNT)
+    return detected;
+
+  detected = SIMD_SCALAR;
+#if INTEGRATOR_X86
+#if defined(__GNUC__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    detected = SIMD_SSE;
+  if (__builtin_cpu_supports("avx2"))
+    detected = SIMD_AVX2;
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  if (info[3] & (1 << 26))
+    detected = SIMD_SSE;
+  // AVX2 needs the OS to save the ymm registers (OSXSAVE + XCR0)
+  bool os_avx = (info[2] & (1 << 27)) && ((_xgetbv(0) & 6) == 6);
+  __cpuidex(info, 7, 0);
+  if (os_avx && (info[1] & (1 << 5)))
+    detected = SIMD_AVX2;
+#endif
+#endif
+  return detected;
+}
+
+const char *simd_name(simd_level_t level) {
+  switch (level) {
+  case SIMD_SCALAR:
+    return "scalar";
+  case SIMD_SSE:
+    return "sse";
+  case SIMD_AVX2:
+    return "avx2";
+  default:
+    return "unknown";
+  }
+}
+
+void simd_set_level(simd_level_t level) {
+  active_level = level < simd_detect() ? level : simd_detect();
+}
+
+simd_level_t simd_get_level(void) {
+  if (active_level == SIMD_LEVEL_COUNT)
+    active_level = simd_detect();
+  return active_level;
+}
+
+// the reference path; the vector paths mirror it operation for operation
+// so that their results are bitwise equal
+static void integrate_scalar(entity_block_t *blk, float dt, uint32_t begin,
+                             uint32_t end) {
+  float *px = blk->pos_x.data(), *py = blk->pos_y.data(),
+        *pz = blk->pos_z.data();
+  float *vx = blk->vel_x.data(), *vy = blk->vel_y.data(),
+        *vz = blk->vel_z.data();
+  const float *m = blk->mass.data();
+
+  for (uint32_t i = begin; i < end; ++i) {
+    // sum forces (gravity and the ground's normal force act along y only)
+    float force = fgrav;
+    if ((py[i] + plane_diff) < radius)
+      force += fnorm;
+
+    const float accl = force / m[i];
+
+    vx[i] = vx[i] * dt;
+    vy[i] = (vy[i] + accl) * dt;
+    vz[i] = vz[i] * dt;
+
+    px[i] += vx[i] * dt;
+    py[i] += vy[i] * dt;
+    pz[i] += vz[i] * dt;
+  }
+}
+
+#if INTEGRATOR_X86
+static void integrate_sse(entity_block_t *blk, float dt, uint32_t begin,
+                          uint32_t end) {
+  float *px = blk->pos_x.data(), *py = blk->pos_y.data(),
+        *pz = blk->pos_z.data();
+  float *vx = blk->vel_x.data(), *vy = blk->vel_y.data(),
+        *vz = blk->vel_z.data();
+  const float *m = blk->mass.data();
+
+  const __m128 v_dt = _mm_set1_ps(dt);
+  const __m128 v_grav = _mm_set1_ps(fgrav);
+  const __m128 v_norm = _mm_set1_ps(fnorm);
+  const __m128 v_diff = _mm_set1_ps(plane_diff);
+  const __m128 v_radius = _mm_set1_ps(radius);
+
+  uint32_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    __m128 y = _mm_loadu_ps(py + i);
+
+    // the normal force only where the sphere touches the ground
+    __m128 contact = _mm_cmplt_ps(_mm_add_ps(y, v_diff), v_radius);
+    __m128 force = _mm_add_ps(v_grav, _mm_and_ps(contact, v_norm));
+    __m128 accl = _mm_div_ps(force, _mm_loadu_ps(m + i));
+
+    __m128 vel_x = _mm_mul_ps(_mm_loadu_ps(vx + i), v_dt);
+    __m128 vel_y = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vy + i), accl), v_dt);
+    __m128 vel_z = _mm_mul_ps(_mm_loadu_ps(vz + i), v_dt);
+
+    _mm_storeu_ps(vx + i, vel_x);
+    _mm_storeu_ps(vy + i, vel_y);
+    _mm_storeu_ps(vz + i, vel_z);
+
+    _mm_storeu_ps(px + i,
+                  _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(vel_x, v_dt)));
+    _mm_storeu_ps(py + i, _mm_add_ps(y, _mm_mul_ps(vel_y, v_dt)));
+    _mm_storeu_ps(pz + i,
+                  _mm_add_ps(_mm_loadu_ps(pz + i), _mm_mul_ps(vel_z, v_dt)));
+  }
+
+  integrate_scalar(blk, dt, i, end);
+}
+
+TARGET_AVX2 static void integrate_avx2(entity_block_t *blk, float dt,
+                                       uint32_t begin, uint32_t end) {
+  float *px = blk->pos_x.data(), *py = blk->pos_y.data(),
+        *pz = blk->pos_z.data();
+  float *vx = blk->vel_x.data(), *vy = blk->vel_y.data(),
+        *vz = blk->vel_z.data();
+  const float *m = blk->mass.data();
+
+  const __m256 v_dt = _mm256_set1_ps(dt);
+  const __m256 v_grav = _mm256_set1_ps(fgrav);
+  const __m256 v_norm = _mm256_set1_ps(fnorm);
+  const __m256 v_diff = _mm256_set1_ps(plane_diff);
+  const __m256 v_radius = _mm256_set1_ps(radius);
+
+  // no fused multiply-adds here: they would round differently from the
+  // scalar reference
+  uint32_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 y = _mm256_loadu_ps(py + i);
+
+    __m256 contact =
+        _mm256_cmp_ps(_mm256_add_ps(y, v_diff), v_radius, _CMP_LT_OQ);
+    __m256 force = _mm256_add_ps(v_grav, _mm256_and_ps(contact, v_norm));
+    __m256 accl = _mm256_div_ps(force, _mm256_loadu_ps(m + i));
+
+    __m256 vel_x = _mm256_mul_ps(_mm256_loadu_ps(vx + i), v_dt);
+    __m256 vel_y =
+        _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(vy + i), accl), v_dt);
+    __m256 vel_z = _mm256_mul_ps(_mm256_loadu_ps(vz + i), v_dt);
+
+    _mm256_storeu_ps(vx + i, vel_x);
+    _mm256_storeu_ps(vy + i, vel_y);
+    _mm256_storeu_ps(vz + i, vel_z);
+
+    _mm256_storeu_ps(px + i, _mm256_add_ps(_mm256_loadu_ps(px + i),
+                                           _mm256_mul_ps(vel_x, v_dt)));
+    _mm256_storeu_ps(py + i, _mm256_add_ps(y, _mm256_mul_ps(vel_y, v_dt)));
+    _mm256_storeu_ps(pz + i, _mm256_add_ps(_mm256_loadu_ps(pz + i),
+                                           _mm256_mul_ps(vel_z, v_dt)));
+  }
+
+  integrate_sse(blk, dt, i, end);
+}
+#endif
+
+void integrate_spheres_with(simd_level_t level, entity_block_t *blk, float dt,
+                            uint32_t begin, uint32_t end) {
+  assert(end <= blk->size() && "Invalid entity range!");
+
+  switch (level < simd_detect() ? level : simd_detect()) {
+#if INTEGRATOR_X86
+  case SIMD_AVX2:
+    integrate_avx2(blk, dt, begin, end);
+    break;
+  case SIMD_SSE:
+    integrate_sse(blk, dt, begin, end);
+    break;
+#endif
+  default:
+    integrate_scalar(blk, dt, begin, end);
+    break;
+  }
+
+  // sphere model matrices are pure translations
+  for (uint32_t i = begin; i < end; ++i)
+    blk->model[i][3] = glm::vec4(blk->pos_x[i], blk->pos_y[i], blk->pos_z[i],
+                                 1.0f);
+}
+
+void integrate_spheres(entity_block_t *blk, float dt, uint32_t begin,
+                       uint32_t end) {
+  integrate_spheres_with(simd_get_level(), blk, dt, begin, end);
+}
@@ -0,0 +1,167 @@
+#include "jobs.h"
+#include "trace.h"
+
+job_system_t jobs;
+
+// index of the calling thread's queue if it is a worker, otherwise -1
+static thread_local int worker_index = -1;
+
+void job_system_t::init(uint32_t num_workers) {
+  assert(workers.empty() && "Job system is already running!");
+
+  if (num_workers == auto_workers) {
+    uint32_t hw = std::thread::hardware_concurrency();
+    num_workers = hw > 1 ? hw - 1 : 0;
+  }
+
+  stopping = false;
+  queued = 0;
+
+  queues.clear();
+  for (uint32_t q = 0; q < num_workers + 1; ++q)
+    queues.push_back(std::unique_ptr<queue_t>(new queue_t));
+
+  for (uint32_t w = 0; w < num_workers; ++w)
+    workers.push_back(std::thread(&job_system_t::worker_main, this, w));
+}
+
+void job_system_t::teardown(void) {
+  {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (std::thread &t : workers)
+    t.join();
+  workers.clear();
+  queues.clear();
+}
+
+uint32_t job_system_t::own_queue(void) const {
+  return worker_index >= 0 ? (uint32_t)worker_index
+                           : (uint32_t)queues.size() - 1;
+}
+
+bool job_system_t::pop(uint32_t q, task_t *t) {
+  queue_t &queue = *queues[q];
+  std::lock_guard<std::mutex> guard(queue.lock);
+  if (queue.tasks.empty())
+    return false;
+
+  *t = queue.tasks.back();
+  queue.tasks.pop_back();
+  queued--;
+  return true;
+}
+
+// the newest task of "batch" still in queue "q"; the batch's other tasks
+// were stolen, so they are not in any other queue
+bool job_system_t::pop_batch(uint32_t q, const batch_t *batch, task_t *t) {
+  queue_t &queue = *queues[q];
+  std::lock_guard<std::mutex> guard(queue.lock);
+  for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it) {
+    if (it->batch != batch)
+      continue;
+    *t = *it;
+    queue.tasks.erase(std::next(it).base());
+    queued--;
+    return true;
+  }
+  return false;
+}
+
+bool job_system_t::steal(uint32_t thief, task_t *t) {
+  const uint32_t n = (uint32_t)queues.size();
+  for (uint32_t k = 1; k < n; ++k) {
+    queue_t &victim = *queues[(thief + k) % n];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (victim.tasks.empty())
+      continue;
+
+    *t = victim.tasks.front();
+    victim.tasks.pop_front();
+    queued--;
+    return true;
+  }
+  return false;
+}
+
+void job_system_t::execute(const task_t &t) {
+  TRACE_SCOPE("job");
+  batch_t *b = t.batch;
+  (*b->fn)(t.begin, t.end);
+  if (b->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    std::lock_guard<std::mutex> guard(b->lock);
+    b->done = true;
+    b->finished.notify_all();
+  }
+}
+
+void job_system_t::worker_main(uint32_t index) {
+  worker_index = (int)index;
+  if (trace.active())
+    trace.name_thread("worker");
+
+  while (true) {
+    task_t t;
+    if (pop(index, &t) || steal(index, &t)) {
+      execute(t);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(sleep_lock);
+    wake.wait(guard, [this](void) { return stopping || queued > 0; });
+    if (stopping)
+      break;
+  }
+
+  worker_index = -1;
+}
+
+void job_system_t::parallel_for(uint32_t count, uint32_t grain,
+                                const range_fn_t &fn) {
+  if (!count)
+    return;
+  if (!grain)
+    grain = count;
+
+  // nothing to share it with
+  if (workers.empty() || count <= grain) {
+    for (uint32_t begin = 0; begin < count; begin += grain)
+      fn(begin, glm::min(begin + grain, count));
+    return;
+  }
+
+  const uint32_t chunks = (count + grain - 1) / grain;
+  batch_t batch;
+  batch.fn = &fn;
+  batch.remaining = chunks;
+  batch.done = false;
+
+  const uint32_t q = own_queue();
+  {
+    queue_t &queue = *queues[q];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    // pushed last-to-first so that popping from the back runs the chunks
+    // roughly in order
+    for (uint32_t c = chunks; c-- > 0;) {
+      task_t t = {&batch, c * grain, glm::min((c + 1) * grain, count)};
+      queue.tasks.push_back(t);
+    }
+    queued += chunks;
+  }
+  {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+  }
+  wake.notify_all();
+
+  // run what is left of our chunks, then wait for those taken by others.
+  // Other callers' tasks, in the queue non-workers share, are left alone.
+  task_t t;
+  while (pop_batch(q, &batch, &t))
+    execute(t);
+
+  std::unique_lock<std::mutex> guard(batch.lock);
+  batch.finished.wait(guard, [&batch](void) { return batch.done; });
+}
@@ -0,0 +1,92 @@
+#include "lod.h"
+#include "jobs.h"
+
+// coarsen only once the coarser level's error is this fraction of the
+// tolerance
+static const float default_hysteresis = 0.75f;
+
+void lod_view_t::setup(const camera_t &c, float height, float tolerance) {
+  eye = c.get_pos();
+  // proj[1][1] is the cotangent of half the vertical field of view
+  px_per_unit = c.get_proj()[1][1] * height * 0.5f;
+  this->tolerance = tolerance;
+  hysteresis = default_hysteresis;
+}
+
+// position "i" of "view", in mesh space
+static glm::vec3 view_pos(const mesh_view_t &view, uint32_t i) {
+  if (view.layout != VTX_LAYOUT_PACKED)
+    return ((const glm::vec3 *)view.vtx)[i];
+  const packed_vtx_t &v = ((const packed_vtx_t *)view.vtx)[i];
+  return glm::vec3(v.pos[0], v.pos[1], v.pos[2]) *
+             glm::vec3(view.decode.scale) +
+         glm::vec3(view.decode.bias);
+}
+
+static uint32_t view_idx(const mesh_view_t &view, uint32_t i) {
+  if (!view.idx_count)
+    return i;
+  return view.idx_size == sizeof(uint16_t) ? ((const uint16_t *)view.idx)[i]
+                                           : ((const uint32_t *)view.idx)[i];
+}
+
+float tessellation_error(const mesh_view_t &view) {
+  if (!view.vtx_count)
+    return 0.0f;
+
+  glm::vec3 lo = view_pos(view, 0), hi = lo;
+  for (uint32_t i = 1; i < view.vtx_count; ++i) {
+    const glm::vec3 p = view_pos(view, i);
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+  const glm::vec3 centre = (lo + hi) * 0.5f;
+  float radius = 0.0f;
+  for (uint32_t i = 0; i < view.vtx_count; ++i)
+    radius = glm::max(radius, glm::length(view_pos(view, i) - centre));
+
+  const uint32_t n = view.idx_count ? view.idx_count : view.vtx_count;
+  double edges = 0.0;
+  uint32_t edge_count = 0;
+  for (uint32_t i = 0; i + 2 < n; i += 3) {
+    const glm::vec3 a = view_pos(view, view_idx(view, i)),
+                    b = view_pos(view, view_idx(view, i + 1)),
+                    c = view_pos(view, view_idx(view, i + 2));
+    edges += glm::length(b - a) + glm::length(c - b) + glm::length(a - c);
+    edge_count += 3;
+  }
+  if (!edge_count || radius <= 0.0f)
+    return 0.0f;
+
+  // the sagitta of a chord of that length on the bounding sphere
+  const float edge = (float)(edges / edge_count);
+  return edge * edge / (8.0f * radius);
+}
+
+void select_lods(const lod_view_t &view, const lod_chain_t &chain,
+                 float radius, const glm::vec3 *pos, const uint32_t *idx,
+                 uint32_t count, uint8_t *lods) {
+  if (chain.count < 2 || view.tolerance <= 0.0f) {
+    for (uint32_t i = 0; i < count; ++i)
+      lods[idx[i]] = 0;
+    return;
+  }
+
+  const float coarsen = view.tolerance * view.hysteresis;
+  jobs.parallel_for(count, 4096, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i) {
+      const uint32_t j = idx[i];
+      // pixels per unit of error at the nearest point of the bounds
+      const float dist =
+          glm::max(glm::length(pos[j] - view.eye) - radius, 1e-3f);
+      const float px = view.px_per_unit / dist;
+
+      uint32_t l = glm::min((uint32_t)lods[j], chain.count - 1);
+      while (l > 0 && chain.error[l] * px > view.tolerance)
+        --l;
+      while (l + 1 < chain.count && chain.error[l + 1] * px < coarsen)
+        ++l;
+      lods[j] = (uint8_t)l;
+    }
+  });
+}
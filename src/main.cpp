@@ -5,6 +5,20 @@
 #include "ocl.h"
 #include "nullspace.h"
 #include "demo.h"
+#include "gl-ext.h"
+#include "options.h"
+#include "bench.h"
+#include "integrator.h"
+#include "jobs.h"
+#include "headless.h"
+#include "readback.h"
+#include "capture.h"
+#include "gl-state.h"
+#include "stream-buffer.h"
+#include "uniform-blocks.h"
+#include "profiler.h"
+#include "trace.h"
+#include "frame-report.h"
 
 #include <cprintf/cprintf.hpp>
 
@@ -23,6 +37,9 @@ bool gui_enabled = false;
 // handle for the demo application
 demo_app_t demo = {};
 
+// frame capture, when asked for with --capture
+static capture_t capture;
+
 // In case a GLFW function fails, an error is reported to the
 // GLFW error callback
 static void pfn_glfw_err_cb(int error, const char *description) {
@@ -47,6 +64,12 @@ static void pfn_glfw_key_cb(GLFWwindow *window, int key, int scancode,
     return;
   }
 
+  // what has been recorded so far; the trace keeps recording
+  if (key == GLFW_KEY_T && action == GLFW_PRESS && opts.trace) {
+    trace.dump(opts.trace);
+    return;
+  }
+
   cam.process_input(key, scancode, action, mods);
 
   demo.input(key, scancode, action, mods);
@@ -95,7 +118,9 @@ GLuint create_shader(GLenum type, const char *src) {
 
   if (!shader_ok) {
     fprintf(stderr, "ERROR: Failed to compile %s shader\n",
-            (type == GL_FRAGMENT_SHADER) ? "fragment" : "vertex");
+            (type == GL_FRAGMENT_SHADER)
+                ? "fragment"
+                : (type == GL_COMPUTE_SHADER ? "compute" : "vertex"));
 
     glGetShaderInfoLog(shader, 8192, &log_length, info_log);
     fprintf(stderr, "BUILD LOG: \n%s\n\n", info_log);
@@ -135,9 +160,8 @@ GLuint create_shader_program(int32_t shader_count, ...) {
   return program;
 }
 
-void setup(int argc, char const *argv[]) {
-  cprintf(L"$c*`begin$? program setup\n");
-
+// visible window with input, compute and gui
+static void setup_window(void) {
   glfwSetErrorCallback(pfn_glfw_err_cb);
 
   if (!glfwInit())
@@ -167,6 +191,7 @@ void setup(int argc, char const *argv[]) {
   }
   // load fucntion pointers
   gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+  glext_load((GLADloadproc)glfwGetProcAddress);
 
   // how often we swap render buffers i.e. front and back buffers upon
   // invoking a swap-buffers command
@@ -216,11 +241,37 @@ void setup(int argc, char const *argv[]) {
   // io.Fonts->AddFontFromFileTTF("../../extra_fonts/DroidSans.ttf", 18.0f);
   // io.Fonts->AddFontFromFileTTF("../../extra_fonts/fontawesome-webfont.ttf",
   // 18.0f, &icons_config, icons_ranges);
+}
+
+void setup(int argc, char const *argv[]) {
+  TRACE_SCOPE("setup");
+  cprintf(L"$c*`begin$? program setup\n");
+
+  if (opts.headless) {
+    window_width = opts.width;
+    window_height = opts.height;
+    if (!headless_init()) {
+      cprintf<CPF_STDE>(L"$r*FATAL ERROR$?: no headless GL context\n");
+      abort();
+    }
+  } else
+    setup_window();
+
+  cprintf(L"GL $c*%s$? on $c*%s$?\n", (const char *)glGetString(GL_VERSION),
+          (const char *)glGetString(GL_RENDERER));
+
+  // a new context is in its default state
+  gl_state.reset();
+  profiler.init();
+
+  stream_buf.init(1 << 20, opts.persistent_map);
+  cprintf(L"per-frame data streamed through $c*%s$? buffer maps\n",
+          stream_buf.is_persistent() ? "persistent" : "unsynchronised");
 
   glViewport(0, 0, window_width, window_height);
   glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
 
-  glEnable(GL_DEPTH_TEST);
+  gl_state.enable(GL_DEPTH_TEST);
 #if ENABLE_NULLSPACE
   nullspace_init();
 #endif
@@ -248,12 +299,25 @@ void teardown() {
   nullspace_teardown();
 #endif
 
-  imgui_shutdown();
+  stream_buf.teardown();
+  profiler.teardown();
 
-  compute_teardown();
+  if (!opts.headless) {
+    imgui_shutdown();
+    compute_teardown();
+  }
+
+  jobs.teardown();
+
+  // every other thread has stopped recording by now
+  if (opts.trace) {
+    trace.stop();
+    trace.dump(opts.trace);
+  }
 
   if (window)
     glfwDestroyWindow(window);
+  headless_teardown();
 
   // destroys any remaining windows and releases any other
   // resources allocated by GLFW
@@ -269,7 +333,6 @@ void imgui_update(void) {
       glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     return;
   }
-  bool show_test_window = true;
   bool show_another_window = false;
   ImVec4 clear_color = ImColor(114, 144, 154);
 
@@ -283,12 +346,20 @@ void imgui_update(void) {
     ImGui::Text("Hello, world!");
     ImGui::SliderFloat("float", &f, 0.0f, 1.0f);
     ImGui::ColorEdit3("clear color", (float *)&clear_color);
-    if (ImGui::Button("Test Window"))
-      show_test_window ^= 1;
     if (ImGui::Button("Another Window"))
       show_another_window ^= 1;
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("Culled %u of %u objects (%u boxes tested) in %.3f ms, "
+                "%s in %.3f ms",
+                demo.cull_stats.culled, demo.cull_stats.objects,
+                demo.cull_stats.nodes_tested, demo.cull_stats.cull_ms,
+                demo.cull_stats.rebuilt ? "rebuilt" : "refitted",
+                demo.cull_stats.update_ms);
+    ImGui::Text("Levels of detail: %u %u %u %u objects, %llu triangles",
+                demo.lod_stats.instances[0], demo.lod_stats.instances[1],
+                demo.lod_stats.instances[2], demo.lod_stats.instances[3],
+                (unsigned long long)demo.lod_stats.triangles);
   }
 
   // 2. Show another simple window, this time using an explicit Begin/End pair
@@ -299,12 +370,12 @@ void imgui_update(void) {
     ImGui::End();
   }
 
-  // 3. Show the ImGui test window. Most of the sample code is in
-  // ImGui::ShowTestWindow()
-  if (show_test_window) {
-    ImGui::SetNextWindowPos(ImVec2(650, 20), ImGuiSetCond_FirstUseEver);
-    ImGui::ShowTestWindow(&show_test_window);
-  }
+  // 3. Show where the time of a frame goes
+  ImGui::SetNextWindowPos(ImVec2(650, 20), ImGuiSetCond_FirstUseEver);
+  ImGui::SetNextWindowSize(ImVec2(500, 300), ImGuiSetCond_FirstUseEver);
+  ImGui::Begin("Profiler");
+  profiler.draw_panel();
+  ImGui::End();
 }
 
 void imgui_render(void) {
@@ -317,34 +388,298 @@ void imgui_render(void) {
 void run(void) {
   tsamplr_t time_sampler(NULL);
   float dt = 0.0f;
+  uint64_t frame = 0;
+
+  if (opts.capture) {
+    int w, h;
+    glfwGetFramebufferSize(window, &w, &h);
+    if (!capture.init(opts.capture, w, h, opts.capture_fps, false))
+      exit(1);
+  }
 
   while (executing) {
     time_sampler.sample();
     dt = time_sampler.get_dt(tsamplr_t::_s_);
+    profiler.begin_frame();
 
     // update ...
-    imgui_update();
-    cam.apply(dt);
-    demo.update(dt);
+    {
+      PROFILE_SCOPE("update");
+      {
+        PROFILE_SCOPE("imgui update");
+        imgui_update();
+      }
+      cam.apply(dt);
+      demo.update(dt);
+    }
 
     // render
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     {
-      imgui_render();
-
+      PROFILE_SCOPE("render");
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      upload_camera_block(cam);
+      {
+        PROFILE_SCOPE("imgui");
+        PROFILE_GPU_SCOPE("imgui");
+        imgui_render();
+      }
 #if ENABLE_NULLSPACE
-      nullspace_render();
+      {
+        PROFILE_SCOPE("nullspace");
+        PROFILE_GPU_SCOPE("nullspace");
+        nullspace_render();
+      }
 #endif
-      demo.render();
+      {
+        PROFILE_SCOPE("demo");
+        PROFILE_GPU_SCOPE("demo");
+        demo.render();
+      }
+      stream_buf.end_frame();
     }
-    glfwSwapBuffers(window);
+
+    // the back buffer is undefined once swapped, so the readback is issued
+    // first; finished ones are picked up after the swap
+    {
+      PROFILE_SCOPE("present");
+      if (capture.active())
+        capture.grab(frame);
+      glfwSwapBuffers(window);
+      if (capture.active())
+        capture.poll();
+    }
+    ++frame;
+
     glfwPollEvents();
+    profiler.end_frame();
+  }
+
+  capture.teardown();
+}
+
+// Render opts.headless frames into an offscreen target, reading each back
+// through a PBO ring. Frames advance by a fixed step, so a given build and
+// GL implementation always produces the same images; their hash is
+// printed for comparison between runs.
+void run_headless(void) {
+  const float dt = opts.frame_dt;
+  const uint32_t frames = (uint32_t)opts.headless;
+
+  // for a report, the camera follows the scripted path, far enough out to
+  // see the whole scene at times, and the first frames, while caches and
+  // the driver warm up, are left out of it
+  const bool scripted = opts.report || opts.baseline;
+  const float path_radius = glm::max(16.72f, 1.2f * demo.extent);
+  frame_report_t report;
+  report.warmup = glm::min(frames / 10, 10U);
+
+  // the GPU times of the frames read since the last call, in order
+  uint64_t gpu_next = report.warmup;
+  auto collect_gpu_ms = [&](void) {
+    const profiler_t::frame_t *timed = profiler.latest();
+    for (; timed && gpu_next <= timed->index; ++gpu_next) {
+      const profiler_t::frame_t *f = profiler.frame(gpu_next);
+      if (f && f->gpu_valid)
+        report.gpu_ms.push_back(f->gpu_ms());
+      else
+        report.gpu_dropped++;
+    }
+  };
+
+  offscreen_target_t target;
+  target.init(window_width, window_height);
+
+  readback_t readback;
+  readback.init(window_width, window_height, 3);
+
+  // batch jobs want every frame, however long writing them takes
+  if (opts.capture && !capture.init(opts.capture, window_width, window_height,
+                                    opts.capture_fps, true))
+    exit(1);
+
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a
+  double latency_ms = 0.0, max_latency_ms = 0.0;
+  uint32_t collected = 0;
+
+  // culling, summed over the frames
+  uint64_t culled = 0, rebuilds = 0;
+  double update_ms = 0.0, cull_ms = 0.0;
+  // and the levels of detail drawn
+  uint64_t lod_instances[max_lods] = {}, triangles = 0;
+
+  readback_t::sink_fn_t sink = [&](const uint8_t *rgba, uint64_t frame,
+                                   tsamplr_t::storage_t issued) {
+    const double ms =
+        tsamplr_t::convert(tsamplr_t::now() - issued, tsamplr_t::_ms_);
+    latency_ms += ms;
+    max_latency_ms = glm::max(max_latency_ms, ms);
+
+    assert(frame == collected && "Frames read back out of order!");
+    for (uint32_t i = 0; i < readback.frame_bytes(); ++i)
+      hash = (hash ^ rgba[i]) * 1099511628211ULL;
+    ++collected;
+
+    // every frame is read back for the hash already; capture that copy
+    if (capture.active())
+      capture.submit(rgba, frame, issued);
+  };
+
+  tsamplr_t::storage_t start = tsamplr_t::now();
+
+  gl_state.bind_framebuffer(GL_FRAMEBUFFER, target.fbo);
+  for (uint32_t f = 0; f < frames; ++f) {
+    const tsamplr_t::storage_t frame_start = tsamplr_t::now();
+    profiler.begin_frame();
+    {
+      PROFILE_SCOPE("update");
+      if (scripted)
+        cam.follow_path(f * dt, path_radius);
+      else
+        cam.apply(dt);
+      demo.update(dt);
+    }
+
+    {
+      PROFILE_SCOPE("render");
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      upload_camera_block(cam);
+#if ENABLE_NULLSPACE
+      {
+        PROFILE_SCOPE("nullspace");
+        PROFILE_GPU_SCOPE("nullspace");
+        nullspace_render();
+      }
+#endif
+      {
+        PROFILE_SCOPE("demo");
+        PROFILE_GPU_SCOPE("demo");
+        demo.render();
+      }
+      stream_buf.end_frame();
+    }
+
+    culled += demo.cull_stats.culled;
+    rebuilds += demo.cull_stats.rebuilt;
+    update_ms += demo.cull_stats.update_ms;
+    cull_ms += demo.cull_stats.cull_ms;
+    for (uint32_t l = 0; l < max_lods; ++l)
+      lod_instances[l] += demo.lod_stats.instances[l];
+    triangles += demo.lod_stats.triangles;
+
+    {
+      PROFILE_SCOPE("readback");
+      if (readback.full())
+        readback.collect(sink, true);
+      readback.read(f);
+      readback.collect(sink, false);
+    }
+    profiler.end_frame();
+
+    if (f >= report.warmup) {
+      report.frame_ms.push_back(tsamplr_t::convert(
+          tsamplr_t::now() - frame_start, tsamplr_t::_ms_));
+      report.cpu_ms.push_back(profiler.frame(f)->cpu_ms());
+    }
+    // GPU times come in a few frames late
+    collect_gpu_ms();
   }
+  profiler.flush();
+  collect_gpu_ms();
+  if (gpu_next < frames)
+    report.gpu_dropped += frames - (uint32_t)gpu_next;
+
+  while (readback.pending())
+    readback.collect(sink, true);
+  capture.teardown();
+
+  const double total_ms =
+      tsamplr_t::convert(tsamplr_t::now() - start, tsamplr_t::_ms_);
+  cprintf(L"rendered $c*%u$? frames of %dx%d in %.1f ms (%.3f ms/frame)\n",
+          frames, window_width, window_height, total_ms, total_ms / frames);
+  cprintf(L"readback latency: avg %.3f ms, max %.3f ms\n",
+          latency_ms / collected, max_latency_ms);
+  cprintf(L"gl state changes: %llu issued, %llu skipped\n",
+          (unsigned long long)gl_state.issued,
+          (unsigned long long)gl_state.skipped);
+  cprintf(L"stream buffer: %llu bytes a frame, %llu stalls, %llu grows\n",
+          (unsigned long long)stream_buf.last_frame_bytes,
+          (unsigned long long)stream_buf.stalls,
+          (unsigned long long)stream_buf.grows);
+  cprintf(L"culling: %.1f of %u objects culled a frame in %.3f ms, "
+          L"%.3f ms updating bounds, %llu rebuilds\n",
+          (double)culled / frames, demo.cull_stats.objects, cull_ms / frames,
+          update_ms / frames, (unsigned long long)rebuilds);
+  cprintf(L"levels of detail: %.1f %.1f %.1f %.1f objects a frame at levels "
+          L"0-3, %.0f triangles a frame\n",
+          (double)lod_instances[0] / frames, (double)lod_instances[1] / frames,
+          (double)lod_instances[2] / frames, (double)lod_instances[3] / frames,
+          (double)triangles / frames);
+  profiler.report();
+  printf("frame hash: %.16llx\n", (unsigned long long)hash);
+
+  if (scripted) {
+    report.frames = frames;
+    report.objects = demo.cull_stats.objects;
+    report.sphere_segments = (uint32_t)opts.sphere_segments;
+    report.dt = dt;
+    report.lod_error = opts.lod_error;
+    report.cull = cull_mode_name((cull_mode_t)opts.cull);
+    report.stream_bytes = stream_buf.last_frame_bytes;
+    report.hash = hash;
+    report.sample_memory();
+
+    const sample_stats_t s = sample_stats(report.frame_ms);
+    cprintf(L"frame time: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms over %u "
+            L"frames\n",
+            s.p50, s.p95, s.p99, s.count);
+    if (opts.report && !report.write(opts.report))
+      exit(1);
+    if (opts.baseline && !report.check(opts.baseline, opts.max_regression))
+      exit(1);
+  }
+
+  readback.teardown();
+  target.teardown();
 }
 
 int main(int argc, char const *argv[]) {
+  parse_options(argc, argv);
+
+  // before any thread that records starts
+  if (opts.trace) {
+    trace.name_thread("main");
+    trace.start();
+  }
+
+  if (opts.simd >= 0)
+    simd_set_level((simd_level_t)opts.simd);
+
+  jobs.init(opts.threads < 0 ? job_system_t::auto_workers
+                             : (uint32_t)opts.threads);
+
+  if (opts.bench) {
+    bool passed;
+    bool found = bench_run(opts.bench, &passed);
+    jobs.teardown();
+    if (opts.trace)
+      trace.dump(opts.trace);
+    if (!found) {
+      cprintf<CPF_STDE>(L"$r*FATAL ERROR$?: no such benchmark: %s\n",
+                        opts.bench);
+      return EXIT_FAILURE;
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  // reproducible frames need the simulation in lock-step with them
+  if (opts.headless)
+    opts.sim_sync = true;
+
   std::atexit(teardown);
   setup(argc, argv);
-  run();
+  if (opts.headless)
+    run_headless();
+  else
+    run();
   return 0;
 }
@@ -0,0 +1,65 @@
+#include "mapped-file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool mapped_file_t::map(const char *path) {
+  release();
+
+#ifdef _WIN32
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  const long end = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = end > 0 ? (uint8_t *)malloc((size_t)end) : NULL;
+  const bool read = buf && fread(buf, 1, (size_t)end, f) == (size_t)end;
+  fclose(f);
+  if (!read) {
+    free(buf);
+    return false;
+  }
+  data = buf;
+  size = (size_t)end;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file open
+  close(fd);
+  if (base == MAP_FAILED)
+    return false;
+
+  // advice values are not flags: each needs its own call
+  madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+  madvise(base, (size_t)st.st_size, MADV_WILLNEED);
+  data = (const uint8_t *)base;
+  size = (size_t)st.st_size;
+#endif
+
+  return true;
+}
+
+void mapped_file_t::release(void) {
+  if (data) {
+#ifdef _WIN32
+    free((void *)data);
+#else
+    munmap((void *)data, size);
+#endif
+  }
+  data = NULL;
+  size = 0;
+}
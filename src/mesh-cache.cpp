@@ -0,0 +1,234 @@
+#include "mesh-cache.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mesh_view_t view_mesh(const mesh_t *m, vertex_layout_t layout,
+                      mesh_pack_t *pack) {
+  mesh_view_t v;
+  v.layout = layout;
+  v.vtx_count = m->vtx_data.size();
+  v.idx_count = m->idx_data.size();
+  v.idx_size = sizeof(uint32_t);
+  v.idx = m->idx_data.data();
+  // identity unless the vertices are packed
+  v.decode = {glm::vec4(1.0f, 1.0f, 1.0f, 0.0f),
+              glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)};
+
+  if (layout == VTX_LAYOUT_PACKED) {
+    v.decode = pack_vertices(m, &pack->vtx);
+    v.vtx = pack->vtx.data();
+    v.nrm = NULL;
+    v.txcrd = NULL;
+
+    if (v.idx_count && fits_16bit_indices(m)) {
+      pack_indices(m, &pack->idx16);
+      v.idx = pack->idx16.data();
+      v.idx_size = sizeof(uint16_t);
+    }
+  } else {
+    v.vtx = m->vtx_data.data();
+    v.nrm = m->norm_data.size() == v.vtx_count ? m->norm_data.data() : NULL;
+    v.txcrd =
+        m->txcrd_data.size() == v.vtx_count ? m->txcrd_data.data() : NULL;
+  }
+
+  return v;
+}
+
+enum section_t { SEC_VTX = 0, SEC_NRM, SEC_TXCRD, SEC_IDX, SEC_COUNT };
+
+// sections start on cache line boundaries
+static const uint64_t section_align = 64;
+
+static const char file_magic[8] = {'C', 'S', 'M', 'E', 'S', 'H', '\r', '\n'};
+static const uint32_t byte_order_mark = 0x01020304;
+
+struct file_header_t {
+  char magic[8];
+  uint32_t byte_order; // byte_order_mark, as the writer stored it
+  uint32_t version;
+  uint64_t key;
+
+  // the mesh it is
+  uint32_t type, layout;
+  float sz_param[3];
+  uint32_t res_u, res_v;
+
+  // what the file holds
+  uint32_t vtx_count, idx_count, idx_size;
+  vtx_decode_t decode;
+  uint64_t offset[SEC_COUNT], bytes[SEC_COUNT]; // 0 bytes when absent
+};
+
+// FNV-1a of everything that decides the file's contents
+static uint64_t cache_key(const mesh_create_info_t &info,
+                          vertex_layout_t layout) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  auto mix = [&](const void *data, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+      h ^= ((const uint8_t *)data)[i];
+      h *= 0x100000001b3ULL;
+    }
+  };
+
+  const uint32_t fields[] = {mesh_cache_version, (uint32_t)layout,
+                             (uint32_t)info.type, info.res_u, info.res_v};
+  mix(fields, sizeof(fields));
+  mix(&info.sz_param0, sizeof(float));
+  mix(&info.sz_param1, sizeof(float));
+  mix(&info.sz_param2, sizeof(float));
+  return h;
+}
+
+static std::string cache_path(const char *dir, const mesh_create_info_t &info,
+                              vertex_layout_t layout) {
+  char name[64];
+  snprintf(name, sizeof(name), "/%s-%016llx.mesh", mesh_type_name(info.type),
+           (unsigned long long)cache_key(info, layout));
+  return std::string(dir) + name;
+}
+
+static void describe(const mesh_create_info_t &info, vertex_layout_t layout,
+                     file_header_t *h) {
+  // zeroed bytewise, padding included, as the header is compared that way
+  memset((void *)h, 0, sizeof(*h));
+  memcpy(h->magic, file_magic, sizeof(file_magic));
+  h->byte_order = byte_order_mark;
+  h->version = mesh_cache_version;
+  h->key = cache_key(info, layout);
+  h->type = info.type;
+  h->layout = layout;
+  h->sz_param[0] = info.sz_param0;
+  h->sz_param[1] = info.sz_param1;
+  h->sz_param[2] = info.sz_param2;
+  h->res_u = info.res_u;
+  h->res_v = info.res_v;
+}
+
+bool cached_mesh_t::load(const char *dir, const mesh_create_info_t &info,
+                         vertex_layout_t layout) {
+  release();
+  const std::string path = cache_path(dir, info, layout);
+
+  if (!file.map(path.c_str()))
+    return false;
+
+  file_header_t expect;
+  describe(info, layout, &expect);
+  const size_t size = file.size;
+  const file_header_t *h = (const file_header_t *)file.data;
+
+  // the header must describe this very mesh, as this build writes it
+  bool valid = size >= sizeof(file_header_t) &&
+               !memcmp(h, &expect, offsetof(file_header_t, vtx_count)) &&
+               (h->idx_size == 2 || h->idx_size == 4);
+  for (uint32_t s = 0; valid && s < SEC_COUNT; ++s)
+    valid = h->offset[s] <= size && h->bytes[s] <= size - h->offset[s] &&
+            h->offset[s] % section_align == 0;
+
+  if (valid) {
+    const uint8_t *b = file.data;
+    view.layout = layout;
+    view.vtx_count = h->vtx_count;
+    view.idx_count = h->idx_count;
+    view.idx_size = h->idx_size;
+    view.decode = h->decode;
+    view.vtx = b + h->offset[SEC_VTX];
+    view.nrm = h->bytes[SEC_NRM]
+                   ? (const glm::vec3 *)(b + h->offset[SEC_NRM])
+                   : NULL;
+    view.txcrd = h->bytes[SEC_TXCRD]
+                     ? (const glm::vec2 *)(b + h->offset[SEC_TXCRD])
+                     : NULL;
+    view.idx = b + h->offset[SEC_IDX];
+
+    // and the sections must be the sizes the counts imply
+    valid = h->bytes[SEC_VTX] == view.vtx_bytes() &&
+            h->bytes[SEC_NRM] == view.nrm_bytes() &&
+            h->bytes[SEC_TXCRD] == view.txcrd_bytes() &&
+            h->bytes[SEC_IDX] == view.idx_bytes() && view.vtx_count;
+  }
+
+  if (!valid) {
+    fprintf(stderr, "WARNING: ignoring stale or damaged mesh cache file %s\n",
+            path.c_str());
+    release();
+    return false;
+  }
+
+  printf("... mapped %s (%lu bytes)\n", path.c_str(),
+         (unsigned long)file.size);
+  return true;
+}
+
+bool store_cached_mesh(const char *dir, const mesh_create_info_t &info,
+                       const mesh_view_t &view) {
+#ifdef _WIN32
+  if (_mkdir(dir) && errno != EEXIST)
+    return false;
+  const int pid = _getpid();
+#else
+  if (mkdir(dir, 0755) && errno != EEXIST)
+    return false;
+  const int pid = getpid();
+#endif
+
+  file_header_t h;
+  describe(info, view.layout, &h);
+  h.vtx_count = view.vtx_count;
+  h.idx_count = view.idx_count;
+  h.idx_size = view.idx_size;
+  h.decode = view.decode;
+
+  const void *data[SEC_COUNT] = {view.vtx, view.nrm, view.txcrd, view.idx};
+  h.bytes[SEC_VTX] = view.vtx_bytes();
+  h.bytes[SEC_NRM] = view.nrm_bytes();
+  h.bytes[SEC_TXCRD] = view.txcrd_bytes();
+  h.bytes[SEC_IDX] = view.idx_bytes();
+
+  uint64_t end = sizeof(h);
+  for (uint32_t s = 0; s < SEC_COUNT; ++s) {
+    h.offset[s] = (end + section_align - 1) / section_align * section_align;
+    end = h.offset[s] + h.bytes[s];
+  }
+
+  // write a private file and rename it into place, so readers never see
+  // a partial one
+  const std::string path = cache_path(dir, info, view.layout);
+  const std::string tmp = path + "." + std::to_string(pid) + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f)
+    return false;
+
+  static const uint8_t zeros[section_align] = {};
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+  uint64_t at = sizeof(h);
+  for (uint32_t s = 0; ok && s < SEC_COUNT; ++s) {
+    ok = fwrite(zeros, 1, h.offset[s] - at, f) == h.offset[s] - at &&
+         fwrite(data[s], 1, h.bytes[s], f) == h.bytes[s];
+    at = h.offset[s] + h.bytes[s];
+  }
+  ok = !fclose(f) && ok;
+
+#ifdef _WIN32
+  // rename does not replace an existing file here
+  remove(path.c_str());
+#endif
+  if (!ok || rename(tmp.c_str(), path.c_str())) {
+    remove(tmp.c_str());
+    return false;
+  }
+
+  printf("... cached in %s\n", path.c_str());
+  return true;
+}
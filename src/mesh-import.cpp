@@ -0,0 +1,842 @@
+#include "mesh-import.h"
+#include "mapped-file.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+
+// bytes of OBJ text each parallel chunk parses
+static const size_t obj_chunk_bytes = 1 << 22;
+static const uint32_t vtx_per_chunk = 16384;
+static const uint32_t tri_per_chunk = 16384;
+
+// leave "m" empty, keeping its storage, and report failure
+static bool discard(mesh_t *m) {
+  m->vtx_data.clear();
+  m->idx_data.clear();
+  m->txcrd_data.clear();
+  m->norm_data.clear();
+  return false;
+}
+
+// area-weighted vertex normals of the triangles of "m"
+static void compute_normals(mesh_t *m) {
+  const glm::vec3 *vtx = m->vtx_data.data();
+  const uint32_t *idx = m->idx_data.data();
+  m->norm_data.assign(m->vtx_data.size(), glm::vec3(0.0f));
+  glm::vec3 *nrm = m->norm_data.data();
+
+  for (size_t i = 0; i + 2 < m->idx_data.size(); i += 3) {
+    const glm::vec3 &a = vtx[idx[i]], &b = vtx[idx[i + 1]],
+                    &c = vtx[idx[i + 2]];
+    // twice the area, so larger triangles weigh more
+    const glm::vec3 n = glm::cross(b - a, c - a);
+    nrm[idx[i]] += n;
+    nrm[idx[i + 1]] += n;
+    nrm[idx[i + 2]] += n;
+  }
+
+  jobs.parallel_for(m->norm_data.size(), vtx_per_chunk,
+                    [=](uint32_t begin, uint32_t end) {
+                      for (uint32_t v = begin; v < end; v++) {
+                        const float len = glm::length(nrm[v]);
+                        // unused vertices still need a valid normal
+                        nrm[v] = len > 0.0f ? nrm[v] / len
+                                            : glm::vec3(0.0f, 0.0f, 1.0f);
+                      }
+                    });
+}
+
+//--------------------------------------------------------------------
+//	text
+//--------------------------------------------------------------------
+
+static inline bool is_digit(char c) { return (unsigned)(c - '0') < 10U; }
+static inline bool is_blank(char c) { return c == ' ' || c == '\t'; }
+
+static inline const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && is_blank(*p))
+    p++;
+  return p;
+}
+
+// the powers of ten a double holds exactly
+static const double exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Parse the decimal number at "p" into "out", returning the character
+// after it, or NULL if there is no number there. Up to 19 significant
+// digits are kept, which is far more than a float needs, and scaled by an
+// exact power of ten where there is one: a single rounding, unlike
+// strtof's locale and errno handling this is on the hot path of every
+// vertex.
+static const char *parse_float(const char *p, const char *end, float *out) {
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+
+  uint64_t mantissa = 0;
+  int exp = 0, digits = 0, significant = 0;
+  for (; p < end && is_digit(*p); p++, digits++) {
+    if (significant < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      significant += mantissa != 0;
+    } else {
+      exp++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && is_digit(*p); p++, digits++) {
+      if (significant < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        significant += mantissa != 0;
+        exp--;
+      }
+    }
+  }
+  if (!digits)
+    return NULL;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool exp_neg = false;
+    if (q < end && (*q == '-' || *q == '+'))
+      exp_neg = *q++ == '-';
+    if (q < end && is_digit(*q)) {
+      int e = 0;
+      for (; q < end && is_digit(*q); q++)
+        if (e < 10000)
+          e = e * 10 + (*q - '0');
+      exp += exp_neg ? -e : e;
+      p = q;
+    }
+  }
+
+  double v = (double)mantissa;
+  if (exp < 0)
+    v = exp >= -22 ? v / exact_pow10[-exp] : v * pow(10.0, exp);
+  else if (exp > 0)
+    v = exp <= 22 ? v * exact_pow10[exp] : v * pow(10.0, exp);
+  *out = (float)(neg ? -v : v);
+  return p;
+}
+
+// as parse_float, for integers
+static const char *parse_int(const char *p, const char *end, int64_t *out) {
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+
+  const char *first = p;
+  int64_t v = 0;
+  for (; p < end && is_digit(*p); p++)
+    if (v < (1LL << 40)) // saturate: no index is this large
+      v = v * 10 + (*p - '0');
+  if (p == first)
+    return NULL;
+
+  *out = neg ? -v : v;
+  return p;
+}
+
+// "count" blank-separated numbers
+static bool parse_floats(const char *p, const char *end, float *out,
+                         uint32_t count) {
+  for (uint32_t i = 0; i < count; i++)
+    if (!(p = parse_float(skip_blanks(p, end), end, &out[i])))
+      return false;
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	Wavefront OBJ
+//--------------------------------------------------------------------
+
+// A face corner's indices into the file's v, vt and vn lists. Chunks are
+// parsed without knowing how many elements came before them, so indices
+// counting back from the latest element ("-1") are stored relative to the
+// chunk's first element, biased by obj_relative, until it is known.
+struct obj_corner_t {
+  int32_t v, t, n;
+};
+
+static const int32_t obj_none = INT32_MIN; // no vt or vn given
+static const int64_t obj_relative = 1LL << 30;
+
+struct obj_chunk_t {
+  const char *begin, *end; // whole lines
+  std::vector<glm::vec3> pos, nrm;
+  std::vector<glm::vec2> txcrd;
+  std::vector<obj_corner_t> corners; // three per triangle
+  bool any_t, any_n;                 // whether any corner has a vt, a vn
+  const char *error;                 // the line that failed to parse
+};
+
+// store the OBJ index "i" of a list of which the chunk has seen "seen"
+static inline bool encode_index(int64_t i, size_t seen, int32_t *out) {
+  if (i > 0 && i <= INT32_MAX) {
+    *out = (int32_t)(i - 1);
+    return true;
+  }
+  const int64_t r = (int64_t)seen + i; // from the chunk's first element
+  if (i < 0 && r > -obj_relative && r < obj_relative) {
+    *out = (int32_t)(r - obj_relative);
+    return true;
+  }
+  return false;
+}
+
+// resolve an encoded index against the chunk's first element, "base", and
+// the length of the whole list
+static inline bool resolve_index(int32_t *i, int64_t base, int64_t count) {
+  if (*i == obj_none)
+    return true;
+  const int64_t r = *i >= 0 ? *i : base + *i + obj_relative;
+  if (r < 0 || r >= count)
+    return false;
+  *i = (int32_t)r;
+  return true;
+}
+
+// "v", "v/t", "v//n" or "v/t/n"
+static const char *parse_corner(const char *p, const char *end,
+                                const obj_chunk_t &c, obj_corner_t *out) {
+  int64_t i;
+  out->t = out->n = obj_none;
+  if (!(p = parse_int(p, end, &i)) || !encode_index(i, c.pos.size(), &out->v))
+    return NULL;
+
+  if (p < end && *p == '/') {
+    if (++p < end && *p != '/')
+      if (!(p = parse_int(p, end, &i)) ||
+          !encode_index(i, c.txcrd.size(), &out->t))
+        return NULL;
+    if (p < end && *p == '/')
+      if (!(p = parse_int(p + 1, end, &i)) ||
+          !encode_index(i, c.nrm.size(), &out->n))
+        return NULL;
+  }
+  return p;
+}
+
+static void parse_obj_chunk(obj_chunk_t *c) {
+  const char *p = c->begin;
+  while (p < c->end) {
+    const char *line = p;
+    const char *eol = (const char *)memchr(p, '\n', c->end - p);
+    if (!eol)
+      eol = c->end;
+    p = skip_blanks(p, eol);
+
+    bool ok = true;
+    if (eol - p > 1 && p[0] == 'v' && is_blank(p[1])) {
+      glm::vec3 v;
+      ok = parse_floats(p + 2, eol, &v.x, 3); // w and colours are ignored
+      c->pos.push_back(v);
+    } else if (eol - p > 2 && p[0] == 'v' && p[1] == 't' && is_blank(p[2])) {
+      glm::vec2 t(0.0f);
+      const char *q = parse_float(skip_blanks(p + 3, eol), eol, &t.x);
+      ok = q != NULL;
+      if (q) // v is optional
+        parse_float(skip_blanks(q, eol), eol, &t.y);
+      c->txcrd.push_back(t);
+    } else if (eol - p > 2 && p[0] == 'v' && p[1] == 'n' && is_blank(p[2])) {
+      glm::vec3 n;
+      ok = parse_floats(p + 3, eol, &n.x, 3);
+      c->nrm.push_back(n);
+    } else if (eol - p > 1 && p[0] == 'f' && is_blank(p[1])) {
+      // a fan around the first corner
+      obj_corner_t first = {0, 0, 0}, prev = first, corner;
+      uint32_t n = 0;
+      for (p += 2;; n++) {
+        p = skip_blanks(p, eol);
+        if (p == eol || *p == '\r' || *p == '#')
+          break;
+        if (!(p = parse_corner(p, eol, *c, &corner))) {
+          ok = false;
+          break;
+        }
+        c->any_t |= corner.t != obj_none;
+        c->any_n |= corner.n != obj_none;
+        if (n >= 2) {
+          c->corners.push_back(first);
+          c->corners.push_back(prev);
+          c->corners.push_back(corner);
+        } else if (!n) {
+          first = corner;
+        }
+        prev = corner;
+      }
+      ok = ok && n >= 3;
+    }
+
+    if (!ok) {
+      c->error = line;
+      return;
+    }
+    p = eol + 1;
+  }
+}
+
+bool import_obj(const char *path, mesh_t *out) {
+  assert(path != NULL && out != NULL && "null pointer");
+
+  mapped_file_t file;
+  if (!file.map(path)) {
+    fprintf(stderr, "ERROR: failed to read %s\n", path);
+    return discard(out);
+  }
+  const char *text = (const char *)file.data;
+  const char *end = text + file.size;
+
+  // split into chunks of whole lines
+  std::vector<const char *> cuts(1, text);
+  for (size_t at = obj_chunk_bytes; at < file.size; at += obj_chunk_bytes) {
+    const char *from = std::max(text + at, cuts.back());
+    const char *eol = (const char *)memchr(from, '\n', end - from);
+    if (!eol)
+      break;
+    cuts.push_back(eol + 1);
+  }
+  cuts.push_back(end);
+
+  const uint32_t num_chunks = cuts.size() - 1;
+  std::vector<obj_chunk_t> chunks(num_chunks);
+  jobs.parallel_for(num_chunks, 1, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++) {
+      obj_chunk_t &c = chunks[i];
+      c.begin = cuts[i];
+      c.end = cuts[i + 1];
+      c.any_t = c.any_n = false;
+      c.error = NULL;
+      // a guess from typical files, to save most of the regrowth
+      const size_t lines = (c.end - c.begin) / 24;
+      c.pos.reserve(lines / 2);
+      c.corners.reserve(lines * 3);
+      parse_obj_chunk(&c);
+    }
+  });
+
+  // where each chunk's elements go in the whole
+  std::vector<size_t> v_base(num_chunks + 1, 0), t_base(num_chunks + 1, 0),
+      n_base(num_chunks + 1, 0), c_base(num_chunks + 1, 0);
+  bool any_t = false, any_n = false;
+  for (uint32_t i = 0; i < num_chunks; i++) {
+    const obj_chunk_t &c = chunks[i];
+    if (c.error) {
+      const size_t line = std::count(text, c.error, '\n') + 1;
+      fprintf(stderr, "ERROR: %s:%zu: malformed statement\n", path, line);
+      return discard(out);
+    }
+    v_base[i + 1] = v_base[i] + c.pos.size();
+    t_base[i + 1] = t_base[i] + c.txcrd.size();
+    n_base[i + 1] = n_base[i] + c.nrm.size();
+    c_base[i + 1] = c_base[i] + c.corners.size();
+    any_t |= c.any_t;
+    any_n |= c.any_n;
+  }
+
+  const size_t num_v = v_base[num_chunks], num_corners = c_base[num_chunks];
+  if (!num_corners) {
+    fprintf(stderr, "ERROR: %s has no faces\n", path);
+    return discard(out);
+  }
+  if (num_v > INT32_MAX || num_corners > UINT32_MAX) {
+    fprintf(stderr, "ERROR: %s is too large\n", path);
+    return discard(out);
+  }
+
+  // gather the attribute lists, and make every index absolute
+  const bool shared = !any_t && !any_n; // a vertex per position
+  std::vector<glm::vec3> pos, nrm(n_base[num_chunks]);
+  std::vector<glm::vec2> txcrd(t_base[num_chunks]);
+  std::vector<glm::vec3> &all_pos = shared ? out->vtx_data : pos;
+  all_pos.resize(num_v);
+  out->idx_data.resize(num_corners);
+  std::atomic<bool> in_range(true);
+
+  jobs.parallel_for(num_chunks, 1, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++) {
+      obj_chunk_t &c = chunks[i];
+      std::copy(c.pos.begin(), c.pos.end(), all_pos.begin() + v_base[i]);
+      std::copy(c.txcrd.begin(), c.txcrd.end(), txcrd.begin() + t_base[i]);
+      std::copy(c.nrm.begin(), c.nrm.end(), nrm.begin() + n_base[i]);
+
+      bool ok = true;
+      for (obj_corner_t &k : c.corners)
+        ok &= resolve_index(&k.v, v_base[i], num_v) &&
+              resolve_index(&k.t, t_base[i], txcrd.size()) &&
+              resolve_index(&k.n, n_base[i], nrm.size());
+      if (!ok)
+        in_range = false;
+
+      if (shared) {
+        uint32_t *idx = out->idx_data.data() + c_base[i];
+        for (size_t k = 0; k < c.corners.size(); k++)
+          idx[k] = c.corners[k].v;
+      }
+    }
+  });
+
+  if (!in_range) {
+    fprintf(stderr, "ERROR: %s: face refers to a missing element\n", path);
+    return discard(out);
+  }
+
+  if (shared) {
+    out->txcrd_data.clear();
+  } else {
+    // One vertex per distinct corner. The position index hashes the
+    // corner perfectly, so the table is an array of chains, one per
+    // position, through the vertices made from it: longer than one only
+    // along texture and normal seams.
+    const uint32_t end_of_chain = ~0U;
+    std::vector<uint32_t> head(num_v, end_of_chain), next;
+    std::vector<obj_corner_t> made;
+    made.reserve(num_v + num_v / 4);
+    next.reserve(made.capacity());
+
+    uint32_t *idx = out->idx_data.data();
+    for (const obj_chunk_t &c : chunks) {
+      for (const obj_corner_t &k : c.corners) {
+        uint32_t o = head[k.v];
+        while (o != end_of_chain && (made[o].t != k.t || made[o].n != k.n))
+          o = next[o];
+        if (o == end_of_chain) {
+          o = made.size();
+          made.push_back(k);
+          next.push_back(head[k.v]);
+          head[k.v] = o;
+        }
+        *idx++ = o;
+      }
+    }
+
+    const size_t num_out = made.size();
+    out->vtx_data.resize(num_out);
+    out->txcrd_data.resize(any_t ? num_out : 0);
+    out->norm_data.resize(any_n ? num_out : 0);
+    glm::vec3 *dst_pos = out->vtx_data.data(), *dst_nrm = out->norm_data.data();
+    glm::vec2 *dst_txcrd = out->txcrd_data.data();
+    const obj_corner_t *src = made.data();
+
+    jobs.parallel_for(num_out, vtx_per_chunk,
+                      [&](uint32_t begin, uint32_t end) {
+                        for (uint32_t o = begin; o < end; o++) {
+                          const obj_corner_t &k = src[o];
+                          dst_pos[o] = pos[k.v];
+                          if (any_t)
+                            dst_txcrd[o] = k.t != obj_none ? txcrd[k.t]
+                                                           : glm::vec2(0.0f);
+                          if (any_n)
+                            dst_nrm[o] = k.n != obj_none ? nrm[k.n]
+                                                         : glm::vec3(0.0f);
+                        }
+                      });
+  }
+
+  if (!any_n)
+    compute_normals(out);
+  return true;
+}
+
+//--------------------------------------------------------------------
+//	binary PLY
+//--------------------------------------------------------------------
+
+enum ply_type_t {
+  PLY_NONE = 0,
+  PLY_INT8,
+  PLY_UINT8,
+  PLY_INT16,
+  PLY_UINT16,
+  PLY_INT32,
+  PLY_UINT32,
+  PLY_FLOAT32,
+  PLY_FLOAT64
+};
+
+static const struct {
+  const char *name, *alias;
+  uint32_t size;
+} ply_types[] = {
+    {"", "", 0},
+    {"char", "int8", 1},     {"uchar", "uint8", 1},    {"short", "int16", 2},
+    {"ushort", "uint16", 2}, {"int", "int32", 4},      {"uint", "uint32", 4},
+    {"float", "float32", 4}, {"double", "float64", 8},
+};
+
+struct ply_property_t {
+  std::string name;
+  ply_type_t type;       // of the value, or of a list's elements
+  ply_type_t count_type; // of a list's length; PLY_NONE if not a list
+  uint32_t offset;       // from the start of an element of fixed size
+};
+
+struct ply_element_t {
+  std::string name;
+  uint64_t count;
+  std::vector<ply_property_t> props;
+  uint32_t stride; // 0 when the element has lists, and so varies in size
+
+  inline const ply_property_t *find(const char *a, const char *b) const {
+    for (const ply_property_t &p : props)
+      if (p.name == a || (b && p.name == b))
+        return &p;
+    return NULL;
+  }
+};
+
+static ply_type_t ply_type(const std::string &name) {
+  for (uint32_t t = PLY_INT8; t <= PLY_FLOAT64; t++)
+    if (name == ply_types[t].name || name == ply_types[t].alias)
+      return (ply_type_t)t;
+  return PLY_NONE;
+}
+
+template <typename T> static inline T ply_load(const uint8_t *p, bool swap) {
+  uint8_t b[sizeof(T)];
+  memcpy(b, p, sizeof(T));
+  if (swap)
+    std::reverse(b, b + sizeof(T));
+  T v;
+  memcpy(&v, b, sizeof(T));
+  return v;
+}
+
+static inline double ply_read(const uint8_t *p, ply_type_t t, bool swap) {
+  switch (t) {
+  case PLY_INT8:
+    return (int8_t)*p;
+  case PLY_UINT8:
+    return *p;
+  case PLY_INT16:
+    return ply_load<int16_t>(p, swap);
+  case PLY_UINT16:
+    return ply_load<uint16_t>(p, swap);
+  case PLY_INT32:
+    return ply_load<int32_t>(p, swap);
+  case PLY_UINT32:
+    return ply_load<uint32_t>(p, swap);
+  case PLY_FLOAT32:
+    return ply_load<float>(p, swap);
+  case PLY_FLOAT64:
+    return ply_load<double>(p, swap);
+  default:
+    return 0.0;
+  }
+}
+
+// parse the header, returning the offset of the body, or 0 with "why" set
+static size_t parse_ply_header(const char *text, size_t size, bool *swap,
+                               std::vector<ply_element_t> *elements,
+                               const char **why) {
+  const char *p = text, *end = text + size;
+  bool format = false;
+  *why = "not a PLY file";
+
+  for (uint32_t line = 0; p < end; line++) {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    if (!eol)
+      break;
+
+    std::vector<std::string> words;
+    for (const char *w = p; w < eol;) {
+      w = skip_blanks(w, eol);
+      const char *e = w;
+      while (e < eol && !is_blank(*e) && *e != '\r')
+        e++;
+      if (e > w)
+        words.push_back(std::string(w, e));
+      w = e + (e < eol && *e == '\r');
+    }
+    p = eol + 1;
+
+    if (!line) {
+      if (words.size() != 1 || words[0] != "ply")
+        return 0;
+      continue;
+    }
+    if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+      continue;
+
+    if (words[0] == "format" && words.size() == 3) {
+      if (words[1] == "ascii") {
+        *why = "ASCII PLY is not supported";
+        return 0;
+      }
+      const bool little = words[1] == "binary_little_endian";
+      if (!little && words[1] != "binary_big_endian")
+        break;
+      const uint32_t probe = 1;
+      *swap = little != (*(const uint8_t *)&probe == 1);
+      format = true;
+    } else if (words[0] == "element" && words.size() == 3) {
+      ply_element_t e;
+      e.name = words[1];
+      e.count = strtoull(words[2].c_str(), NULL, 10);
+      e.stride = 0;
+      if (e.count > size) // every element takes at least a byte
+        break;
+      elements->push_back(e);
+    } else if (words[0] == "property" && !elements->empty()) {
+      ply_property_t prop;
+      const bool list = words.size() == 5 && words[1] == "list";
+      if (!list && words.size() != 3)
+        break;
+      prop.count_type = list ? ply_type(words[2]) : PLY_NONE;
+      prop.type = ply_type(words[list ? 3 : 1]);
+      prop.name = words.back();
+      if (prop.type == PLY_NONE || (list && prop.count_type == PLY_NONE))
+        break;
+
+      ply_element_t &e = elements->back();
+      prop.offset = e.stride;
+      // stride stays 0 from the first list on
+      if (!list && (e.props.empty() || e.stride))
+        e.stride += ply_types[prop.type].size;
+      else
+        e.stride = 0;
+      e.props.push_back(prop);
+    } else if (words[0] == "end_header") {
+      if (!format)
+        break;
+      return p - text;
+    } else {
+      break;
+    }
+  }
+
+  *why = "malformed header";
+  return 0;
+}
+
+// the triangle fan indices of the faces, from "at", in element "e" (of
+// variable size), or false if the file ends early
+static bool read_ply_faces(const uint8_t *data, size_t size, size_t *at,
+                           const ply_element_t &e, const ply_property_t *list,
+                           bool swap, std::vector<uint32_t> *idx) {
+  size_t p = *at;
+  for (uint64_t f = 0; f < e.count; f++) {
+    for (const ply_property_t &prop : e.props) {
+      const uint32_t value = ply_types[prop.type].size;
+      if (prop.count_type == PLY_NONE) {
+        p += value;
+        continue;
+      }
+
+      const uint32_t count_size = ply_types[prop.count_type].size;
+      if (p + count_size > size)
+        return false;
+      const uint64_t n = (uint64_t)ply_read(data + p, prop.count_type, swap);
+      p += count_size;
+      if (n * value > size - p)
+        return false;
+
+      if (&prop == list) {
+        const uint8_t *corner = data + p;
+        const uint32_t first = (uint32_t)ply_read(corner, prop.type, swap);
+        for (uint64_t k = 2; k < n; k++) {
+          idx->push_back(first);
+          idx->push_back(
+              (uint32_t)ply_read(corner + (k - 1) * value, prop.type, swap));
+          idx->push_back(
+              (uint32_t)ply_read(corner + k * value, prop.type, swap));
+        }
+      }
+      p += n * value;
+    }
+  }
+  if (p > size)
+    return false;
+  *at = p;
+  return true;
+}
+
+bool import_ply(const char *path, mesh_t *out) {
+  assert(path != NULL && out != NULL && "null pointer");
+
+  mapped_file_t file;
+  if (!file.map(path)) {
+    fprintf(stderr, "ERROR: failed to read %s\n", path);
+    return discard(out);
+  }
+
+  bool swap = false;
+  std::vector<ply_element_t> elements;
+  const char *why = NULL;
+  size_t at = parse_ply_header((const char *)file.data, file.size, &swap,
+                               &elements, &why);
+  if (!at) {
+    fprintf(stderr, "ERROR: %s: %s\n", path, why);
+    return discard(out);
+  }
+
+  const uint8_t *data = file.data;
+  const size_t size = file.size;
+  bool have_vertices = false, have_faces = false;
+  bool any_n = false;
+  out->idx_data.clear();
+
+  for (size_t ei = 0; ei < elements.size(); ei++) {
+    const ply_element_t &e = elements[ei];
+
+    if (e.name == "vertex") {
+      const ply_property_t *x = e.find("x", NULL), *y = e.find("y", NULL),
+                           *z = e.find("z", NULL);
+      const ply_property_t *nx = e.find("nx", NULL), *ny = e.find("ny", NULL),
+                           *nz = e.find("nz", NULL);
+      const ply_property_t *u = e.find("u", "s"), *v = e.find("v", "t");
+      if (!u || !v)
+        u = e.find("texture_u", "texture_s"),
+        v = e.find("texture_v", "texture_t");
+
+      if (!x || !y || !z || !e.stride) {
+        fprintf(stderr, "ERROR: %s: unsupported vertex layout\n", path);
+        return discard(out);
+      }
+      if (e.count > UINT32_MAX || e.count * e.stride > size - at) {
+        fprintf(stderr, "ERROR: %s: truncated vertex data\n", path);
+        return discard(out);
+      }
+
+      const uint32_t count = e.count, stride = e.stride;
+      any_n = nx && ny && nz;
+      const bool any_t = u && v;
+      out->vtx_data.resize(count);
+      out->norm_data.resize(any_n ? count : 0);
+      out->txcrd_data.resize(any_t ? count : 0);
+      glm::vec3 *pos = out->vtx_data.data(), *nrm = out->norm_data.data();
+      glm::vec2 *txcrd = out->txcrd_data.data();
+      const uint8_t *base = data + at;
+
+      jobs.parallel_for(count, vtx_per_chunk, [&](uint32_t begin,
+                                                  uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+          const uint8_t *p = base + (size_t)i * stride;
+          pos[i] = glm::vec3(ply_read(p + x->offset, x->type, swap),
+                             ply_read(p + y->offset, y->type, swap),
+                             ply_read(p + z->offset, z->type, swap));
+          if (any_n)
+            nrm[i] = glm::vec3(ply_read(p + nx->offset, nx->type, swap),
+                               ply_read(p + ny->offset, ny->type, swap),
+                               ply_read(p + nz->offset, nz->type, swap));
+          if (any_t)
+            txcrd[i] = glm::vec2(ply_read(p + u->offset, u->type, swap),
+                                 ply_read(p + v->offset, v->type, swap));
+        }
+      });
+
+      at += (size_t)count * stride;
+      have_vertices = true;
+      continue;
+    }
+
+    const ply_property_t *list =
+        e.name == "face" ? e.find("vertex_indices", "vertex_index") : NULL;
+    if (list && list->count_type == PLY_NONE)
+      list = NULL;
+
+    if (e.stride) {
+      // nothing we need, and of fixed size
+      if (e.count * e.stride > size - at) {
+        fprintf(stderr, "ERROR: %s: truncated %s data\n", path,
+                e.name.c_str());
+        return discard(out);
+      }
+      at += e.count * e.stride;
+      continue;
+    }
+
+    // Scans are nearly always triangles, and then the faces, when they
+    // end the file, fill it at a fixed stride: those are read in parallel.
+    // Anything else is walked in order.
+    bool done = false;
+    if (list && ei + 1 == elements.size() && e.count <= UINT32_MAX / 3) {
+      const uint32_t value = ply_types[list->type].size;
+      const uint32_t count_size = ply_types[list->count_type].size;
+      uint32_t stride = 0, list_at = 0;
+      bool fixed = true; // false if there is another list
+      for (const ply_property_t &prop : e.props) {
+        if (&prop == list)
+          list_at = stride, stride += count_size + 3 * value;
+        else if (prop.count_type == PLY_NONE)
+          stride += ply_types[prop.type].size;
+        else
+          fixed = false;
+      }
+
+      if (fixed && e.count * stride == size - at) {
+        const uint32_t count = e.count;
+        out->idx_data.resize((size_t)count * 3);
+        uint32_t *idx = out->idx_data.data();
+        const uint8_t *base = data + at + list_at;
+        const ply_type_t count_type = list->count_type, type = list->type;
+        std::atomic<bool> triangles(true);
+
+        jobs.parallel_for(count, tri_per_chunk, [&](uint32_t begin,
+                                                    uint32_t end) {
+          bool ok = true;
+          for (uint32_t f = begin; f < end; f++) {
+            const uint8_t *p = base + (size_t)f * stride;
+            ok &= ply_read(p, count_type, swap) == 3.0;
+            p += count_size;
+            for (uint32_t k = 0; k < 3; k++)
+              idx[f * 3 + k] = (uint32_t)ply_read(p + k * value, type, swap);
+          }
+          if (!ok)
+            triangles = false;
+        });
+
+        done = triangles;
+        if (done)
+          at += e.count * stride;
+        else
+          out->idx_data.clear();
+      }
+    }
+
+    if (!done && !read_ply_faces(data, size, &at, e, list, swap,
+                                 list ? &out->idx_data : NULL)) {
+      fprintf(stderr, "ERROR: %s: truncated %s data\n", path, e.name.c_str());
+      return discard(out);
+    }
+    have_faces |= list != NULL;
+  }
+
+  if (!have_vertices || !have_faces || out->idx_data.empty()) {
+    fprintf(stderr, "ERROR: %s has no %s\n", path,
+            have_vertices ? "faces" : "vertices");
+    return discard(out);
+  }
+
+  const uint32_t num_v = out->vtx_data.size();
+  for (uint32_t i : out->idx_data) {
+    if (i >= num_v) {
+      fprintf(stderr, "ERROR: %s: face refers to a missing vertex\n", path);
+      return discard(out);
+    }
+  }
+
+  if (!any_n)
+    compute_normals(out);
+  return true;
+}
+
+bool import_mesh(const char *path, mesh_t *out) {
+  const char *dot = strrchr(path, '.');
+  std::string ext = dot ? dot + 1 : "";
+  for (char &c : ext)
+    c = (char)tolower((unsigned char)c);
+
+  if (ext == "obj")
+    return import_obj(path, out);
+  if (ext == "ply")
+    return import_ply(path, out);
+
+  fprintf(stderr, "ERROR: %s: unknown mesh format\n", path);
+  return discard(out);
+}
@@ -0,0 +1,237 @@
+#include "mesh-opt.h"
+
+#include <algorithm>
+
+// marks a vertex that has never been in the cache
+static const uint64_t never = ~0ULL;
+
+vertex_cache_stats_t analyze_vertex_cache(const mesh_t *m,
+                                          uint32_t cache_size) {
+  assert(m != NULL && "null pointer");
+
+  // in a FIFO every miss pushes one entry, so a vertex is still cached
+  // while fewer than "cache_size" misses have happened since its own
+  std::vector<uint64_t> pushed(m->vtx_data.size(), never);
+  uint64_t misses = 0;
+  for (uint32_t v : m->idx_data) {
+    if (pushed[v] == never || misses - pushed[v] >= cache_size)
+      pushed[v] = misses++;
+  }
+
+  vertex_cache_stats_t stats;
+  stats.transforms = misses;
+  stats.acmr = m->idx_data.empty()
+                   ? 0.0f
+                   : (float)misses / (m->idx_data.size() / 3);
+  stats.atvr =
+      m->vtx_data.empty() ? 0.0f : (float)misses / m->vtx_data.size();
+  return stats;
+}
+
+// Tipsify: fan around a vertex, emitting all its remaining triangles,
+// then move on to the neighbour most likely to still be in the cache.
+// "clusters" receives the triangle each run between dead ends starts at.
+static void tipsify(const std::vector<uint32_t> &in, uint32_t vtx_cnt,
+                    uint32_t cache_size, std::vector<uint32_t> *out,
+                    std::vector<uint32_t> *clusters) {
+  const uint32_t tri_cnt = in.size() / 3;
+
+  // triangles around each vertex, and how many are not yet emitted
+  std::vector<uint32_t> live(vtx_cnt, 0), offset(vtx_cnt + 1, 0);
+  for (uint32_t v : in)
+    live[v]++;
+  for (uint32_t v = 0; v < vtx_cnt; v++)
+    offset[v + 1] = offset[v] + live[v];
+  std::vector<uint32_t> adjacency(in.size());
+  {
+    std::vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+    for (uint32_t t = 0; t < tri_cnt; t++)
+      for (uint32_t k = 0; k < 3; k++)
+        adjacency[fill[in[t * 3 + k]]++] = t;
+  }
+
+  std::vector<uint32_t> stamp(vtx_cnt, 0);
+  std::vector<bool> emitted(tri_cnt, false);
+  std::vector<uint32_t> dead_ends, candidates;
+  dead_ends.reserve(in.size());
+
+  out->clear();
+  out->reserve(in.size());
+  clusters->clear();
+
+  uint32_t time = cache_size + 1, cursor = 0;
+  int64_t fan = vtx_cnt ? 0 : -1;
+  bool jumped = true;
+
+  while (fan >= 0) {
+    if (jumped)
+      clusters->push_back(out->size() / 3);
+
+    candidates.clear();
+    for (uint32_t a = offset[fan]; a < offset[fan + 1]; a++) {
+      const uint32_t t = adjacency[a];
+      if (emitted[t])
+        continue;
+      emitted[t] = true;
+
+      for (uint32_t k = 0; k < 3; k++) {
+        const uint32_t v = in[t * 3 + k];
+        out->push_back(v);
+        dead_ends.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - stamp[v] > cache_size)
+          stamp[v] = time++;
+      }
+    }
+
+    // the candidate that will still be cached once its remaining
+    // triangles are fanned, and has been for the longest
+    fan = -1;
+    int64_t best = -1;
+    for (uint32_t v : candidates) {
+      if (!live[v])
+        continue;
+      int64_t priority = 0;
+      if (time - stamp[v] + 2 * live[v] <= cache_size)
+        priority = time - stamp[v];
+      if (priority > best) {
+        best = priority;
+        fan = v;
+      }
+    }
+
+    // no neighbour left to fan around: back up to a recent vertex, or
+    // failing that the next one in input order
+    jumped = fan < 0;
+    while (fan < 0 && !dead_ends.empty()) {
+      const uint32_t v = dead_ends.back();
+      dead_ends.pop_back();
+      if (live[v])
+        fan = v;
+    }
+    while (fan < 0 && cursor < vtx_cnt) {
+      if (live[cursor])
+        fan = cursor;
+      cursor++;
+    }
+  }
+}
+
+// sort the clusters of "idx" so the ones facing away from the mesh's
+// centre, which occlude the others from most viewpoints, come first
+static void sort_clusters(const mesh_t *m, std::vector<uint32_t> *idx,
+                          const std::vector<uint32_t> &clusters) {
+  const glm::vec3 *vtx = m->vtx_data.data();
+  const uint32_t tri_cnt = idx->size() / 3;
+  const uint32_t cluster_cnt = clusters.size();
+
+  struct cluster_t {
+    uint32_t first, last; // triangles
+    glm::vec3 centroid, normal;
+    float key;
+  };
+  std::vector<cluster_t> c(cluster_cnt);
+
+  glm::vec3 mesh_centroid(0.0f);
+  float mesh_area = 0.0f;
+  for (uint32_t i = 0; i < cluster_cnt; i++) {
+    c[i].first = clusters[i];
+    c[i].last = i + 1 < cluster_cnt ? clusters[i + 1] : tri_cnt;
+    c[i].centroid = c[i].normal = glm::vec3(0.0f);
+
+    float area = 0.0f;
+    for (uint32_t t = c[i].first; t < c[i].last; t++) {
+      const glm::vec3 &a = vtx[(*idx)[t * 3]], &b = vtx[(*idx)[t * 3 + 1]],
+                      &d = vtx[(*idx)[t * 3 + 2]];
+      const glm::vec3 n = glm::cross(b - a, d - a); // twice the area
+      const float w = glm::length(n);
+      c[i].centroid += (a + b + d) * (w / 3.0f);
+      c[i].normal += n;
+      area += w;
+    }
+
+    mesh_centroid += c[i].centroid;
+    mesh_area += area;
+    if (area > 0.0f)
+      c[i].centroid = c[i].centroid / area;
+  }
+  if (mesh_area > 0.0f)
+    mesh_centroid = mesh_centroid / mesh_area;
+
+  for (cluster_t &ci : c) {
+    const float len = glm::length(ci.normal);
+    ci.key = len > 0.0f
+                 ? glm::dot(ci.centroid - mesh_centroid, ci.normal / len)
+                 : 0.0f;
+  }
+
+  // stable, so clusters that tie (on a flat mesh, all of them) keep the
+  // order Tipsify gave them
+  std::stable_sort(c.begin(), c.end(),
+                   [](const cluster_t &a, const cluster_t &b) {
+                     return a.key > b.key;
+                   });
+
+  std::vector<uint32_t> sorted;
+  sorted.reserve(idx->size());
+  for (const cluster_t &ci : c)
+    sorted.insert(sorted.end(), idx->begin() + ci.first * 3,
+                  idx->begin() + ci.last * 3);
+  idx->swap(sorted);
+}
+
+bool optimize_vertex_cache(mesh_t *m, uint32_t cache_size) {
+  assert(m != NULL && "null pointer");
+  if (m->idx_data.size() < 3)
+    return false;
+
+  std::vector<uint32_t> order, clusters;
+  tipsify(m->idx_data, m->vtx_data.size(), cache_size, &order, &clusters);
+  sort_clusters(m, &order, clusters);
+
+  const vertex_cache_stats_t before = analyze_vertex_cache(m, cache_size);
+  order.swap(m->idx_data);
+  const vertex_cache_stats_t after = analyze_vertex_cache(m, cache_size);
+  if (after.transforms < before.transforms)
+    return true;
+
+  order.swap(m->idx_data);
+  return false;
+}
+
+// move element i of "data" to remap[i]; arrays without an element per
+// vertex are left alone
+template <typename T>
+static void permute(const std::vector<uint32_t> &remap,
+                    std::vector<T> *data) {
+  if (data->size() != remap.size())
+    return;
+  std::vector<T> moved(data->size());
+  for (size_t v = 0; v < remap.size(); v++)
+    moved[remap[v]] = (*data)[v];
+  data->swap(moved);
+}
+
+void optimize_vertex_fetch(mesh_t *m) {
+  assert(m != NULL && "null pointer");
+
+  const uint32_t vtx_cnt = m->vtx_data.size();
+  const uint32_t unused = ~0U;
+
+  // old index -> new, in order of first use
+  std::vector<uint32_t> remap(vtx_cnt, unused);
+  uint32_t next = 0;
+  for (uint32_t &v : m->idx_data) {
+    if (remap[v] == unused)
+      remap[v] = next++;
+    v = remap[v];
+  }
+  for (uint32_t &r : remap)
+    if (r == unused)
+      r = next++;
+
+  permute(remap, &m->vtx_data);
+  permute(remap, &m->norm_data);
+  permute(remap, &m->txcrd_data);
+}
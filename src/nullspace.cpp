@@ -1,13 +1,16 @@
 #include "nullspace.h"
 #include "base.h"
 #include "camera.h"
+#include "shader.h"
+#include "gl-state.h"
+#include "uniform-blocks.h"
 
+// the grid is drawn as it is, in world space
 static const char *vs_src = ""
-                            "#version 330 core\n"
-                            "uniform mat4 u_mvp;\n"
+                            "#version 330 core\n" CAMERA_BLOCK_GLSL
                             "layout(location = 0) in vec4 a_pos;\n"
                             "void main(void) {\n"
-                            "  gl_Position = (u_mvp * a_pos);\n"
+                            "  gl_Position = (camera.view_proj * a_pos);\n"
                             "}\n";
 
 static const char *fs_src =
@@ -19,7 +22,8 @@ static const char *fs_src =
 
 GLuint vtx_buf;
 GLuint vtx_arr;
-static GLuint shdr_prog;
+static shader_program_t shdr_prog;
+static shader_program_t::uniform_t u_color;
 
 int sz = 8, num_grid_verts = sz * (2 * 4), num_border_verts = 4,
     num_axes_verts = 6,
@@ -44,19 +48,16 @@ draw_array_t draw_arrays[] = {
 const uint32_t num_draw_arrays = sizeof(draw_arrays) / sizeof(draw_array_t);
 
 void nullspace_init(void) {
-  GLint vs = create_shader(GL_VERTEX_SHADER, vs_src);
-  GLint fs = create_shader(GL_FRAGMENT_SHADER, fs_src);
-  shdr_prog = create_shader_program(2, vs, fs);
-
-  glDeleteShader(vs);
-  glDeleteShader(fs);
+  shdr_prog.create(vs_src, fs_src);
+  shdr_prog.bind_block("camera_block", UBO_CAMERA);
+  u_color = shdr_prog.uniform("u_color");
 
   glGenVertexArrays(1, &vtx_arr);
   glGenBuffers(1, &vtx_buf);
 
-  glBindVertexArray(vtx_arr);
+  gl_state.bind_vertex_array(vtx_arr);
   {
-    glBindBuffer(GL_ARRAY_BUFFER, vtx_buf);
+    gl_state.bind_buffer(GL_ARRAY_BUFFER, vtx_buf);
     {
       glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec4) * num_verts, NULL,
                    GL_STATIC_DRAW);
@@ -105,10 +106,10 @@ void nullspace_init(void) {
       ptr = NULL;
 
       glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+      glEnableVertexAttribArray(0);
     }
-    glBindVertexArray(0);
+    gl_state.bind_vertex_array(0);
   }
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
 
   // buffer lookup offsets upon render
   size_t offset = 0;
@@ -120,66 +121,33 @@ void nullspace_init(void) {
 }
 
 void nullspace_teardown(void) {
-  glDeleteBuffers(1, &vtx_buf);
-  glDeleteVertexArrays(1, &vtx_arr);
-  glDeleteProgram(shdr_prog);
+  gl_state.delete_buffers(1, &vtx_buf);
+  gl_state.delete_vertex_arrays(1, &vtx_arr);
+  shdr_prog.destroy();
 }
 
 void nullspace_render(void) {
-  GLint last_texture, last_array_buffer, last_vertex_array,
-      last_element_array_buffer, last_program;
-  glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
-  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
-  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
-  glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &last_element_array_buffer);
-  GLboolean depth_test_was_enabled = glIsEnabled(GL_DEPTH_TEST);
-
-  if (!depth_test_was_enabled)
-    glEnable(GL_DEPTH_TEST);
-
-  glUseProgram(shdr_prog);
-  glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(1.0)),
-            mvp = cam.get_proj() * cam.get_matrix() * model;
+  const gl_state_t::snapshot_t last_state = gl_state.save();
 
-  GLint location = glGetUniformLocation(shdr_prog, "u_mvp");
-  glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mvp));
+  gl_state.enable(GL_DEPTH_TEST);
 
-  glBindVertexArray(vtx_arr);
-  glEnableVertexAttribArray(0);
+  shdr_prog.use();
 
-  GLfloat last_line_width;
-  glGetFloatv(GL_LINE_WIDTH, &last_line_width);
+  gl_state.bind_vertex_array(vtx_arr);
 
   for (uint32_t i(0); i < num_draw_arrays; ++i) {
     draw_array_t *draw_array = &draw_arrays[i];
 
     if (i)
-      glDisable(GL_DEPTH_TEST);
+      gl_state.disable(GL_DEPTH_TEST);
 
-    location = glGetUniformLocation(shdr_prog, "u_color");
-    glUniform3fv(location, 1, glm::value_ptr(draw_array->color));
+    shdr_prog.set(u_color, draw_array->color);
 
-    glLineWidth(draw_array->line_width);
+    gl_state.line_width(draw_array->line_width);
 
     glDrawArrays(draw_array->mode, draw_array->first, draw_array->count);
   }
 
-  glLineWidth(last_line_width);
-
-  glDisableVertexAttribArray(0);
-  glBindVertexArray(0);
-  glUseProgram(0);
-
-  if (depth_test_was_enabled)
-    glEnable(GL_DEPTH_TEST);
-  else
-    glDisable(GL_DEPTH_TEST);
-
   // Restore modified GL state
-  glUseProgram(last_program);
-  glBindTexture(GL_TEXTURE_2D, last_texture);
-  glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, last_element_array_buffer);
-  glBindVertexArray(last_vertex_array);
+  gl_state.restore(last_state);
 }
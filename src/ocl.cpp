@@ -1,4 +1,5 @@
 #include "ocl.h"
+#include "trace.h"
 cl_platform_id ocl_platform = NULL;
 cl_device_id ocl_device = NULL;
 cl_bool ocl_dev_is_ver12 = CL_FALSE;
@@ -12,6 +13,7 @@ pfn_notify(const char *msg, const void *data0, size_t sz, void *data1) {
 }
 
 void compute_init(void) {
+  TRACE_SCOPE("compute_init");
         cprintf(L"$c*`begin$? compute setup\n");
   cl_uint num_platforms = 0;
   ocl_err = clGetPlatformIDs(0, NULL, &num_platforms);
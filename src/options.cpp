@@ -0,0 +1,208 @@
+#include "options.h"
+#include "integrator.h"
+#include "collision.h"
+#include "culling.h"
+#include <cstring>
+
+options_t opts = {
+    NULL, // bench
+    -1,   // simd
+    BROADPHASE_GRID, // broadphase
+    -1,   // threads
+    100.0f, // sim_hz
+    false,  // sim_sync
+    0,      // headless
+    768,    // width
+    512,    // height
+    NULL,   // capture
+    60,     // capture_fps
+    NULL,   // mesh_cache
+    true,   // persistent_map
+    CULL_CPU, // cull
+    1.0f,     // lod_error
+    NULL,     // trace
+    0,        // objects
+    32,       // sphere_segments
+    1.0f / 60, // frame_dt
+    NULL,     // report
+    NULL,     // baseline
+    10.0f,    // max_regression
+};
+
+static void print_usage(const char *prog) {
+  printf("usage: %s [options]\n"
+         "  --bench <name>   run a benchmark and exit (\"list\" to list)\n"
+         "  --simd <level>   integrator instruction set: scalar, sse, avx2\n"
+         "  --broadphase <m> collision broad phase: grid, sap\n"
+         "  --threads <n>    job system worker threads (default one per core,\n"
+         "                   less one; 0 runs everything on its caller)\n"
+         "  --sim-hz <hz>    simulation steps per second (default 100)\n"
+         "  --sim-sync       step the simulation on the render thread\n"
+         "  --headless <n>   render n frames offscreen, without a window\n"
+         "  --size <w>x<h>   offscreen frame size (default 768x512)\n"
+         "  --capture <out>  write frames to a file, or \"|command\"; PPM if\n"
+         "                   it ends in .ppm, otherwise Y4M\n"
+         "  --capture-fps <n> frame rate recorded in Y4M streams (default 60)\n"
+         "  --mesh-cache <dir> cache generated meshes in dir (default none:\n"
+         "                   always generate them, and write no files)\n"
+         "  --no-persistent-map stream per-frame data through unsynchronised\n"
+         "                   buffer maps, even with ARB_buffer_storage\n"
+         "  --cull <where>   cull objects the camera cannot see: none, cpu\n"
+         "                   (default) or gpu, a compute pass issuing\n"
+         "                   indirect draws (GL 4.3; else cpu)\n"
+         "  --lod-error <px> screen-space error levels of detail may show\n"
+         "                   (default 1; 0 always draws the finest level)\n"
+         "  --trace <file>   record a trace for chrome://tracing or Perfetto,\n"
+         "                   written to file at exit, or on T\n"
+         "  --objects <n>    spawn n objects instead of the demo's ten\n"
+         "  --sphere-segments <n> segments around the finest sphere (default\n"
+         "                   32); each coarser level has half as many\n"
+         "  --dt <s>         seconds a headless frame advances (default 1/60)\n"
+         "  --report <file>  render headlessly along a scripted camera path\n"
+         "                   (600 frames unless --headless says otherwise)\n"
+         "                   and write frame time percentiles as JSON\n"
+         "  --baseline <file> fail if slower than this earlier report\n"
+         "  --max-regression <pct> how much slower (default 10)\n"
+         "  --help           print this message\n",
+         prog);
+}
+
+void parse_options(int argc, char const *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+
+    // options which take a value
+    auto value = [&](void) -> const char * {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "ERROR: missing value for option %s\n", arg);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (!strcmp(arg, "--bench")) {
+      opts.bench = value();
+    } else if (!strcmp(arg, "--simd")) {
+      const char *level = value();
+      opts.simd = -1;
+      for (int l = 0; l < SIMD_LEVEL_COUNT; ++l)
+        if (!strcmp(level, simd_name((simd_level_t)l)))
+          opts.simd = l;
+      if (opts.simd < 0) {
+        fprintf(stderr, "ERROR: unknown simd level %s\n", level);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--broadphase")) {
+      const char *mode = value();
+      if (!strcmp(mode, "grid"))
+        opts.broadphase = BROADPHASE_GRID;
+      else if (!strcmp(mode, "sap"))
+        opts.broadphase = BROADPHASE_SAP;
+      else {
+        fprintf(stderr, "ERROR: unknown broad phase %s\n", mode);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--threads")) {
+      opts.threads = atoi(value());
+      if (opts.threads < 0) {
+        fprintf(stderr, "ERROR: invalid thread count %d\n", opts.threads);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--sim-hz")) {
+      opts.sim_hz = (float)atof(value());
+      if (!(opts.sim_hz > 0.0f)) {
+        fprintf(stderr, "ERROR: invalid simulation rate %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--sim-sync")) {
+      opts.sim_sync = true;
+    } else if (!strcmp(arg, "--headless")) {
+      opts.headless = atoi(value());
+      if (opts.headless <= 0) {
+        fprintf(stderr, "ERROR: invalid frame count %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--size")) {
+      const char *size = value();
+      if (sscanf(size, "%dx%d", &opts.width, &opts.height) != 2 ||
+          opts.width <= 0 || opts.height <= 0) {
+        fprintf(stderr, "ERROR: invalid frame size %s\n", size);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--capture")) {
+      opts.capture = value();
+    } else if (!strcmp(arg, "--capture-fps")) {
+      opts.capture_fps = atoi(value());
+      if (opts.capture_fps <= 0) {
+        fprintf(stderr, "ERROR: invalid capture rate %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--mesh-cache")) {
+      opts.mesh_cache = value();
+      if (!strcmp(opts.mesh_cache, "none"))
+        opts.mesh_cache = NULL;
+    } else if (!strcmp(arg, "--no-persistent-map")) {
+      opts.persistent_map = false;
+    } else if (!strcmp(arg, "--cull")) {
+      const char *mode = value();
+      opts.cull = -1;
+      for (int m = 0; m < CULL_MODE_COUNT; ++m)
+        if (!strcmp(mode, cull_mode_name((cull_mode_t)m)))
+          opts.cull = m;
+      if (opts.cull < 0) {
+        fprintf(stderr, "ERROR: unknown cull mode %s\n", mode);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--lod-error")) {
+      opts.lod_error = (float)atof(value());
+      if (!(opts.lod_error >= 0.0f)) {
+        fprintf(stderr, "ERROR: invalid level of detail error %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--trace")) {
+      opts.trace = value();
+      if (!ENABLE_TRACE)
+        fprintf(stderr, "WARNING: built without ENABLE_TRACE; --trace "
+                        "records nothing\n");
+    } else if (!strcmp(arg, "--objects")) {
+      opts.objects = atoi(value());
+      if (opts.objects < 0) {
+        fprintf(stderr, "ERROR: invalid object count %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--sphere-segments")) {
+      opts.sphere_segments = atoi(value());
+      if (opts.sphere_segments < 8) {
+        fprintf(stderr, "ERROR: invalid sphere segments %s (8 at least)\n",
+                argv[i]);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--dt")) {
+      opts.frame_dt = (float)atof(value());
+      if (!(opts.frame_dt > 0.0f)) {
+        fprintf(stderr, "ERROR: invalid frame step %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--report")) {
+      opts.report = value();
+    } else if (!strcmp(arg, "--baseline")) {
+      opts.baseline = value();
+    } else if (!strcmp(arg, "--max-regression")) {
+      opts.max_regression = (float)atof(value());
+      if (!(opts.max_regression >= 0.0f)) {
+        fprintf(stderr, "ERROR: invalid regression percentage %s\n",
+                argv[i]);
+        exit(1);
+      }
+    } else if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+      print_usage(argv[0]);
+      exit(0);
+    } else {
+      fprintf(stderr, "WARNING: ignoring unknown option %s\n", arg);
+    }
+  }
+
+  // reports are of headless runs
+  if ((opts.report || opts.baseline) && !opts.headless)
+    opts.headless = 600;
+}
@@ -0,0 +1,292 @@
+#include "profiler.h"
+#include <imgui.h>
+#include <cprintf/cprintf.hpp>
+
+#include <cfloat>
+#include <cstring>
+
+profiler_t profiler;
+
+static const uint64_t no_frame = ~0ULL;
+
+static inline double to_ms(tsamplr_t::storage_t t) {
+  return tsamplr_t::convert(t, tsamplr_t::_ms_);
+}
+
+double profiler_t::frame_t::gpu_ms(void) const {
+  double ms = 0.0;
+  for (uint32_t i = 0; i < gpu_count; ++i)
+    ms += gpu[i].ms;
+  return ms;
+}
+
+profiler_t::profiler_t(void)
+    : frames(history), frame_count(0), latest_gpu(no_frame), in_frame(false),
+      depth(0), gpu_open(false), total_count(0), frame_ms(0.0) {
+  memset(queries, 0, sizeof(queries));
+  for (uint32_t s = 0; s < query_sets; ++s)
+    query_frame[s] = no_frame;
+}
+
+void profiler_t::init(void) {
+  owner = std::this_thread::get_id();
+  glGenQueries(query_sets * max_gpu_scopes, &queries[0][0]);
+}
+
+void profiler_t::teardown(void) {
+  if (queries[0][0])
+    glDeleteQueries(query_sets * max_gpu_scopes, &queries[0][0]);
+  memset(queries, 0, sizeof(queries));
+  for (uint32_t s = 0; s < query_sets; ++s)
+    query_frame[s] = no_frame;
+}
+
+void profiler_t::add_total(const char *name, uint32_t depth, bool gpu,
+                           double ms) {
+  uint32_t i = 0;
+  while (i < total_count && (totals[i].name != name ||
+                             totals[i].depth != depth || totals[i].gpu != gpu))
+    ++i;
+  if (i == total_count) {
+    if (total_count == max_totals)
+      return;
+    totals[total_count++] = {name, depth, gpu, 0.0, 0};
+  }
+  totals[i].ms += ms;
+  ++totals[i].frames;
+}
+
+// the GPU times of the frame that last used "set"; false, leaving them
+// to be read later, if they are not ready and "wait" is not set
+bool profiler_t::read_queries(uint32_t set, bool wait) {
+  const uint64_t index = query_frame[set];
+  if (index == no_frame)
+    return true;
+  frame_t &f = frames[index % history];
+  if (f.index != index) {
+    query_frame[set] = no_frame;
+    return true;
+  }
+
+  for (uint32_t i = 0; i < f.gpu_count && !wait; ++i) {
+    GLint available = 0;
+    glGetQueryObjectiv(queries[set][i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return false;
+  }
+  query_frame[set] = no_frame;
+  for (uint32_t i = 0; i < f.gpu_count; ++i) {
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(queries[set][i], GL_QUERY_RESULT, &ns);
+    f.gpu[i].ms = ns / 1000000.0;
+    add_total(f.gpu[i].name, 0, true, f.gpu[i].ms);
+  }
+  f.gpu_valid = true;
+  latest_gpu = index;
+  return true;
+}
+
+// read every frame's GPU times that are ready, oldest first so that
+// latest() only moves forward, waiting for those of frames below
+// "wait_below"
+void profiler_t::read_ready(uint64_t wait_below) {
+  const uint64_t first = frame_count > query_sets ? frame_count - query_sets : 0;
+  for (uint64_t i = first; i < frame_count; ++i) {
+    const uint32_t set = (uint32_t)(i % query_sets);
+    if (query_frame[set] == i && !read_queries(set, i < wait_below))
+      break;
+  }
+}
+
+void profiler_t::begin_frame(void) {
+  assert(!in_frame && "Profiler frames cannot nest!");
+  // the set this frame reuses must be read first
+  if (queries[0][0])
+    read_ready(frame_count + 1 > query_sets ? frame_count + 1 - query_sets
+                                            : 0);
+
+  frame_t &f = current();
+  f.index = frame_count;
+  f.begin = f.end = tsamplr_t::now();
+  f.cpu_count = f.gpu_count = 0;
+  f.gpu_valid = false;
+  depth = 0;
+  in_frame = true;
+}
+
+void profiler_t::end_frame(void) {
+  assert(in_frame && "No profiler frame to end!");
+  assert(!depth && !gpu_open && "Profiler scopes left open!");
+  frame_t &f = current();
+  f.end = tsamplr_t::now();
+
+  for (uint32_t i = 0; i < f.cpu_count; ++i)
+    add_total(f.cpu[i].name, f.cpu[i].depth, false,
+              to_ms(f.cpu[i].end - f.cpu[i].begin));
+  frame_ms += f.cpu_ms();
+
+  if (queries[0][0])
+    query_frame[frame_count % query_sets] = frame_count;
+  ++frame_count;
+  in_frame = false;
+}
+
+void profiler_t::flush(void) {
+  assert(!in_frame && "Cannot flush the profiler inside a frame!");
+  if (queries[0][0])
+    read_ready(frame_count);
+}
+
+uint32_t profiler_t::push_cpu(const char *name) {
+  if (!in_frame || std::this_thread::get_id() != owner)
+    return ~0U;
+  frame_t &f = current();
+  if (f.cpu_count == max_scopes)
+    return ~0U;
+
+  const uint32_t scope = f.cpu_count++;
+  f.cpu[scope].name = name;
+  f.cpu[scope].depth = depth++;
+  f.cpu[scope].begin = f.cpu[scope].end = tsamplr_t::now();
+  return scope;
+}
+
+void profiler_t::pop_cpu(uint32_t scope) {
+  if (scope == ~0U)
+    return;
+  current().cpu[scope].end = tsamplr_t::now();
+  --depth;
+}
+
+void profiler_t::push_gpu(const char *name) {
+  if (!in_frame || !queries[0][0] || std::this_thread::get_id() != owner)
+    return;
+  assert(!gpu_open && "GPU profiler scopes cannot nest!");
+  frame_t &f = current();
+  if (f.gpu_count == max_gpu_scopes)
+    return;
+
+  f.gpu[f.gpu_count].name = name;
+  f.gpu[f.gpu_count].ms = 0.0;
+  glBeginQuery(GL_TIME_ELAPSED,
+               queries[frame_count % query_sets][f.gpu_count]);
+  gpu_open = true;
+}
+
+void profiler_t::pop_gpu(void) {
+  if (!gpu_open)
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+  ++current().gpu_count;
+  gpu_open = false;
+}
+
+const profiler_t::frame_t *profiler_t::latest(void) const {
+  return latest_gpu == no_frame ? NULL : frame(latest_gpu);
+}
+
+const profiler_t::frame_t *profiler_t::frame(uint64_t index) const {
+  if (index >= frame_count)
+    return NULL;
+  const frame_t &f = frames[index % history];
+  return f.index == index ? &f : NULL;
+}
+
+// a colour of its own for each scope name
+static ImU32 scope_colour(const char *name) {
+  uint32_t h = 2166136261U;
+  for (const char *c = name; *c; ++c)
+    h = (h ^ (uint8_t)*c) * 16777619U;
+  return ImColor(64 + (int)(h & 0x7f), 64 + (int)((h >> 8) & 0x7f),
+                 64 + (int)((h >> 16) & 0x7f));
+}
+
+// a bar of the flame graph, labelled if the label fits
+static void draw_bar(ImDrawList *dl, ImVec2 a, ImVec2 b, const char *name,
+                     double ms) {
+  b.x = glm::max(b.x, a.x + 1.0f);
+  dl->AddRectFilled(a, b, scope_colour(name));
+  dl->PushClipRect(ImVec4(a.x, a.y, b.x, b.y));
+  dl->AddText(ImVec2(a.x + 2.0f, a.y), ImColor(255, 255, 255), name);
+  dl->PopClipRect();
+  if (ImGui::IsMouseHoveringRect(a, b))
+    ImGui::SetTooltip("%s: %.3f ms", name, ms);
+}
+
+void profiler_t::draw_panel(void) {
+  const frame_t *f = latest();
+  if (!f) {
+    ImGui::Text("No frame profiled yet");
+    return;
+  }
+  ImGui::Text("Frame %llu: %.3f ms on the CPU, %.3f ms on the GPU",
+              (unsigned long long)f->index, f->cpu_ms(), f->gpu_ms());
+
+  // the frames up to latest(), oldest first
+  float cpu_ms[history], gpu_ms[history];
+  int count = 0;
+  for (uint64_t i = f->index + 1 - glm::min<uint64_t>(f->index + 1, history);
+       i <= f->index; ++i) {
+    const frame_t &h = frames[i % history];
+    if (h.index != i || !h.gpu_valid)
+      continue;
+    cpu_ms[count] = (float)h.cpu_ms();
+    gpu_ms[count++] = (float)h.gpu_ms();
+  }
+  ImGui::PlotLines("CPU ms", cpu_ms, count, 0, NULL, 0.0f, FLT_MAX,
+                   ImVec2(0.0f, 40.0f));
+  ImGui::PlotLines("GPU ms", gpu_ms, count, 0, NULL, 0.0f, FLT_MAX,
+                   ImVec2(0.0f, 40.0f));
+
+  // the CPU scopes at their place in the frame, one row per depth, and
+  // below them the GPU scopes one after the other on the same scale
+  ImDrawList *dl = ImGui::GetWindowDrawList();
+  const ImVec2 origin = ImGui::GetCursorScreenPos();
+  const float width = glm::max(ImGui::GetContentRegionAvailWidth(), 100.0f);
+  const float row = ImGui::GetTextLineHeightWithSpacing();
+  const double scale =
+      width / glm::max(glm::max(f->cpu_ms(), f->gpu_ms()), 1e-3);
+
+  uint32_t rows = 0;
+  for (uint32_t i = 0; i < f->cpu_count; ++i) {
+    const cpu_scope_t &s = f->cpu[i];
+    const float y = origin.y + row * s.depth;
+    draw_bar(dl,
+             ImVec2(origin.x + (float)(to_ms(s.begin - f->begin) * scale), y),
+             ImVec2(origin.x + (float)(to_ms(s.end - f->begin) * scale),
+                    y + row - 1.0f),
+             s.name, to_ms(s.end - s.begin));
+    rows = glm::max(rows, s.depth + 1);
+  }
+
+  const float y = origin.y + row * (rows + 0.5f);
+  float x = origin.x;
+  for (uint32_t i = 0; i < f->gpu_count; ++i) {
+    const float w = (float)(f->gpu[i].ms * scale);
+    draw_bar(dl, ImVec2(x, y), ImVec2(x + w, y + row - 1.0f), f->gpu[i].name,
+             f->gpu[i].ms);
+    x += w;
+  }
+  ImGui::Dummy(ImVec2(width, row * (rows + 1.5f)));
+}
+
+void profiler_t::report(void) const {
+  if (!frame_count)
+    return;
+  cprintf(L"profile: %.3f ms a frame on the CPU over %llu frames\n",
+          frame_ms / frame_count, (unsigned long long)frame_count);
+  for (uint32_t i = 0; i < total_count; ++i) {
+    const total_t &t = totals[i];
+    if (t.gpu)
+      continue;
+    const int indent = 2 * (int)t.depth;
+    printf("  %*s%-*s %8.3f ms\n", indent, "", 24 - indent, t.name,
+           t.ms / frame_count);
+  }
+  for (uint32_t i = 0; i < total_count; ++i) {
+    const total_t &t = totals[i];
+    if (t.gpu)
+      printf("  gpu %-20s %8.3f ms over %llu frames\n", t.name,
+             t.ms / t.frames, (unsigned long long)t.frames);
+  }
+}
@@ -0,0 +1,92 @@
+#include "readback.h"
+#include "gl-state.h"
+
+void readback_t::init(int width, int height, uint32_t depth) {
+  assert(slots.empty() && "Readback ring is already initialised!");
+  assert(depth > 0 && "Readback ring needs at least one buffer!");
+
+  this->width = width;
+  this->height = height;
+  head = count = 0;
+
+  slots.resize(depth);
+  for (slot_t &s : slots) {
+    glGenBuffers(1, &s.pbo);
+    gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, frame_bytes(), NULL, GL_STREAM_READ);
+    s.fence = 0;
+    s.frame = 0;
+    s.issued = 0;
+  }
+  gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void readback_t::teardown(void) {
+  for (slot_t &s : slots) {
+    if (s.fence)
+      glDeleteSync(s.fence);
+    gl_state.delete_buffers(1, &s.pbo);
+  }
+  slots.clear();
+  head = count = 0;
+}
+
+void readback_t::read(uint64_t frame) {
+  assert(!full() && "Readback ring is full!");
+
+  slot_t &s = slots[head];
+  s.frame = frame;
+  s.issued = tsamplr_t::now();
+
+  gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  head = (head + 1) % slots.size();
+  ++count;
+}
+
+uint32_t readback_t::collect(const sink_fn_t &sink, bool wait) {
+  uint32_t collected = 0;
+
+  while (count) {
+    slot_t &s = slots[(head + slots.size() - count) % slots.size()];
+
+    // only the first wait may block, and it must flush for the fence to
+    // ever signal
+    const bool block = wait && !collected;
+    GLenum status = glClientWaitSync(
+        s.fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+        block ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      break;
+    if (status == GL_WAIT_FAILED) {
+      fprintf(stderr, "ERROR: failed to wait on a readback fence\n");
+      exit(1);
+    }
+
+    glDeleteSync(s.fence);
+    s.fence = 0;
+
+    gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+    const uint8_t *pixels = (const uint8_t *)glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, frame_bytes(), GL_MAP_READ_BIT);
+    if (!pixels) {
+      fprintf(stderr, "ERROR: failed to map readback buffer\n");
+      exit(1);
+    }
+
+    sink(pixels, s.frame, s.issued);
+
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    --count;
+    ++collected;
+  }
+
+  return collected;
+}
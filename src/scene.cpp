@@ -0,0 +1,59 @@
+#include "scene.h"
+
+uint32_t entity_block_t::add(glm::vec3 pos, float m) {
+  const uint32_t idx = size();
+
+  pos_x.push_back(pos.x);
+  pos_y.push_back(pos.y);
+  pos_z.push_back(pos.z);
+
+  vel_x.push_back(0.0f);
+  vel_y.push_back(0.0f);
+  vel_z.push_back(0.0f);
+
+  mass.push_back(m);
+  model.push_back(glm::translate(glm::mat4(1.0f), pos));
+
+  return idx;
+}
+
+void entity_block_t::reserve(uint32_t count) {
+  pos_x.reserve(count);
+  pos_y.reserve(count);
+  pos_z.reserve(count);
+  vel_x.reserve(count);
+  vel_y.reserve(count);
+  vel_z.reserve(count);
+  mass.reserve(count);
+  model.reserve(count);
+}
+
+void entity_block_t::clear(void) {
+  pos_x.clear();
+  pos_y.clear();
+  pos_z.clear();
+  vel_x.clear();
+  vel_y.clear();
+  vel_z.clear();
+  mass.clear();
+  model.clear();
+}
+
+entity_t scene_t::spawn(entity_type_t type, glm::vec3 pos, float mass) {
+  assert(type < ENTITY_TYPE_COUNT && "Invalid entity type!");
+  entity_t e = {type, blocks[type].add(pos, mass)};
+  return e;
+}
+
+uint32_t scene_t::size(void) const {
+  uint32_t n = 0;
+  for (uint32_t t = 0; t < ENTITY_TYPE_COUNT; ++t)
+    n += blocks[t].size();
+  return n;
+}
+
+void scene_t::clear(void) {
+  for (uint32_t t = 0; t < ENTITY_TYPE_COUNT; ++t)
+    blocks[t].clear();
+  time = 0.0;
+}
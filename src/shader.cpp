@@ -0,0 +1,196 @@
+#include "shader.h"
+#include "gl-ext.h"
+
+#include <cstring>
+
+// bytes of one element of a uniform of the given type
+static uint32_t uniform_bytes(GLenum type) {
+  switch (type) {
+  case GL_FLOAT_VEC2:
+  case GL_INT_VEC2:
+    return 8;
+  case GL_FLOAT_VEC3:
+  case GL_INT_VEC3:
+    return 12;
+  case GL_FLOAT_VEC4:
+  case GL_INT_VEC4:
+  case GL_FLOAT_MAT2:
+    return 16;
+  case GL_FLOAT_MAT3:
+    return 36;
+  case GL_FLOAT_MAT4:
+    return 64;
+  default: // scalars, booleans and samplers
+    return 4;
+  }
+}
+
+// whether glUniform1i can set a uniform of the given type: int, bool and
+// the samplers, but not uint, which needs glUniform1ui
+static bool is_int_like(GLenum type) {
+  return uniform_bytes(type) == 4 && type != GL_FLOAT &&
+         type != GL_UNSIGNED_INT;
+}
+
+void shader_program_t::create(const char *vs_src, const char *fs_src) {
+  assert(!handle && "Shader program already created!");
+
+  GLuint vs = create_shader(GL_VERTEX_SHADER, vs_src);
+  GLuint fs = create_shader(GL_FRAGMENT_SHADER, fs_src);
+  handle = create_shader_program(2, vs, fs);
+
+  // the program keeps them alive for as long as it needs them
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+
+  reflect();
+}
+
+void shader_program_t::create_compute(const char *cs_src) {
+  assert(!handle && "Shader program already created!");
+
+  GLuint cs = create_shader(GL_COMPUTE_SHADER, cs_src);
+  handle = create_shader_program(1, cs);
+  glDeleteShader(cs);
+
+  reflect();
+}
+
+void shader_program_t::destroy(void) {
+  gl_state.delete_program(handle);
+  handle = 0;
+  uniforms.clear();
+  uniform_index.clear();
+  attrib_locations.clear();
+  shadow.clear();
+}
+
+void shader_program_t::reflect(void) {
+  GLint count = 0, max_length = 0;
+  uploads = skipped = 0;
+
+  glGetProgramiv(handle, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+  std::vector<char> name(glm::max(max_length, 1));
+
+  uint32_t offset = 0;
+  for (GLint i = 0; i < count; ++i) {
+    uniform_info_t info;
+    glGetActiveUniform(handle, i, (GLsizei)name.size(), NULL, &info.size,
+                       &info.type, name.data());
+
+    // members of uniform blocks have no location of their own
+    info.location = glGetUniformLocation(handle, name.data());
+    if (info.location < 0)
+      continue;
+
+    std::string key = name.data();
+    const size_t bracket = key.find('[');
+    if (bracket != std::string::npos)
+      key.resize(bracket);
+
+    info.offset = offset;
+    info.known = false;
+    offset += uniform_bytes(info.type) * info.size;
+
+    uniform_index[key] = (uniform_t)uniforms.size();
+    uniforms.push_back(info);
+  }
+  shadow.resize(offset);
+
+  glGetProgramiv(handle, GL_ACTIVE_ATTRIBUTES, &count);
+  glGetProgramiv(handle, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+  name.resize(glm::max(max_length, 1));
+
+  for (GLint i = 0; i < count; ++i) {
+    GLint size;
+    GLenum type;
+    glGetActiveAttrib(handle, i, (GLsizei)name.size(), NULL, &size, &type,
+                      name.data());
+    attrib_locations[name.data()] = glGetAttribLocation(handle, name.data());
+  }
+}
+
+shader_program_t::uniform_t shader_program_t::uniform(const char *name) const {
+  auto it = uniform_index.find(name);
+  return it == uniform_index.end() ? -1 : it->second;
+}
+
+GLint shader_program_t::attrib(const char *name) const {
+  auto it = attrib_locations.find(name);
+  return it == attrib_locations.end() ? -1 : it->second;
+}
+
+bool shader_program_t::bind_block(const char *name, GLuint binding) {
+  const GLuint index = glGetUniformBlockIndex(handle, name);
+  if (index == GL_INVALID_INDEX)
+    return false;
+  glUniformBlockBinding(handle, index, binding);
+  return true;
+}
+
+bool shader_program_t::changed(uniform_t u, GLenum type, const void *data,
+                               size_t bytes) {
+  if (u < 0)
+    return false;
+
+  uniform_info_t &info = uniforms[u];
+  assert((info.type == type || (type == GL_INT && is_int_like(info.type))) &&
+         "Uniform set with the wrong type!");
+  assert(bytes <= uniform_bytes(info.type) * info.size &&
+         "Uniform set with too many elements!");
+
+  uint8_t *last = shadow.data() + info.offset;
+  if (info.known && !memcmp(last, data, bytes)) {
+    ++skipped;
+    return false;
+  }
+
+  memcpy(last, data, bytes);
+  // a partial array upload leaves the rest unknown, so only whole ones
+  // count as a known value
+  info.known = bytes == uniform_bytes(info.type) * info.size;
+  ++uploads;
+  return true;
+}
+
+void shader_program_t::set(uniform_t u, GLint v) {
+  if (changed(u, GL_INT, &v, sizeof(v)))
+    glUniform1i(uniforms[u].location, v);
+}
+
+void shader_program_t::set(uniform_t u, GLuint v) {
+  if (changed(u, GL_UNSIGNED_INT, &v, sizeof(v)))
+    glUniform1ui(uniforms[u].location, v);
+}
+
+void shader_program_t::set(uniform_t u, GLfloat v) {
+  if (changed(u, GL_FLOAT, &v, sizeof(v)))
+    glUniform1f(uniforms[u].location, v);
+}
+
+void shader_program_t::set(uniform_t u, const glm::vec2 &v) {
+  if (changed(u, GL_FLOAT_VEC2, glm::value_ptr(v), sizeof(v)))
+    glUniform2fv(uniforms[u].location, 1, glm::value_ptr(v));
+}
+
+void shader_program_t::set(uniform_t u, const glm::vec3 &v) {
+  if (changed(u, GL_FLOAT_VEC3, glm::value_ptr(v), sizeof(v)))
+    glUniform3fv(uniforms[u].location, 1, glm::value_ptr(v));
+}
+
+void shader_program_t::set(uniform_t u, const glm::vec4 &v) {
+  if (changed(u, GL_FLOAT_VEC4, glm::value_ptr(v), sizeof(v)))
+    glUniform4fv(uniforms[u].location, 1, glm::value_ptr(v));
+}
+
+void shader_program_t::set(uniform_t u, const glm::mat4 &v) {
+  if (changed(u, GL_FLOAT_MAT4, glm::value_ptr(v), sizeof(v)))
+    glUniformMatrix4fv(uniforms[u].location, 1, GL_FALSE, glm::value_ptr(v));
+}
+
+void shader_program_t::set(uniform_t u, const glm::mat4 *v, GLsizei count) {
+  if (changed(u, GL_FLOAT_MAT4, v, sizeof(glm::mat4) * count))
+    glUniformMatrix4fv(uniforms[u].location, count, GL_FALSE,
+                       glm::value_ptr(v[0]));
+}
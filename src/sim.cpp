@@ -0,0 +1,136 @@
+#include "sim.h"
+#include "sphere.h"
+#include "cube.h"
+#include "jobs.h"
+#include "trace.h"
+
+#include <chrono>
+
+void sim_snapshot_t::interpolate(entity_type_t type, float alpha,
+                                 std::vector<glm::mat4> *models) const {
+  const std::vector<glm::vec3> &p0 = prev_pos[type];
+  const std::vector<glm::vec3> &p1 = pos[type];
+
+  models->resize(p1.size());
+  glm::mat4 *out = models->data();
+  jobs.parallel_for((uint32_t)p1.size(), 4096,
+                    [&](uint32_t begin, uint32_t end) {
+                      for (uint32_t i = begin; i < end; ++i)
+                        out[i] = glm::translate(glm::mat4(1.0),
+                                                glm::mix(p0[i], p1[i], alpha));
+                    });
+}
+
+void sim_snapshot_t::interpolate(entity_type_t type, float alpha,
+                                 std::vector<glm::vec3> *positions) const {
+  const std::vector<glm::vec3> &p0 = prev_pos[type];
+  const std::vector<glm::vec3> &p1 = pos[type];
+
+  positions->resize(p1.size());
+  glm::vec3 *out = positions->data();
+  jobs.parallel_for((uint32_t)p1.size(), 4096,
+                    [&](uint32_t begin, uint32_t end) {
+                      for (uint32_t i = begin; i < end; ++i)
+                        out[i] = glm::mix(p0[i], p1[i], alpha);
+                    });
+}
+
+// copy the positions of "blk" into "out"
+static void gather_positions(const entity_block_t &blk,
+                             std::vector<glm::vec3> *out) {
+  out->resize(blk.size());
+  for (uint32_t i = 0; i < blk.size(); ++i)
+    (*out)[i] = blk.get_pos(i);
+}
+
+void sim_t::step(void) {
+  TRACE_SCOPE("sim step");
+  for (int t = 0; t < ENTITY_TYPE_COUNT; ++t)
+    gather_positions(scene.blocks[t], &prev_pos[t]);
+
+  const float dt = (float)step_dt;
+  scene.time += step_dt;
+
+  sphere_t::update(&scene[ENTITY_SPHERE], dt);
+  cube_t::update(&scene[ENTITY_CUBE], (float)scene.time);
+
+  colliders.gather(scene);
+  broadphase.build(colliders);
+
+  pairs.clear();
+  broadphase.find_pairs(colliders, &pairs);
+
+  contacts.clear();
+  narrow_phase(colliders, pairs.data(), pairs.size(), &contacts);
+  resolve_contacts(&scene, colliders, contacts);
+
+  ++steps;
+}
+
+uint32_t sim_t::advance_to(double t) {
+  uint32_t n = 0;
+  while (scene.time + step_dt <= t && (!max_catchup || n < max_catchup)) {
+    step();
+    ++n;
+  }
+
+  if (n)
+    publish();
+  return n;
+}
+
+void sim_t::publish(void) {
+  sim_snapshot_t &snap = snapshots.write_buffer();
+  snap.time = scene.time;
+  snap.step = steps;
+
+  for (int t = 0; t < ENTITY_TYPE_COUNT; ++t) {
+    gather_positions(scene.blocks[t], &snap.pos[t]);
+
+    // entities spawned since the last step have no earlier position
+    if (prev_pos[t].size() == snap.pos[t].size())
+      snap.prev_pos[t] = prev_pos[t];
+    else
+      snap.prev_pos[t] = snap.pos[t];
+  }
+
+  snapshots.publish();
+}
+
+void sim_t::start(void) {
+  assert(!running && "Simulation thread is already running!");
+  running = true;
+  thread = std::thread(&sim_t::run, this);
+}
+
+void sim_t::stop(void) {
+  if (!running)
+    return;
+  running = false;
+  thread.join();
+}
+
+void sim_t::run(void) {
+  if (trace.active())
+    trace.name_thread("sim");
+  const tsamplr_t::storage_t origin = tsamplr_t::now();
+  // simulated time at "origin"; pushed back whenever steps are dropped
+  double base = scene.time;
+
+  while (running) {
+    double wall = base + tsamplr_t::convert(tsamplr_t::now() - origin,
+                                            tsamplr_t::_s_);
+    advance_to(wall);
+
+    // fell further behind than max_catchup allows: slow down rather than
+    // trying to make up the difference
+    if (scene.time + step_dt <= wall) {
+      base -= wall - scene.time;
+      wall = scene.time;
+    }
+
+    const double wait = scene.time + step_dt - wall;
+    if (wait > 0.0)
+      std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+  }
+}
@@ -0,0 +1,150 @@
+#include "stream-buffer.h"
+#include "gl-ext.h"
+#include "gl-state.h"
+
+stream_buffer_t stream_buf;
+
+void stream_buffer_t::init(GLsizeiptr region_bytes, bool persistent) {
+  assert(!handle && "Stream buffer is already initialised!");
+  this->persistent = persistent && glext.buffer_storage;
+  create(region_bytes);
+  last_frame_bytes = stalls = grows = 0;
+}
+
+void stream_buffer_t::teardown(void) {
+  if (!handle)
+    return;
+  retire();
+  release_retired();
+}
+
+void stream_buffer_t::create(GLsizeiptr region_bytes) {
+  region_size = region_bytes;
+  frame = 0;
+  head = 0;
+  for (uint32_t i = 0; i < frames_in_flight; ++i)
+    fences[i] = 0;
+
+  const GLsizeiptr size = region_size * frames_in_flight;
+  glGenBuffers(1, &handle);
+  gl_state.bind_buffer(GL_ARRAY_BUFFER, handle);
+
+  if (persistent) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glext.buffer_storage(GL_ARRAY_BUFFER, size, NULL, flags);
+    base = (uint8_t *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    if (!base) {
+      fprintf(stderr, "ERROR: failed to map the stream buffer\n");
+      exit(1);
+    }
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    base = NULL;
+  }
+}
+
+void stream_buffer_t::retire(void) {
+  for (uint32_t i = 0; i < frames_in_flight; ++i) {
+    if (fences[i])
+      glDeleteSync(fences[i]);
+    fences[i] = 0;
+  }
+
+  if (base) {
+    gl_state.bind_buffer(GL_ARRAY_BUFFER, handle);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    base = NULL;
+  }
+  retired.push_back(handle);
+  handle = 0;
+}
+
+void stream_buffer_t::release_retired(void) {
+  // draws already queued keep the storage alive until they are done
+  if (!retired.empty())
+    gl_state.delete_buffers((GLsizei)retired.size(), retired.data());
+  retired.clear();
+}
+
+void *stream_buffer_t::map(GLsizeiptr size, GLsizeiptr align,
+                           GLintptr *offset) {
+  assert(handle && "Stream buffer is not initialised!");
+  assert(size > 0 && align > 0 && "Invalid stream allocation!");
+
+  // alignments need not be powers of two (ImDrawVert is 20 bytes)
+  const GLsizeiptr start = frame * region_size;
+  GLsizeiptr at = (start + head + align - 1) / align * align;
+
+  if (at + size > start + region_size) {
+    // the frame has outgrown its region. What the old buffer holds stays
+    // valid until the frame ends, and the GPU is never waited on for the
+    // new one, which it has not used.
+    GLsizeiptr region = region_size * 2;
+    while (region < size + align)
+      region *= 2;
+    retire();
+    create(region);
+    ++grows;
+    printf("... stream buffer grown to %ld bytes a frame\n", (long)region);
+    at = (head + align - 1) / align * align;
+  }
+
+  head = at + size - frame * region_size;
+  *offset = at;
+
+  gl_state.bind_buffer(GL_ARRAY_BUFFER, handle);
+  if (base)
+    return base + at;
+
+  void *ptr = glMapBufferRange(GL_ARRAY_BUFFER, at, size,
+                               GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                   GL_MAP_INVALIDATE_RANGE_BIT);
+  if (!ptr) {
+    fprintf(stderr, "ERROR: failed to map %ld bytes of the stream buffer\n",
+            (long)size);
+    exit(1);
+  }
+  return ptr;
+}
+
+void stream_buffer_t::unmap(void) {
+  // coherent mappings need no flush
+  if (base)
+    return;
+  gl_state.bind_buffer(GL_ARRAY_BUFFER, handle);
+  if (!glUnmapBuffer(GL_ARRAY_BUFFER)) {
+    fprintf(stderr, "ERROR: stream buffer contents were lost\n");
+    exit(1);
+  }
+}
+
+void stream_buffer_t::end_frame(void) {
+  if (!handle)
+    return;
+
+  release_retired();
+  fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame = (frame + 1) % frames_in_flight;
+  last_frame_bytes = head;
+  head = 0;
+
+  // the GPU must be done with what this region held frames_in_flight
+  // frames ago before it is overwritten
+  GLsync &fence = fences[frame];
+  if (!fence)
+    return;
+
+  GLenum status = glClientWaitSync(fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    ++stalls;
+    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              GL_TIMEOUT_IGNORED);
+  }
+  if (status == GL_WAIT_FAILED) {
+    fprintf(stderr, "ERROR: failed to wait on a stream buffer fence\n");
+    exit(1);
+  }
+  glDeleteSync(fence);
+  fence = 0;
+}
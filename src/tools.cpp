@@ -1,8 +1,26 @@
-
 #include "tools.h"
+#include "mesh-opt.h"
+#include "jobs.h"
+#include "trace.h"
+
+#include <algorithm>
+
+// vertices generated per job system chunk of a large mesh
+static const uint32_t vtx_per_chunk = 16384;
+
+// rows per chunk, for a mesh generated "row_vtx" vertices to a row
+static uint32_t row_grain(size_t row_vtx) {
+  return glm::max(1U, vtx_per_chunk / (uint32_t)glm::max<size_t>(row_vtx, 1));
+}
+
+static void resize_mesh(const mesh_size_t &sz, mesh_t *m) {
+  m->vtx_data.resize(sz.vtx);
+  m->idx_data.resize(sz.idx);
+  m->txcrd_data.resize(sz.txcrd);
+  m->norm_data.resize(sz.norm);
+}
 
 void make_quad(const mesh_create_info_t* info, mesh_t *m) {
-  printf("prepare quad mesh\n");
   assert(m != NULL && "null pointer");
 
   float l = info->sz_param0 / 2.0f;
@@ -27,101 +45,385 @@ void make_quad(const mesh_create_info_t* info, mesh_t *m) {
 }
 
 void make_grid(const mesh_create_info_t* info, mesh_t *m) {
-  printf("preparing grid mesh\n");
   assert(m != NULL && "null pointer");
 
-  size_t size_xdim = info->sz_param0, size_zdim = info->sz_param1;
+  const size_t size_xdim = info->sz_param0, size_zdim = info->sz_param1;
 
   /*both size parameters must be perfectly divisible by two*/
   assert(((size_xdim % 2) == 0) && ((size_zdim % 2) == 0));
 
-  const uint32_t vtx_cnt = size_xdim * size_zdim;
-  const uint32_t hlf_xdim = size_xdim / 2;
-  const uint32_t hlf_zdim = size_zdim / 2;
+  const float hlf_xdim = size_xdim / 2;
+  const float hlf_zdim = size_zdim / 2;
+  const glm::vec2 txcrd_scale(1.0f / (size_xdim - 1), 1.0f / (size_zdim - 1));
+
+  const uint32_t idx_per_sqr = 6u; // two triangles
+
+  glm::vec3 *vtx = m->vtx_data.data();
+  glm::vec3 *nrm = m->norm_data.data();
+  glm::vec2 *txcrd = m->txcrd_data.data();
+  uint32_t *idx = m->idx_data.data();
+
+  // one row of vertices, and the row of squares above it, at a time
+  jobs.parallel_for(size_zdim, row_grain(size_xdim),
+                    [=](uint32_t begin, uint32_t end) {
+    for (uint32_t z = begin; z < end; z++) {
+      const uint32_t row = z * size_xdim;
+      for (uint32_t x = 0; x < size_xdim; x++) {
+        vtx[row + x] = glm::vec3((float)x - hlf_xdim, 0.0f, (float)z - hlf_zdim);
+        nrm[row + x] = glm::vec3(0.0f, 1.0f, 0.0f);
+        txcrd[row + x] = glm::vec2((float)x, (float)z) * txcrd_scale;
+      }
+
+      if (z == size_zdim - 1)
+        continue;
+
+      uint32_t *out = idx + z * (size_xdim - 1) * idx_per_sqr;
+      for (uint32_t x = 0; x < size_xdim - 1; x++) {
+        const uint32_t v = row + x;
+        *out++ = v;
+        *out++ = v + size_xdim;
+        *out++ = v + size_xdim + 1;
+
+        *out++ = v;
+        *out++ = v + size_xdim + 1;
+        *out++ = v + 1;
+      }
+    }
+  });
+}
 
-  m->vtx_data.reserve(vtx_cnt);
+// A profile curve in the (radial, y) half-plane, one point per ring of
+// the surface it sweeps out around the y axis. Each point carries the
+// surface normal in the same plane and its texture v coordinate. Rings
+// with zero radius are poles; consecutive rings at the same place are a
+// crease, giving the two sides their own normals.
+struct profile_pt_t {
+  float r, y;   // position
+  float nr, ny; // normal
+  float v;
+};
+typedef std::vector<profile_pt_t> profile_t;
+
+// "segs" segments of the arc of circle around "centre" from angle "from"
+// to "to", measured from +y towards +r
+static void profile_arc(profile_t *p, const glm::vec2 &centre, float radius,
+                        float from, float to, uint32_t segs) {
+  for (uint32_t i = 0; i <= segs; i++) {
+    const float a = from + (to - from) * i / segs;
+    const glm::vec2 n(sin(a), cos(a));
+    profile_pt_t pt = { centre.x + radius * n.x, centre.y + radius * n.y,
+                        n.x, n.y, 0.0f };
+    // land exactly on the axis, so the engine sees a pole
+    if (fabs(pt.r) < 1e-6f * radius)
+      pt.r = 0.0f;
+    p->push_back(pt);
+  }
+}
 
-  for (auto i = 0u; i < vtx_cnt; i++) {
-    m->vtx_data.push_back(glm::vec3(0.0, 0.0, 0.0));
+// "segs" segments of the line from "a" to "b"
+static void profile_line(profile_t *p, const glm::vec2 &a, const glm::vec2 &b,
+                         uint32_t segs) {
+  const glm::vec2 t = b - a;
+  const glm::vec2 n = glm::vec2(-t.y, t.x) / glm::length(t);
+  for (uint32_t i = 0; i <= segs; i++) {
+    // exactly "b" at the end, so creases find their twin
+    const glm::vec2 pos = i == segs ? b : a + t * ((float)i / segs);
+    p->push_back({ pos.x, pos.y, n.x, n.y, 0.0f });
   }
+}
 
-  for (auto x = 0u; x < size_xdim; x++) {
-    for (auto z = 0u; z < size_zdim; z++) {
-      m->vtx_data[x + (z * size_xdim)] =
-          glm::vec3((float)x - hlf_xdim, 0.0f, (float)z - hlf_zdim);
-    }
+// v runs from 0 to 1 with distance along the curve
+static void profile_parametrise(profile_t *p) {
+  float len = 0.0f;
+  for (size_t i = 1; i < p->size(); i++) {
+    len += glm::length(glm::vec2((*p)[i].r - (*p)[i - 1].r,
+                                 (*p)[i].y - (*p)[i - 1].y));
+    (*p)[i].v = len;
   }
+  for (profile_pt_t &pt : *p)
+    pt.v /= len;
+}
 
-  const uint32_t tri_per_sqr = 2u;
-  const uint32_t idx_per_sqr = 4u;
-  const uint32_t idx_cnt =
-      ((size_xdim - 1) * (size_zdim - 1)) * tri_per_sqr * idx_per_sqr;
+// triangles of the band between rings "i" and "i + 1", per segment
+static uint32_t band_tris(const profile_t &p, size_t i) {
+  if (p[i].r == p[i + 1].r && p[i].y == p[i + 1].y)
+    return 0; // crease
+  return (p[i + 1].r != 0.0f) + (p[i].r != 0.0f);
+}
 
-  m->idx_data.reserve(idx_cnt);
+static mesh_size_t revolution_size(const profile_t &p, uint32_t slices) {
+  size_t tris = 0;
+  for (size_t i = 0; i + 1 < p.size(); i++)
+    tris += band_tris(p, i);
 
-  for (auto x = 0u; x < size_xdim - 1; x++) {
-    for (auto z = 0u; z < size_zdim - 1; z++) {
-      m->idx_data.push_back(x + (z * size_xdim));
-      m->idx_data.push_back(x + (z * size_xdim) + size_xdim);
-      m->idx_data.push_back(x + (z * size_xdim) + size_xdim + 1);
+  const size_t vtx = (slices + 1) * p.size();
+  return { vtx, 3 * tris * slices, vtx, vtx };
+}
 
-      m->idx_data.push_back(x + (z * size_xdim));
-      m->idx_data.push_back(x + (z * size_xdim) + size_xdim + 1);
-      m->idx_data.push_back((x + 1) + (z * size_xdim));
+// columns of squares the triangles of a surface of revolution are ordered
+// in. Walking down a column narrow enough for two of its rows of vertices
+// to fit a 32-entry post-transform cache, most vertices are shaded once
+// instead of once per ring they border (ACMR ~0.55 on a sphere, rather
+// than ~1.05 in ring order).
+static const uint32_t revolution_column = 12;
+
+// Sweep profile "p" around the y axis in "slices" segments. Each ring is
+// one evaluation of the profile, and the sweep is a branch-free pass of
+// multiply-adds over a table of the segment angles' sines and cosines.
+// The seam and the poles are duplicated per segment, so texture
+// coordinates are continuous everywhere.
+static void make_revolution(const profile_t &p, uint32_t slices, mesh_t *m) {
+  assert(slices >= 3 && p.size() >= 2 && "Degenerate surface!");
+
+  std::vector<float> sin_u(slices + 1), cos_u(slices + 1), tex_u(slices + 1);
+  for (uint32_t s = 0; s <= slices; s++) {
+    const float phi = glm::radians(360.0f * s / slices);
+    sin_u[s] = sin(phi);
+    cos_u[s] = cos(phi);
+    tex_u[s] = (float)s / slices;
+  }
+
+  glm::vec3 *vtx = m->vtx_data.data();
+  glm::vec3 *nrm = m->norm_data.data();
+  glm::vec2 *txcrd = m->txcrd_data.data();
+  uint32_t *idx = m->idx_data.data();
+  const profile_pt_t *prof = p.data();
+  const float *su = sin_u.data(), *cu = cos_u.data(), *tu = tex_u.data();
+  const uint32_t rings = (uint32_t)p.size(), row = slices + 1;
+
+  jobs.parallel_for(rings, row_grain(row), [=](uint32_t begin, uint32_t end) {
+    for (uint32_t r = begin; r < end; r++) {
+      const profile_pt_t pt = prof[r];
+      glm::vec3 *v = vtx + r * row, *n = nrm + r * row;
+      glm::vec2 *t = txcrd + r * row;
+      for (uint32_t s = 0; s <= slices; s++) {
+        v[s] = glm::vec3(pt.r * su[s], pt.y, pt.r * cu[s]);
+        n[s] = glm::vec3(pt.nr * su[s], pt.ny, pt.nr * cu[s]);
+        t[s] = glm::vec2(tu[s], pt.v);
+      }
+    }
+  });
+
+  const uint32_t columns = (slices + revolution_column - 1) / revolution_column;
+  const size_t idx_per_slice = m->idx_data.size() / slices;
+
+  jobs.parallel_for(columns, row_grain(revolution_column * rings),
+                    [=](uint32_t begin, uint32_t end) {
+    for (uint32_t col = begin; col < end; col++) {
+      const uint32_t first = col * revolution_column;
+      const uint32_t last = glm::min(first + revolution_column, slices);
+
+      uint32_t *out = idx + first * idx_per_slice;
+      for (uint32_t r = 0; r + 1 < rings; r++) {
+        if (prof[r].r == prof[r + 1].r && prof[r].y == prof[r + 1].y)
+          continue; // crease
+
+        // only one triangle of each square touching a pole has any area
+        const bool upper = prof[r + 1].r != 0.0f, lower = prof[r].r != 0.0f;
+        for (uint32_t s = first; s < last; s++) {
+          const uint32_t a = r * row + s, b = a + row, c = b + 1, d = a + 1;
+          if (upper) {
+            *out++ = a;
+            *out++ = b;
+            *out++ = c;
+          }
+          if (lower) {
+            *out++ = a;
+            *out++ = c;
+            *out++ = d;
+          }
+        }
+      }
     }
+  });
+}
+
+// profile of the surface "info" describes, and its number of segments
+// around. Shapes are centred on the origin with their axis along y.
+static uint32_t revolution_profile(const mesh_create_info_t *info,
+                                   profile_t *p) {
+  const float pi = (float)M_PI;
+  uint32_t slices = info->res_u;
+
+  // a profile of no segments has no points to sweep, and release builds
+  // would generate NaNs from it
+  const uint32_t around =
+      info->type == SPHERE ? (uint32_t)info->sz_param1 : info->res_u;
+  const uint32_t along =
+      info->type == SPHERE ? (uint32_t)info->sz_param2 : info->res_v;
+  if (around < 3 || !along) {
+    fprintf(stderr, "ERROR: %s mesh needs 3 segments around and 1 along, "
+                    "not %u and %u\n",
+            mesh_type_name(info->type), around, along);
+    exit(1);
   }
 
-  for (auto i = 0u; i < vtx_cnt; i++) {
-    m->norm_data.push_back(glm::vec3(0.0, 1.0, 0.0));
+  switch (info->type) {
+  case SPHERE: {
+    // diameter; segments around and rings from pole to pole
+    slices = info->sz_param1;
+    const uint32_t rings = info->sz_param2;
+    p->reserve(rings + 1);
+    profile_arc(p, glm::vec2(0.0f), info->sz_param0 / 2.0f, 0.0f, pi, rings);
+    break;
+  }
+  case TORUS: {
+    // radius of the ring, radius of the tube
+    const float ring = info->sz_param0, tube = info->sz_param1;
+    p->reserve(info->res_v + 1);
+    profile_arc(p, glm::vec2(ring, 0.0f), tube, 0.0f, 2.0f * pi, info->res_v);
+    break;
+  }
+  case DISC: {
+    // diameter, facing +y
+    const float radius = info->sz_param0 / 2.0f;
+    p->reserve(info->res_v + 1);
+    profile_line(p, glm::vec2(0.0f), glm::vec2(radius, 0.0f), info->res_v);
+    break;
+  }
+  case CYLINDER: {
+    // diameter, height; capped at both ends
+    const float radius = info->sz_param0 / 2.0f, half = info->sz_param1 / 2.0f;
+    p->reserve(info->res_v + 5);
+    profile_line(p, glm::vec2(0.0f, half), glm::vec2(radius, half), 1);
+    profile_line(p, glm::vec2(radius, half), glm::vec2(radius, -half),
+                 info->res_v);
+    profile_line(p, glm::vec2(radius, -half), glm::vec2(0.0f, -half), 1);
+    break;
+  }
+  case CONE: {
+    // diameter of the base, height; apex up, base capped
+    const float radius = info->sz_param0 / 2.0f, half = info->sz_param1 / 2.0f;
+    p->reserve(info->res_v + 3);
+    profile_line(p, glm::vec2(0.0f, half), glm::vec2(radius, -half),
+                 info->res_v);
+    profile_line(p, glm::vec2(radius, -half), glm::vec2(0.0f, -half), 1);
+    break;
+  }
+  case CAPSULE: {
+    // diameter, height from tip to tip; res_v rings in the two caps
+    const float radius = info->sz_param0 / 2.0f;
+    const float half = glm::max(info->sz_param1 / 2.0f - radius, 0.0f);
+    const uint32_t segs = glm::max(info->res_v / 2, 1U);
+    p->reserve(2 * segs + 2);
+    profile_arc(p, glm::vec2(0.0f, half), radius, 0.0f, pi / 2.0f, segs);
+    profile_arc(p, glm::vec2(0.0f, -half), radius, pi / 2.0f, pi, segs);
+    break;
+  }
+  default:
+    assert(0 && "Not a surface of revolution!");
   }
 
-  m->txcrd_data = {
-    { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f }
-  };
+  profile_parametrise(p);
+  return slices;
 }
 
-void make_sphere(const mesh_create_info_t* info, mesh_t *m) {
-  printf("preparing sphere mesh\n");
+void make_surface(const mesh_create_info_t* info, mesh_t *m) {
   assert(m != NULL && "null pointer");
 
-  float radius = info->sz_param0 / 2.0f;
-  int latitudes = info->sz_param1;
-  int longitudes = info->sz_param2;
+  profile_t p;
+  const uint32_t slices = revolution_profile(info, &p);
+  make_revolution(p, slices, m);
+}
 
-  m->vtx_data.resize(latitudes * longitudes);
+// Icosahedron subdivided "levels" times, each triangle into four, with
+// the new vertices pushed out onto the sphere. Every vertex is shared by
+// all of its triangles. A triangle's children are emitted together, so
+// consecutive triangles stay close on the surface and reuse each other's
+// vertices. Texture coordinates are the equirectangular mapping of the
+// shared vertices and so wrap across the triangles on the u = 0 seam;
+// use SPHERE where that matters.
+void make_icosphere(const mesh_create_info_t* info, mesh_t *m) {
+  assert(m != NULL && "null pointer");
 
-  float latitude_increment = 360.0f / latitudes;
-  float longitude_increment = 180.0f / longitudes;
+  const float radius = info->sz_param0 / 2.0f;
+  const uint32_t levels = info->sz_param1;
 
-  for (float u = 0; u < 360.0f; u += latitude_increment) {
-    for (float t = 0; t < 180.0f; t += longitude_increment) {
-      float rad = radius;
+  const float t = (1.0f + sqrt(5.0f)) / 2.0f;
+  const glm::vec3 corners[12] = {
+    { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+    { 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+    { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+  };
+  // counter-clockwise seen from outside
+  const uint32_t faces[20 * 3] = {
+    0, 11, 5, /**/ 0, 5, 1,  /**/ 0, 1, 7,   /**/ 0, 7, 10, /**/ 0, 10, 11,
+    1, 5, 9,  /**/ 5, 11, 4, /**/ 11, 10, 2, /**/ 10, 7, 6, /**/ 7, 1, 8,
+    3, 9, 4,  /**/ 3, 4, 2,  /**/ 3, 2, 6,   /**/ 3, 6, 8,  /**/ 3, 8, 9,
+    4, 9, 5,  /**/ 2, 4, 11, /**/ 6, 2, 10,  /**/ 8, 6, 7,  /**/ 9, 8, 1
+  };
 
-      float x = (float)(rad * sin(glm::radians(t)) * sin(glm::radians(u)));
-      float y = (float)(rad * cos(glm::radians(t)));
-      float z = (float)(rad * sin(glm::radians(t)) * cos(glm::radians(u)));
+  // unit positions double as the normals
+  glm::vec3 *nrm = m->norm_data.data();
+  uint32_t vtx_cnt = 0;
+  for (const glm::vec3 &c : corners)
+    nrm[vtx_cnt++] = glm::normalize(c);
+
+  // the triangles ping-pong between the index array and a scratch copy,
+  // starting from whichever makes the last level land in the index array
+  std::vector<uint32_t> scratch(m->idx_data.size() / 4);
+  uint32_t *src = levels % 2 ? scratch.data() : m->idx_data.data();
+  uint32_t *dst = levels % 2 ? m->idx_data.data() : scratch.data();
+  std::copy(faces, faces + 20 * 3, src);
+
+  // midpoints of the current level's edges, filed under the lower of the
+  // two vertices: no vertex of an icosphere has more than six neighbours
+  const size_t max_edge_ends = m->vtx_data.size() / 4 + 2;
+  std::vector<uint32_t> edge_cnt(max_edge_ends);
+  std::vector<uint32_t> edge_hi(max_edge_ends * 6), edge_mid(max_edge_ends * 6);
+  auto midpoint = [&](uint32_t a, uint32_t b) {
+    const uint32_t lo = glm::min(a, b), hi = glm::max(a, b);
+    uint32_t *his = &edge_hi[lo * 6], *mids = &edge_mid[lo * 6];
+    for (uint32_t k = 0; k < edge_cnt[lo]; k++)
+      if (his[k] == hi)
+        return mids[k];
+
+    assert(edge_cnt[lo] < 6 && "Icosphere vertex with over six edges!");
+    his[edge_cnt[lo]] = hi;
+    mids[edge_cnt[lo]++] = vtx_cnt;
+    nrm[vtx_cnt] = glm::normalize(nrm[a] + nrm[b]);
+    return vtx_cnt++;
+  };
 
-      m->vtx_data.push_back({ x, y, z });
+  uint32_t tri_cnt = 20;
+  for (uint32_t l = 0; l < levels; l++, tri_cnt *= 4) {
+    std::fill(edge_cnt.begin(), edge_cnt.begin() + vtx_cnt, 0U);
 
-      float x1 = (float)(rad * sin(glm::radians(t + longitude_increment)) *
-                         sin(glm::radians(u + latitude_increment)));
-      float y1 = (float)(rad * cos(glm::radians(t + longitude_increment)));
-      float z1 = (float)(rad * sin(glm::radians(t + longitude_increment)) *
-                         cos(glm::radians(u + latitude_increment)));
+    uint32_t *out = dst;
+    for (uint32_t f = 0; f < tri_cnt; f++) {
+      const uint32_t a = src[f * 3], b = src[f * 3 + 1], c = src[f * 3 + 2];
+      const uint32_t ab = midpoint(a, b), bc = midpoint(b, c),
+                     ca = midpoint(c, a);
 
-      m->vtx_data.push_back({ x1, y1, z1 });
+      const uint32_t children[12] = { a, ab, ca, /**/ b, bc, ab,
+                                      c, ca, bc, /**/ ab, bc, ca };
+      out = std::copy(children, children + 12, out);
     }
+    std::swap(src, dst);
   }
+  assert(vtx_cnt == m->vtx_data.size() && "Icosphere vertex count mismatch!");
+
+  glm::vec3 *vtx = m->vtx_data.data();
+  glm::vec2 *txcrd = m->txcrd_data.data();
+  jobs.parallel_for(vtx_cnt, vtx_per_chunk, [=](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++) {
+      const glm::vec3 &n = nrm[i];
+      vtx[i] = radius * n;
+      txcrd[i] = glm::vec2(0.5f + atan2(n.x, n.z) / (float)(2.0 * M_PI),
+                           acos(glm::clamp(n.y, -1.0f, 1.0f)) / (float)M_PI);
+    }
+  });
 }
 
+// Each face has its own four vertices, so that it can carry its own
+// normal and texture coordinates.
 void make_cube(const mesh_create_info_t *info, mesh_t *m) {
-  printf("preparing cube mesh\n");
   assert(m != NULL && "null pointer");
 
   float size_x = info->sz_param0, size_y = info->sz_param1,
         size_z = info->sz_param2;
 
-  m->vtx_data = {
+  const glm::vec3 corners[8] = {
     // front quad
     { -size_x, -size_y, size_z }, // 0
     { size_x, -size_y, size_z },  // 1
@@ -135,50 +437,84 @@ void make_cube(const mesh_create_info_t *info, mesh_t *m) {
     { -size_x, size_y, -size_z }   // 7
   };
 
-  m->idx_data = {
-    // front
-    0U, 1U, 2U, /**/ 2U, 3U, 0U,
-    // top
-    3U, 2U, 6U, /**/ 6U, 7U, 3U,
-    // back
-    7U, 6U, 5U, /**/ 5U, 4U, 7U,
-    // bottom
-    4U, 5U, 1U, /**/ 1U, 0U, 4U,
-    // left
-    4U, 0U, 3U, /**/ 3U, 7U, 4U,
-    // right
-    1U, 5U, 6U, /**/ 6U, 2U, 1U
+  // corners of each face, counter-clockwise seen from outside
+  const struct {
+    uint32_t corner[4];
+    glm::vec3 normal;
+  } faces[6] = {
+    { { 0U, 1U, 2U, 3U }, { 0.0f, 0.0f, 1.0f } },  // front
+    { { 3U, 2U, 6U, 7U }, { 0.0f, 1.0f, 0.0f } },  // top
+    { { 7U, 6U, 5U, 4U }, { 0.0f, 0.0f, -1.0f } }, // back
+    { { 4U, 5U, 1U, 0U }, { 0.0f, -1.0f, 0.0f } }, // bottom
+    { { 4U, 0U, 3U, 7U }, { -1.0f, 0.0f, 0.0f } }, // left
+    { { 1U, 5U, 6U, 2U }, { 1.0f, 0.0f, 0.0f } }   // right
   };
 
-  for (uint32_t vertex = 0u; vertex < m->idx_data.size(); vertex++) {
-    if (vertex < 6)
-      m->norm_data.push_back({ 0.0f, 0.0f, 1.0f }); // front
-    if (vertex >= 6 && vertex < 12)
-      m->norm_data.push_back({ 0.0f, 1.0f, 0.0f }); // top
-    if (vertex >= 12 && vertex < 18)
-      m->norm_data.push_back({ 0.0f, 0.0f, -1.0f }); // back
-    if (vertex >= 18 && vertex < 24)
-      m->norm_data.push_back({ 0.0f, -1.0f, 0.0f }); // bottom
-    if (vertex >= 24 && vertex < 30)
-      m->norm_data.push_back({ -1.0f, 0.0f, 0.0f }); // left
-    if (vertex >= 32 && vertex < 36)
-      m->norm_data.push_back({ 1.0f, 0.0f, 0.0f }); // right
-  }
-
-  // not perfect
-  m->txcrd_data.push_back(glm::vec2(0.0, 0.0));
-  m->txcrd_data.push_back(glm::vec2(1.0, 0.0));
-  m->txcrd_data.push_back(glm::vec2(1.0, 1.0));
-  m->txcrd_data.push_back(glm::vec2(0.0, 1.0));
-}
-
-void make_torus(const mesh_create_info_t* info, mesh_t *m) {
-  printf("preparing torus mesh\n");
-  assert(m != NULL && "null pointer");
+  const glm::vec2 txcrds[4] = {
+    { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f }
+  };
+
+  for (uint32_t f = 0; f < 6; f++) {
+    for (uint32_t c = 0; c < 4; c++) {
+      m->vtx_data[f * 4 + c] = corners[faces[f].corner[c]];
+      m->norm_data[f * 4 + c] = faces[f].normal;
+      m->txcrd_data[f * 4 + c] = txcrds[c];
+    }
+
+    const uint32_t quad[6] = { 0U, 1U, 2U, /**/ 2U, 3U, 0U };
+    for (uint32_t i = 0; i < 6; i++)
+      m->idx_data[f * 6 + i] = f * 4 + quad[i];
+  }
 }
 
-void create_mesh_data(const mesh_create_info_t *info, mesh_t *m) {
+mesh_size_t mesh_data_size(const mesh_create_info_t *info) {
+  mesh_size_t sz = {0, 0, 0, 0};
+
+  switch (info->type) {
+  case QUAD:
+    sz.vtx = 4;
+    sz.idx = 6;
+    break;
+  case GRID: {
+    const size_t size_xdim = info->sz_param0, size_zdim = info->sz_param1;
+    sz.vtx = size_xdim * size_zdim;
+    sz.idx = (size_xdim - 1) * (size_zdim - 1) * 6;
+    break;
+  }
+  case SPHERE:
+  case TORUS:
+  case DISC:
+  case CYLINDER:
+  case CONE:
+  case CAPSULE: {
+    profile_t p;
+    const uint32_t slices = revolution_profile(info, &p);
+    return revolution_size(p, slices);
+  }
+  case ICOSPHERE: {
+    // each level splits every triangle in four and adds a vertex per edge
+    const size_t tris = (size_t)20 << (2 * (uint32_t)info->sz_param1);
+    sz.vtx = tris / 2 + 2;
+    sz.idx = tris * 3;
+    break;
+  }
+  case CUBE:
+    sz.vtx = 24;
+    sz.idx = 36;
+    break;
+  default:
+    assert(0 && "Invalid mesh type!");
+  };
+
+  sz.txcrd = sz.norm = sz.vtx;
+  return sz;
+}
+
+void generate_mesh_data(const mesh_create_info_t *info, mesh_t *m) {
   assert(m != NULL && "null pointer");
+  TRACE_SCOPE("generate_mesh_data");
+
+  resize_mesh(mesh_data_size(info), m);
 
   switch (info->type) {
   case QUAD:
@@ -187,31 +523,58 @@ void create_mesh_data(const mesh_create_info_t *info, mesh_t *m) {
   case GRID:
     make_grid(info, m);
     break;
-  case DISC:
-    make_grid(info, m);
-    break;
   case SPHERE:
-    make_sphere(info, m);
+  case TORUS:
+  case DISC:
+  case CYLINDER:
+  case CONE:
+  case CAPSULE:
+    make_surface(info, m);
     break;
   case CUBE:
     make_cube(info, m);
     break;
-  case TORUS:
-    make_torus(info, m);
+  case ICOSPHERE:
+    make_icosphere(info, m);
     break;
   default:
     assert(0 && "Invalid mesh type!");
   };
+}
+
+const char *mesh_type_name(mesh_type type) {
+  static const char *type_names[] = {"quad", "grid",  "disc",
+                                     "sphere", "cube", "torus",
+                                     "icosphere", "cylinder", "cone",
+                                     "capsule"};
+  return type_names[type];
+}
+
+void create_mesh_data(const mesh_create_info_t *info, mesh_t *m) {
+  TRACE_SCOPE("create_mesh_data");
+  printf("preparing %s mesh\n", mesh_type_name(info->type));
+
+  generate_mesh_data(info, m);
+
+  // the generators' own orders are already good for some shapes; keep
+  // them where Tipsify cannot do better
+  const vertex_cache_stats_t before = analyze_vertex_cache(m);
+  const bool reordered = optimize_vertex_cache(m);
+  optimize_vertex_fetch(m);
+  const vertex_cache_stats_t after = analyze_vertex_cache(m);
 
   auto print = [](size_t count, size_t type_size, const char *data) {
-    printf("... number of %s: %lu [%.2f Mb]", data, count,
-           (float)(count * type_size) / 2048.0f);
+    printf("... number of %s: %lu [%.2f Mb]\n", data, count,
+           (float)(count * type_size) / (1024.0f * 1024.0f));
   };
 
   print(m->vtx_data.size(), sizeof(glm::vec3), "vertices");
   print(m->idx_data.size(), sizeof(uint32_t), "indices");
   print(m->txcrd_data.size(), sizeof(glm::vec2), "tex-coords");
   print(m->norm_data.size(), sizeof(glm::vec3), "normals");
+  printf("... vertex cache (FIFO %u): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f%s\n",
+         vertex_cache_size, before.acmr, after.acmr, before.atvr, after.atvr,
+         reordered ? "" : " (kept generated order)");
 }
 
 void destroy_mesh_data(mesh_t *ptr) {
@@ -236,3 +599,102 @@ void destroy_mesh_data(mesh_t *ptr) {
   }
 }
 
+// x/|x|, with zero counted as positive
+static inline glm::vec2 sign_not_zero(const glm::vec2 &v) {
+  return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+// map the unit sphere onto the [-1, 1] square: project onto the
+// octahedron |x| + |y| + |z| = 1, then fold the lower half out over the
+// corners
+static inline glm::vec2 oct_encode(const glm::vec3 &n) {
+  const glm::vec3 o = n / (fabs(n.x) + fabs(n.y) + fabs(n.z));
+  const glm::vec2 e(o.x, o.y);
+  if (o.z >= 0.0f)
+    return e;
+  return (glm::vec2(1.0f) - glm::vec2(fabs(e.y), fabs(e.x))) *
+         sign_not_zero(e);
+}
+
+static inline int16_t to_snorm16(float v) {
+  return (int16_t)round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+vtx_decode_t pack_vertices(const mesh_t *m, std::vector<packed_vtx_t> *out) {
+  assert(m != NULL && out != NULL && "null pointer");
+
+  const size_t count = m->vtx_data.size();
+  out->resize(count);
+
+  glm::vec3 lo(0.0f), hi(0.0f);
+  if (count) {
+    lo = hi = m->vtx_data[0];
+    for (const glm::vec3 &v : m->vtx_data) {
+      lo = glm::min(lo, v);
+      hi = glm::max(hi, v);
+    }
+  }
+
+  // the box maps onto [-32767, 32767]; flat axes keep a zero scale
+  const glm::vec3 centre = (lo + hi) * 0.5f;
+  const glm::vec3 half = (hi - lo) * 0.5f;
+  const glm::vec3 scale = half / 32767.0f;
+  const glm::vec3 inv(half.x > 0.0f ? 1.0f / half.x : 0.0f,
+                      half.y > 0.0f ? 1.0f / half.y : 0.0f,
+                      half.z > 0.0f ? 1.0f / half.z : 0.0f);
+
+  const glm::vec3 *vtx = m->vtx_data.data();
+  const glm::vec3 *nrm =
+      m->norm_data.size() == count ? m->norm_data.data() : NULL;
+  const glm::vec2 *txcrd =
+      m->txcrd_data.size() == count ? m->txcrd_data.data() : NULL;
+  packed_vtx_t *dst = out->data();
+
+  // texture coordinates map [-extent, extent] onto [-32767, 32767]; the
+  // extent is at least 1, so coordinates in [0, 1] all keep 15 bits
+  float txcrd_extent = 1.0f;
+  for (size_t i = 0; txcrd && i < count; i++)
+    txcrd_extent = glm::max(txcrd_extent, glm::max(fabsf(txcrd[i].x),
+                                                   fabsf(txcrd[i].y)));
+  const float txcrd_inv = 1.0f / txcrd_extent;
+
+  jobs.parallel_for(count, vtx_per_chunk, [=](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++) {
+      packed_vtx_t &p = dst[i];
+      const glm::vec3 q = (vtx[i] - centre) * inv;
+      p.pos[0] = to_snorm16(q.x);
+      p.pos[1] = to_snorm16(q.y);
+      p.pos[2] = to_snorm16(q.z);
+      p.pos[3] = 0;
+
+      const glm::vec2 e = nrm ? oct_encode(nrm[i]) : glm::vec2(0.0f);
+      p.nrm[0] = to_snorm16(e.x);
+      p.nrm[1] = to_snorm16(e.y);
+
+      const glm::vec2 t = txcrd ? txcrd[i] * txcrd_inv : glm::vec2(0.0f);
+      p.txcrd[0] = to_snorm16(t.x);
+      p.txcrd[1] = to_snorm16(t.y);
+    }
+  });
+
+  return { glm::vec4(scale, 1.0f),
+           glm::vec4(centre, txcrd_extent / 32767.0f) };
+}
+
+bool fits_16bit_indices(const mesh_t *m) {
+  // every index is below the vertex count
+  return m->vtx_data.size() <= 65536;
+}
+
+void pack_indices(const mesh_t *m, std::vector<uint16_t> *out) {
+  assert(fits_16bit_indices(m) && "Indices do not fit in 16 bits!");
+
+  out->resize(m->idx_data.size());
+  const uint32_t *src = m->idx_data.data();
+  uint16_t *dst = out->data();
+  jobs.parallel_for(out->size(), 4 * vtx_per_chunk,
+                    [=](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++)
+      dst[i] = (uint16_t)src[i];
+  });
+}
@@ -0,0 +1,150 @@
+#include "trace.h"
+
+trace_t trace;
+
+#if ENABLE_TRACE
+
+#include <mutex>
+
+struct trace_event_t {
+  const char *name;
+  tsamplr_t::storage_t time;
+  char phase; // 'B' or 'E'
+};
+
+struct trace_ring_t {
+  trace_event_t events[trace_t::ring_size];
+  // events ever recorded; event i is at i % ring_size until overwritten
+  std::atomic<uint64_t> head;
+  uint32_t tid;
+  std::atomic<const char *> name;
+};
+
+// the rings of every thread that has recorded, for dump(). Rings outlive
+// their threads, so that what they recorded can still be written.
+static std::mutex rings_lock;
+static std::vector<trace_ring_t *> rings;
+
+static thread_local trace_ring_t *thread_ring = NULL;
+
+// the calling thread's ring, made the first time it records
+static trace_ring_t *get_ring(void) {
+  if (!thread_ring) {
+    trace_ring_t *r = new trace_ring_t;
+    r->head.store(0, std::memory_order_relaxed);
+    r->name.store(NULL, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(rings_lock);
+    r->tid = (uint32_t)rings.size() + 1;
+    rings.push_back(r);
+    thread_ring = r;
+  }
+  return thread_ring;
+}
+
+static inline void record(const char *name, char phase) {
+  trace_ring_t *r = get_ring();
+  const uint64_t head = r->head.load(std::memory_order_relaxed);
+  trace_event_t &e = r->events[head % trace_t::ring_size];
+  e.name = name;
+  e.time = tsamplr_t::now();
+  e.phase = phase;
+  r->head.store(head + 1, std::memory_order_release);
+}
+
+void trace_t::start(void) {
+  if (!origin)
+    origin = tsamplr_t::now();
+  recording.store(true, std::memory_order_relaxed);
+}
+
+void trace_t::stop(void) { recording.store(false, std::memory_order_relaxed); }
+
+void trace_t::begin(const char *name) { record(name, 'B'); }
+
+void trace_t::end(const char *name) { record(name, 'E'); }
+
+void trace_t::name_thread(const char *name) {
+  get_ring()->name.store(name, std::memory_order_relaxed);
+}
+
+// "s" as the body of a JSON string
+static void write_json_string(FILE *fp, const char *s) {
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\')
+      fputc('\\', fp);
+    fputc(*s, fp);
+  }
+}
+
+bool trace_t::dump(const char *path) const {
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    fprintf(stderr, "ERROR: failed to open trace file %s\n", path);
+    return false;
+  }
+
+  std::vector<trace_ring_t *> all;
+  {
+    std::lock_guard<std::mutex> guard(rings_lock);
+    all = rings;
+  }
+
+  std::vector<trace_event_t> events;
+  uint64_t written = 0;
+  const char *sep = "";
+  fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (trace_ring_t *r : all) {
+    const char *name = r->name.load(std::memory_order_relaxed);
+    if (name) {
+      fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                  "\"tid\":%u,\"args\":{\"name\":\"",
+              sep, r->tid);
+      write_json_string(fp, name);
+      fprintf(fp, "\"}}");
+      sep = ",\n";
+    }
+
+    // copy the ring, then drop what its thread may have overwritten
+    // while it was being copied. Event "now" is written before head
+    // moves past it, into the slot of event now - ring_size, so that slot
+    // counts as overwritten too.
+    const uint64_t head = r->head.load(std::memory_order_acquire);
+    uint64_t first = head > ring_size ? head - ring_size : 0;
+    events.resize(head - first);
+    for (uint64_t i = first; i < head; ++i)
+      events[i - first] = r->events[i % ring_size];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t now = r->head.load(std::memory_order_relaxed);
+    const uint64_t skip =
+        now + 1 > first + ring_size ? now + 1 - (first + ring_size) : 0;
+
+    for (uint64_t i = glm::min<uint64_t>(skip, events.size());
+         i < events.size(); ++i) {
+      const trace_event_t &e = events[i];
+      fprintf(fp, "%s{\"name\":\"", sep);
+      write_json_string(fp, e.name);
+      // ticks are only nanoseconds on linux; the format wants microseconds
+      const double ts =
+          e.time > origin
+              ? tsamplr_t::convert(e.time - origin, tsamplr_t::_us_)
+              : 0.0;
+      fprintf(fp, "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+              e.phase, ts, r->tid);
+      sep = ",\n";
+      ++written;
+    }
+  }
+  fprintf(fp, "\n]}\n");
+
+  const bool ok = !ferror(fp);
+  fclose(fp);
+  if (!ok) {
+    fprintf(stderr, "ERROR: failed to write trace file %s\n", path);
+    return false;
+  }
+  printf("trace: %llu events from %u threads written to %s\n",
+         (unsigned long long)written, (unsigned)all.size(), path);
+  return true;
+}
+
+#endif
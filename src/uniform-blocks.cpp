@@ -0,0 +1,32 @@
+#include "uniform-blocks.h"
+#include "gl-state.h"
+#include "stream-buffer.h"
+
+#include <cstring>
+
+static_assert(sizeof(camera_block_t) == 3 * 64 + 16,
+              "camera_block_t must match its std140 layout");
+
+// the alignment GL requires of uniform buffer ranges
+static GLsizeiptr uniform_alignment(void) {
+  static GLint align = 0;
+  if (!align)
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+  return glm::max(align, 1);
+}
+
+void upload_camera_block(const camera_t &cam) {
+  camera_block_t block;
+  block.view = cam.get_matrix();
+  block.proj = cam.get_proj();
+  block.view_proj = block.proj * block.view;
+  block.eye = glm::vec4(cam.get_pos(), 1.0f);
+
+  GLintptr offset;
+  void *dst = stream_buf.map(sizeof(block), uniform_alignment(), &offset);
+  memcpy(dst, &block, sizeof(block));
+  stream_buf.unmap();
+
+  gl_state.bind_buffer_range(GL_UNIFORM_BUFFER, UBO_CAMERA, stream_buf.handle,
+                             offset, sizeof(block));
+}